@@ -1,8 +1,23 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 fragColor;
+layout (location = 1) in vec2 fragTexCoord;
+layout (location = 2) flat in uint fragTexture;
 layout (location = 0) out vec4 outColor;
 
+// Set when the pipeline is built, see PipelineVariant
+layout (constant_id = 0) const float OPACITY = 1.0;
+
+// Every texture in the descriptor heap (see DescriptorHeap.h)
+layout (set = 0, binding = 0) uniform sampler2D textures[];
+
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    vec3 color = fragColor;
+
+    // Neighbouring objects can use different textures within one draw, so the index needs nonuniformEXT
+    if (fragTexture != NO_TEXTURE) color *= texture(textures[nonuniformEXT(fragTexture)], fragTexCoord).rgb;
+    outColor = vec4(color, OPACITY);
+}
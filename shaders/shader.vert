@@ -1,20 +1,55 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-vec2 positions[3] = vec2[](
-vec2(0.0, -0.5),
-vec2(0.5, 0.5),
-vec2(-0.5, 0.5)
-);
+layout (location = 0) in vec2 inPosition;
+layout (location = 1) in vec3 inColor;
 
-vec3 colors[3] = vec3[](
-vec3(1.0, 0.0, 0.0),
-vec3(0.0, 1.0, 0.0),
-vec3(0.0, 0.0, 1.0)
-);
+// Per instance
+layout (location = 2) in vec2 instanceOffset;
+layout (location = 3) in float instanceScale;
+layout (location = 4) in float instanceDepth;
 
 layout (location = 0) out vec3 fragColor;
+layout (location = 1) out vec2 fragTexCoord;
+layout (location = 2) flat out uint fragTexture;
+
+struct Material {
+    vec4 tint;
+};
+
+// Every storage buffer in the descriptor heap (see DescriptorHeap.h), seen as a material buffer
+layout (set = 0, binding = 1) readonly buffer MaterialBuffer {
+    Material materials[];
+} buffers[];
+
+// The same storage buffers again, seen as texture tables: the heap element of each streamed texture
+layout (set = 0, binding = 1) readonly buffer TextureTable {
+    uint textures[];
+} textureTables[];
+
+// Mirrors DrawConstants and NO_TEXTURE in Mesh.h
+layout (push_constant) uniform DrawConstants {
+    uint materialBuffer;
+    uint materialCount;
+    uint textureTable;
+    uint textureCount;
+    vec2 viewOffset;
+    float viewScale;
+} draw;
+
+const uint NO_TEXTURE = 0xFFFFFFFFu;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    vec2 position = inPosition * instanceScale + instanceOffset;
+    gl_Position = vec4((position - draw.viewOffset) * draw.viewScale, instanceDepth, 1.0);
+
+    // The index comes from a push constant, so it is the same for the whole draw and needs no nonuniformEXT
+    Material material = buffers[draw.materialBuffer].materials[gl_InstanceIndex % draw.materialCount];
+    fragColor = inColor * material.tint.rgb;
+
+    fragTexture = NO_TEXTURE;
+    if (draw.textureCount > 0) {
+        fragTexture = textureTables[draw.textureTable].textures[gl_InstanceIndex % draw.textureCount];
+    }
+    fragTexCoord = inPosition * 0.5 + 0.5;
+}
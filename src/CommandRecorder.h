@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Draw lists shorter than this are not worth handing to another thread
+const uint32_t MIN_DRAWS_PER_RECORD_SLICE = 256;
+
+// Splits the recording of a long draw list across worker threads. Every slice is recorded into a secondary command
+// buffer that comes from a command pool of its own, because pools are externally synchronized and two threads must
+// never touch the same one. There is a set of pools per frame in flight, so all of a frame's secondaries are recycled
+// with a single vkResetCommandPool per pool once that frame has finished on the GPU
+class ParallelCommandRecorder {
+public:
+    // Records draws [first, first + count) into an already begun secondary command buffer. Called from worker threads
+    using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)>;
+
+private:
+    struct SliceCommands {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    };
+
+    VkDevice device;
+    ThreadPool threadPool;
+    std::vector<std::vector<SliceCommands>> frames;  // [frame in flight][slice]
+
+public:
+    ParallelCommandRecorder(VkDevice device, uint32_t queueFamily, uint32_t framesInFlight, uint32_t threadCount)
+        : device(device), threadPool(threadCount) {
+        frames.resize(framesInFlight, std::vector<SliceCommands>(threadPool.size()));
+
+        for (auto &slices : frames) {
+            for (auto &slice : slices) {
+                VkCommandPoolCreateInfo poolInfo{};
+                poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;  // Reset as a whole every frame
+                poolInfo.queueFamilyIndex = queueFamily;
+
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &slice.commandPool) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create recording thread command pool");
+                }
+
+                VkCommandBufferAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = slice.commandPool;
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = 1;
+
+                if (vkAllocateCommandBuffers(device, &allocInfo, &slice.commandBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to allocate secondary command buffer");
+                }
+            }
+        }
+    }
+
+    ~ParallelCommandRecorder() {
+        for (auto &slices : frames) {
+            for (auto &slice : slices) {
+                vkDestroyCommandPool(device, slice.commandPool, nullptr);
+            }
+        }
+    }
+
+    ParallelCommandRecorder(const ParallelCommandRecorder &) = delete;
+    ParallelCommandRecorder &operator=(const ParallelCommandRecorder &) = delete;
+
+    uint32_t threadCount() const { return threadPool.size(); }
+
+    // Records `drawCount` draws in up to `maxSlices` secondary command buffers and returns them in draw order, ready
+    // for vkCmdExecuteCommands. The previous contents of this frame's secondaries are thrown away, so the slot's last
+    // frame has to have finished first
+    std::vector<VkCommandBuffer> record(uint32_t frame, const VkCommandBufferInheritanceInfo &inheritanceInfo,
+                                        uint32_t drawCount, uint32_t maxSlices, const RecordFunction &recordDraws) {
+        std::vector<SliceCommands> &slices = frames[frame];
+
+        uint32_t usefulSlices = (drawCount + MIN_DRAWS_PER_RECORD_SLICE - 1) / MIN_DRAWS_PER_RECORD_SLICE;
+        uint32_t sliceCount = std::max(1u, std::min({maxSlices, threadPool.size(), usefulSlices}));
+        uint32_t drawsPerSlice = (drawCount + sliceCount - 1) / sliceCount;
+
+        std::vector<std::future<void>> pending;
+        std::vector<VkCommandBuffer> commandBuffers;
+        for (uint32_t i = 0; i < sliceCount; i++) {
+            SliceCommands slice = slices[i];
+            uint32_t first = std::min(i * drawsPerSlice, drawCount);
+            uint32_t count = std::min(drawsPerSlice, drawCount - first);
+
+            pending.push_back(threadPool.submit([this, slice, &inheritanceInfo, &recordDraws, first, count] {
+                vkResetCommandPool(device, slice.commandPool, 0);
+
+                VkCommandBufferBeginInfo beginInfo{};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags =
+                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+                beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+                if (vkBeginCommandBuffer(slice.commandBuffer, &beginInfo) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to begin recording secondary command buffer");
+                }
+
+                recordDraws(slice.commandBuffer, first, count);
+
+                if (vkEndCommandBuffer(slice.commandBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to record secondary command buffer");
+                }
+            }));
+            commandBuffers.push_back(slice.commandBuffer);
+        }
+
+        // Wait for every slice before rethrowing, the tasks reference our arguments
+        for (auto &slice : pending) slice.wait();
+        for (auto &slice : pending) slice.get();
+
+        return commandBuffers;
+    }
+};
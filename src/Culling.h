@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+
+// How far the view turns around the scene every frame when it is zoomed in, see animatedView()
+const float VIEW_PAN_RADIANS_PER_FRAME = 0.01f;
+
+// Heap element of the pyramid while there is none to test against
+const uint32_t NO_HIZ = UINT32_MAX;
+
+// Mirrors ObjectBounds in cull.comp. The objects are flat, so the bounding sphere is a circle in the plane the object
+// is drawn at
+struct ObjectBounds {
+    float center[2];
+    float radius;
+    float depth;
+};
+
+// What the camera sees: the scene is moved by -offset and then scaled, see shader.vert. Whatever lands outside [-1, 1]
+// is off screen
+struct CullView {
+    float offset[2] = {0.0f, 0.0f};
+    float scale = 1.0f;
+};
+
+// A zoom of 1 sees the whole scene and never moves. Above that the view circles around the scene, one full turn every
+// few hundred frames, so the set of visible objects changes every frame and has to be culled again
+inline CullView animatedView(float zoom, uint64_t frameNumber) {
+    CullView view;
+    view.scale = zoom;
+
+    float reach = 1.0f - 1.0f / zoom;  // Keeps the edge of the view inside the scene
+    float angle = static_cast<float>(frameNumber % 100000) * VIEW_PAN_RADIANS_PER_FRAME;
+    view.offset[0] = reach * std::cos(angle);
+    view.offset[1] = reach * std::sin(angle);
+    return view;
+}
+
+// A circle around every vertex of the mesh, in the mesh's own coordinates
+inline ObjectBounds computeMeshBounds(const Mesh &mesh) {
+    float minimum[2] = {INFINITY, INFINITY};
+    float maximum[2] = {-INFINITY, -INFINITY};
+    for (auto &vertex : mesh.vertices) {
+        for (int axis = 0; axis < 2; axis++) {
+            minimum[axis] = std::min(minimum[axis], vertex.position[axis]);
+            maximum[axis] = std::max(maximum[axis], vertex.position[axis]);
+        }
+    }
+
+    ObjectBounds bounds{};
+    bounds.center[0] = (minimum[0] + maximum[0]) * 0.5f;
+    bounds.center[1] = (minimum[1] + maximum[1]) * 0.5f;
+    for (auto &vertex : mesh.vertices) {
+        float dx = vertex.position[0] - bounds.center[0];
+        float dy = vertex.position[1] - bounds.center[1];
+        bounds.radius = std::max(bounds.radius, std::sqrt(dx * dx + dy * dy));
+    }
+    return bounds;
+}
+
+// The mesh bounds placed the way shader.vert places every instance
+inline std::vector<ObjectBounds> computeObjectBounds(const ObjectBounds &meshBounds,
+                                                     const std::vector<InstanceData> &instances) {
+    std::vector<ObjectBounds> bounds(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        const InstanceData &instance = instances[i];
+        bounds[i].center[0] = meshBounds.center[0] * instance.scale + instance.offset[0];
+        bounds[i].center[1] = meshBounds.center[1] * instance.scale + instance.offset[1];
+        bounds[i].radius = meshBounds.radius * instance.scale;
+        bounds[i].depth = instance.depth;
+    }
+    return bounds;
+}
+
+// The view is an orthographic box, [-1, 1] in x and y and [0, 1] in depth, so its six planes come down to comparing
+// against those bounds. cull.comp does the same test
+inline bool isInView(const ObjectBounds &object, const CullView &view) {
+    float x = (object.center[0] - view.offset[0]) * view.scale;
+    float y = (object.center[1] - view.offset[1]) * view.scale;
+    float radius = object.radius * view.scale;
+    return std::abs(x) <= 1.0f + radius && std::abs(y) <= 1.0f + radius && object.depth >= 0.0f &&
+           object.depth <= 1.0f;
+}
+
+// Mirrors the push constant block in cull.comp
+struct CullConstants {
+    float viewOffset[2];
+    float viewScale;
+    uint32_t objectCount;
+    float previousViewOffset[2];  // The view the pyramid was built with
+    float previousViewScale;
+    uint32_t hizBuffer;  // NO_HIZ without occlusion culling, or before the first pyramid
+    uint32_t boundsBuffer;
+    uint32_t sourceDrawBuffer;
+    uint32_t drawBuffer;
+    uint32_t countBuffer;
+    uint32_t hizWidth;  // Size of level 0 of the pyramid
+    uint32_t hizHeight;
+    uint32_t hizLevelCount;
+};
+
+// Mirrors the push constant block in hiz.comp
+struct HiZConstants {
+    uint32_t depthTexture;
+    uint32_t hizBuffer;
+    uint32_t level;
+    uint32_t sourceOffset;
+    uint32_t sourceSize[2];
+    uint32_t offset;
+    uint32_t padding;
+    uint32_t size[2];
+};
+
+struct HiZLevel {
+    uint32_t width;
+    uint32_t height;
+    uint32_t offset;  // In texels from the start of the pyramid
+};
+
+// Level 0 is half the depth buffer, rounded up, and every level after that is half the one before, down to a single
+// texel. Rounding up means no texel of a level is left out of the one below it. cull.comp lays the levels out the same
+inline std::vector<HiZLevel> hizLevels(uint32_t depthWidth, uint32_t depthHeight) {
+    std::vector<HiZLevel> levels;
+    uint32_t width = (depthWidth + 1) / 2;
+    uint32_t height = (depthHeight + 1) / 2;
+    uint32_t offset = 0;
+    while (true) {
+        levels.push_back({width, height, offset});
+        offset += width * height;
+        if (width == 1 && height == 1) break;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    return levels;
+}
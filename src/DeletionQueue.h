@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Objects that frames still in flight may be using when they are released. Each one is destroyed once the frame it was
+// released after has finished on the GPU, instead of waiting for the whole device to go idle:
+//
+//   deletionQueue.retire(lastSubmittedFrame, std::move(oldPipeline));
+//   ...
+//   deletionQueue.collect(completedFrame);  // Every frame, once the frame slot has been waited for
+//
+// Frame numbers are the values of the frame timeline (see TimelineSemaphore.h), so a frame has finished when the
+// timeline has reached its number
+class DeletionQueue {
+    struct Deletion {
+        uint64_t frame;
+        std::function<void()> destroy;
+    };
+
+    std::vector<Deletion> deletions;  // In release order
+
+public:
+    DeletionQueue() = default;
+    ~DeletionQueue() { flush(); }
+
+    DeletionQueue(const DeletionQueue &) = delete;
+    DeletionQueue &operator=(const DeletionQueue &) = delete;
+
+    // For anything that isn't owned by an RAII wrapper, e.g. buffers and images from the memory allocator
+    void push(uint64_t frame, std::function<void()> destroy) { deletions.push_back({frame, std::move(destroy)}); }
+
+    // Takes ownership of RAII handles, or containers of them, and lets them go out of scope once `frame` has finished
+    template <typename T>
+    void retire(uint64_t frame, T objects) {
+        static_assert(std::is_default_constructible_v<T>, "Retired objects are released by assigning an empty one");
+        // std::function needs a copyable callable and the objects are move-only
+        auto owned = std::make_shared<T>(std::move(objects));
+        push(frame, [owned] { *owned = T{}; });
+    }
+
+    // Destroys everything released up to and including `completedFrame`, in release order
+    void collect(uint64_t completedFrame) {
+        for (auto &deletion : deletions) {
+            if (deletion.frame <= completedFrame) deletion.destroy();
+        }
+        std::erase_if(deletions, [&](const Deletion &deletion) { return deletion.frame <= completedFrame; });
+    }
+
+    // Only once the device is idle
+    void flush() {
+        for (auto &deletion : deletions) deletion.destroy();
+        deletions.clear();
+    }
+
+    bool empty() const { return deletions.empty(); }
+};
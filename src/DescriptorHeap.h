@@ -0,0 +1,319 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Every pipeline layout reserves this set for the descriptor heap. Its bindings are runtime sized arrays in the
+// shaders, and a draw picks the elements it needs with indices from its push constants instead of binding a set of
+// its own, see shader.vert
+const uint32_t DESCRIPTOR_HEAP_SET = 0;
+const uint32_t DESCRIPTOR_HEAP_TEXTURE_BINDING = 0;  // Combined image samplers
+const uint32_t DESCRIPTOR_HEAP_BUFFER_BINDING = 1;   // Storage buffers
+const uint32_t DEFAULT_DESCRIPTOR_HEAP_TEXTURES = 4096;
+const uint32_t DEFAULT_DESCRIPTOR_HEAP_BUFFERS = 1024;
+// Left out of the per-stage resource limits for the other sets of a pipeline layout and the color attachments
+const uint32_t DESCRIPTOR_HEAP_RESERVED_RESOURCES = 32;
+
+// Sets a pool of the per-frame allocator has room for before another pool is created
+const uint32_t FRAME_DESCRIPTOR_SETS_PER_POOL = 4;
+
+// Hands out the elements of one descriptor array. Freed elements are reused before the array grows, so the part of it
+// in use stays as short as possible
+class DescriptorSlots {
+    uint32_t capacity;
+    uint32_t nextSlot = 0;  // Every slot from here on has never been handed out
+    std::vector<uint32_t> freeSlots;
+
+public:
+    explicit DescriptorSlots(uint32_t capacity) : capacity(capacity) {}
+
+    uint32_t allocate() {
+        if (!freeSlots.empty()) {
+            uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+        if (nextSlot == capacity) throw std::runtime_error("Descriptor heap is full");
+        return nextSlot++;
+    }
+
+    void free(uint32_t slot) { freeSlots.push_back(slot); }
+
+    // One past the highest slot ever handed out
+    uint32_t end() const { return nextSlot; }
+};
+
+// Descriptor sets that only live for one frame. Each frame in flight has its own list of pools; sets are never freed
+// one by one, instead every pool of a frame is reset at once when that frame slot comes around again. The list only
+// grows when a frame needs more sets than it ever did before
+class FrameDescriptorAllocator {
+    struct FramePools {
+        std::vector<VkDescriptorPool> pools;
+        size_t current = 0;  // Pools before this one are full
+    };
+
+    VkDevice device;
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    uint32_t setsPerPool;
+    std::vector<FramePools> frames;
+
+public:
+    // `poolSizes` is what a single pool holds, so it has to fit at least the largest set allocated from it
+    FrameDescriptorAllocator(VkDevice device, uint32_t framesInFlight, std::vector<VkDescriptorPoolSize> poolSizes,
+                             uint32_t setsPerPool)
+        : device(device), poolSizes(std::move(poolSizes)), setsPerPool(setsPerPool), frames(framesInFlight) {}
+
+    ~FrameDescriptorAllocator() {
+        for (auto &frame : frames) {
+            for (auto pool : frame.pools) vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+    }
+
+    FrameDescriptorAllocator(const FrameDescriptorAllocator &) = delete;
+    FrameDescriptorAllocator &operator=(const FrameDescriptorAllocator &) = delete;
+
+    VkDescriptorSet allocate(uint32_t frame, VkDescriptorSetLayout layout) {
+        FramePools &framePools = frames[frame];
+
+        while (true) {
+            bool freshPool = framePools.current == framePools.pools.size();
+            if (freshPool) framePools.pools.push_back(createPool());
+
+            VkDescriptorSetAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = framePools.pools[framePools.current];
+            allocInfo.descriptorSetCount = 1;
+            allocInfo.pSetLayouts = &layout;
+
+            VkDescriptorSet set;
+            VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+            if (result == VK_SUCCESS) return set;
+
+            // Out of room: move on to the next pool, or make one
+            if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || freshPool) {
+                throw std::runtime_error("Failed to allocate per-frame descriptor set");
+            }
+            framePools.current++;
+        }
+    }
+
+    // Frees every set allocated for `frame`. The slot's last frame has to have finished first
+    void reset(uint32_t frame) {
+        FramePools &framePools = frames[frame];
+        for (auto pool : framePools.pools) vkResetDescriptorPool(device, pool, 0);
+        framePools.current = 0;
+    }
+
+private:
+    VkDescriptorPool createPool() {
+        std::vector<VkDescriptorPoolSize> sizes = poolSizes;
+        for (auto &size : sizes) size.descriptorCount *= setsPerPool;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = setsPerPool;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(sizes.size());
+        poolInfo.pPoolSizes = sizes.data();
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor pool");
+        }
+        return pool;
+    }
+};
+
+// Every texture and storage buffer of the application in one descriptor set, so thousands of materials can be drawn
+// without ever binding another set.
+//
+// With update after bind (descriptor indexing, core in Vulkan 1.2) there is exactly one set, allocated up front, and
+// adding a resource writes its element right away, even while command buffers using the set are in flight. Devices
+// without it get the pooled fallback: the heap only remembers what every element holds, and every frame a fresh set is
+// allocated from a FrameDescriptorAllocator and filled with whatever is in use
+class DescriptorHeap {
+    VkDevice device;
+    bool updateAfterBind;
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool pool = VK_NULL_HANDLE;  // Update after bind only
+    VkDescriptorSet set = VK_NULL_HANDLE;    // Update after bind only
+    std::unique_ptr<FrameDescriptorAllocator> frameAllocator;  // Pooled fallback only
+
+    DescriptorSlots textureSlots;
+    DescriptorSlots bufferSlots;
+
+    // What every element currently holds, null handles for free ones
+    std::vector<VkDescriptorImageInfo> textures;
+    std::vector<VkDescriptorBufferInfo> buffers;
+
+public:
+    DescriptorHeap(VkDevice device, uint32_t framesInFlight, uint32_t textureCapacity, uint32_t bufferCapacity,
+                   bool updateAfterBind)
+        : device(device),
+          updateAfterBind(updateAfterBind),
+          textureSlots(textureCapacity),
+          bufferSlots(bufferCapacity),
+          textures(textureCapacity),
+          buffers(bufferCapacity) {
+        VkDescriptorSetLayoutBinding bindings[2]{};
+        bindings[0].binding = DESCRIPTOR_HEAP_TEXTURE_BINDING;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = textureCapacity;
+        bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+        bindings[1].binding = DESCRIPTOR_HEAP_BUFFER_BINDING;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = bufferCapacity;
+        bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+        // Elements that are never written are fine as long as no shader reads them
+        VkDescriptorBindingFlags bindingFlag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        if (updateAfterBind) {
+            bindingFlag |=
+                VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        }
+        VkDescriptorBindingFlags bindingFlags[] = {bindingFlag, bindingFlag};
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(std::size(bindingFlags));
+        bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = updateAfterBind ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT : 0;
+        layoutInfo.bindingCount = static_cast<uint32_t>(std::size(bindings));
+        layoutInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor heap layout");
+        }
+
+        std::vector<VkDescriptorPoolSize> poolSizes = {
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCapacity},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferCapacity},
+        };
+
+        if (!updateAfterBind) {
+            frameAllocator = std::make_unique<FrameDescriptorAllocator>(device, framesInFlight, poolSizes,
+                                                                        FRAME_DESCRIPTOR_SETS_PER_POOL);
+            return;
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+            throw std::runtime_error("Failed to create descriptor heap pool");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+            vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+            throw std::runtime_error("Failed to allocate descriptor heap set");
+        }
+    }
+
+    ~DescriptorHeap() {
+        frameAllocator.reset();
+        if (pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(device, pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    }
+
+    DescriptorHeap(const DescriptorHeap &) = delete;
+    DescriptorHeap &operator=(const DescriptorHeap &) = delete;
+
+    VkDescriptorSetLayout layout() const { return setLayout; }
+    bool isUpdateAfterBind() const { return updateAfterBind; }
+
+    // Returns the element the shaders find the texture at. The image has to be in SHADER_READ_ONLY_OPTIMAL layout
+    uint32_t addTexture(VkImageView imageView, VkSampler sampler) {
+        uint32_t slot = textureSlots.allocate();
+        textures[slot] = {sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        if (updateAfterBind) write(set, DESCRIPTOR_HEAP_TEXTURE_BINDING, slot, 1);
+        return slot;
+    }
+
+    uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) {
+        uint32_t slot = bufferSlots.allocate();
+        buffers[slot] = {buffer, offset, range};
+        if (updateAfterBind) write(set, DESCRIPTOR_HEAP_BUFFER_BINDING, slot, 1);
+        return slot;
+    }
+
+    // The element may be handed out again by the very next add, so only remove resources once every frame that could
+    // still read them has finished
+    void removeTexture(uint32_t slot) {
+        textures[slot] = {};
+        textureSlots.free(slot);
+    }
+
+    void removeBuffer(uint32_t slot) {
+        buffers[slot] = {};
+        bufferSlots.free(slot);
+    }
+
+    // The set to bind at DESCRIPTOR_HEAP_SET for `frame`. With the pooled fallback this recycles the sets of the
+    // previous use of the frame slot, so that frame has to have finished first, and writes every element in use into a
+    // new set, in as few writes as there are runs of consecutive elements
+    VkDescriptorSet beginFrame(uint32_t frame) {
+        if (updateAfterBind) return set;
+
+        frameAllocator->reset(frame);
+        VkDescriptorSet frameSet = frameAllocator->allocate(frame, setLayout);
+        writeUsed(frameSet, DESCRIPTOR_HEAP_TEXTURE_BINDING, textureSlots.end(),
+                  [this](uint32_t slot) { return textures[slot].imageView != VK_NULL_HANDLE; });
+        writeUsed(frameSet, DESCRIPTOR_HEAP_BUFFER_BINDING, bufferSlots.end(),
+                  [this](uint32_t slot) { return buffers[slot].buffer != VK_NULL_HANDLE; });
+        return frameSet;
+    }
+
+private:
+    // Writes elements [first, first + count) of a binding from what the heap remembers about them
+    void write(VkDescriptorSet dstSet, uint32_t binding, uint32_t first, uint32_t count) {
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = dstSet;
+        descriptorWrite.dstBinding = binding;
+        descriptorWrite.dstArrayElement = first;
+        descriptorWrite.descriptorCount = count;
+        if (binding == DESCRIPTOR_HEAP_TEXTURE_BINDING) {
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrite.pImageInfo = &textures[first];
+        } else {
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrite.pBufferInfo = &buffers[first];
+        }
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    template <typename IsUsed>
+    void writeUsed(VkDescriptorSet dstSet, uint32_t binding, uint32_t end, IsUsed isUsed) {
+        for (uint32_t first = 0; first < end;) {
+            if (!isUsed(first)) {
+                first++;
+                continue;
+            }
+            uint32_t last = first + 1;
+            while (last < end && isUsed(last)) last++;
+            write(dstSet, binding, first, last - first);
+            first = last;
+        }
+    }
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Device type outweighs everything else: the best integrated GPU still loses to the worst discrete one. The rest of
+// the score only decides between devices of the same type
+const int64_t DEVICE_SCORE_DISCRETE = 400000;
+const int64_t DEVICE_SCORE_INTEGRATED = 300000;
+const int64_t DEVICE_SCORE_VIRTUAL = 200000;
+const int64_t DEVICE_SCORE_CPU = 100000;
+
+// With --prefer-cpu a software implementation (e.g. lavapipe) beats any type of GPU
+const int64_t DEVICE_SCORE_PREFERRED_CPU = 1000000;
+
+// Per GiB of the largest device local heap, up to a cap. Integrated GPUs report part of system memory as device local,
+// so the cap keeps a machine with a lot of RAM from looking like a card with a lot of VRAM
+const int64_t DEVICE_SCORE_PER_GIB = 1000;
+const int64_t DEVICE_SCORE_MAX_MEMORY = 16 * DEVICE_SCORE_PER_GIB;
+
+// Per queue capability and per optional feature the renderer makes use of
+const int64_t DEVICE_SCORE_QUEUE = 2000;
+const int64_t DEVICE_SCORE_FEATURE = 1000;
+
+// The most the rest of the score can add up to, for the two queues and seven features scoreDevice() looks at. Each
+// device type has to stay ahead of the next one down by more than that
+const int64_t DEVICE_SCORE_MAX_EXTRAS = DEVICE_SCORE_MAX_MEMORY + 2 * DEVICE_SCORE_QUEUE + 7 * DEVICE_SCORE_FEATURE;
+static_assert(DEVICE_SCORE_CPU > DEVICE_SCORE_MAX_EXTRAS);
+static_assert(DEVICE_SCORE_VIRTUAL - DEVICE_SCORE_CPU > DEVICE_SCORE_MAX_EXTRAS);
+static_assert(DEVICE_SCORE_INTEGRATED - DEVICE_SCORE_VIRTUAL > DEVICE_SCORE_MAX_EXTRAS);
+static_assert(DEVICE_SCORE_DISCRETE - DEVICE_SCORE_INTEGRATED > DEVICE_SCORE_MAX_EXTRAS);
+static_assert(DEVICE_SCORE_PREFERRED_CPU - DEVICE_SCORE_DISCRETE > DEVICE_SCORE_MAX_EXTRAS);
+
+// Environment variable with the same meaning as --device, for when the command line isn't at hand (e.g. CI)
+const char *const DEVICE_OVERRIDE_VARIABLE = "VK_LEARNING_DEVICE";
+
+// What a device is scored on. Only things that help the renderer go faster or use fewer fallbacks count; what it
+// can't run without at all is checked by isDeviceSuitable()
+struct DeviceCapabilities {
+    VkPhysicalDeviceType type;
+    VkDeviceSize deviceLocalBytes = 0;    // Largest device local heap
+    bool dedicatedTransferQueue = false;  // A copy engine for texture streaming
+    bool asyncComputeQueue = false;       // Compute without graphics
+    bool timestamps = false;              // On the graphics queue, for the GPU profiler
+    bool multiDrawIndirect = false;
+    bool drawIndirectCount = false;
+    bool bindlessDescriptors = false;  // Update after bind for both heap bindings
+    bool nonUniformIndexing = false;   // Texture streaming
+    bool pipelineStatistics = false;   // Overdraw counter
+    bool presentWait = false;          // Frame pacing
+};
+
+// Takes the properties isDeviceSuitable() already queried. The features are only looked at on Vulkan 1.3 devices, the
+// others can't be used anyway and may not know the Vulkan 1.2 feature structure
+inline DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice device, const VkPhysicalDeviceProperties &properties,
+                                                  const std::set<std::string> &extensions) {
+    DeviceCapabilities capabilities;
+    capabilities.type = properties.deviceType;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        const VkMemoryHeap &heap = memoryProperties.memoryHeaps[i];
+        if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            capabilities.deviceLocalBytes = std::max(capabilities.deviceLocalBytes, heap.size);
+        }
+    }
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+    for (auto &queueFamily : queueFamilies) {
+        bool graphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        bool compute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+        bool transfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+        if (transfer && !graphics && !compute) capabilities.dedicatedTransferQueue = true;
+        if (compute && !graphics) capabilities.asyncComputeQueue = true;
+        if (graphics && queueFamily.timestampValidBits != 0) capabilities.timestamps = true;
+    }
+
+    if (properties.apiVersion < VK_API_VERSION_1_3) return capabilities;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &vulkan12Features;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+
+    capabilities.multiDrawIndirect = features2.features.multiDrawIndirect;
+    capabilities.drawIndirectCount = vulkan12Features.drawIndirectCount;
+    capabilities.bindlessDescriptors = vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+                                       vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind;
+    capabilities.nonUniformIndexing = vulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+    capabilities.pipelineStatistics = features2.features.pipelineStatisticsQuery;
+    capabilities.presentWait = extensions.count(VK_KHR_PRESENT_ID_EXTENSION_NAME) != 0 &&
+                               extensions.count(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) != 0;
+    return capabilities;
+}
+
+inline int64_t scoreDevice(const DeviceCapabilities &capabilities, bool preferCpu) {
+    int64_t score = 0;
+    switch (capabilities.type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            score += DEVICE_SCORE_DISCRETE;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            score += DEVICE_SCORE_INTEGRATED;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            score += DEVICE_SCORE_VIRTUAL;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            score += preferCpu ? DEVICE_SCORE_PREFERRED_CPU : DEVICE_SCORE_CPU;
+            break;
+        default:
+            break;
+    }
+
+    int64_t gibibytes = static_cast<int64_t>(capabilities.deviceLocalBytes >> 30);
+    score += std::min(gibibytes * DEVICE_SCORE_PER_GIB, DEVICE_SCORE_MAX_MEMORY);
+
+    for (bool queue : {capabilities.dedicatedTransferQueue, capabilities.asyncComputeQueue}) {
+        if (queue) score += DEVICE_SCORE_QUEUE;
+    }
+    for (bool feature : {capabilities.timestamps, capabilities.multiDrawIndirect, capabilities.drawIndirectCount,
+                         capabilities.bindlessDescriptors, capabilities.nonUniformIndexing,
+                         capabilities.pipelineStatistics, capabilities.presentWait}) {
+        if (feature) score += DEVICE_SCORE_FEATURE;
+    }
+    return score;
+}
+
+// The override is either an index in enumeration order, as listed by --device-info, or part of the device name,
+// ignoring case. Nothing if no device matches
+inline std::optional<size_t> findOverriddenDevice(const std::string &deviceOverride,
+                                                  const std::vector<std::string> &deviceNames) {
+    bool isIndex = !deviceOverride.empty() && std::all_of(deviceOverride.begin(), deviceOverride.end(),
+                                                           [](unsigned char c) { return std::isdigit(c); });
+    if (isIndex) {
+        size_t index = std::stoul(deviceOverride);
+        if (index < deviceNames.size()) return index;
+        return std::nullopt;
+    }
+
+    auto lower = [](std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+        return text;
+    };
+    std::string wanted = lower(deviceOverride);
+    for (size_t i = 0; i < deviceNames.size(); i++) {
+        if (lower(deviceNames[i]).find(wanted) != std::string::npos) return i;
+    }
+    return std::nullopt;
+}
+
+inline const char *deviceTypeName(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "cpu";
+        default:
+            return "other";
+    }
+}
+
+// One line per device for --device-info, e.g. "Vulkan 1.3.255, 8192 MiB, transfer queue, ..."
+inline std::string describeDevice(const VkPhysicalDeviceProperties &properties,
+                                  const DeviceCapabilities &capabilities) {
+    char summary[128];
+    std::snprintf(summary, sizeof(summary), "%s, Vulkan %u.%u.%u, driver 0x%x, %llu MiB",
+                  deviceTypeName(properties.deviceType), VK_API_VERSION_MAJOR(properties.apiVersion),
+                  VK_API_VERSION_MINOR(properties.apiVersion), VK_API_VERSION_PATCH(properties.apiVersion),
+                  properties.driverVersion, static_cast<unsigned long long>(capabilities.deviceLocalBytes >> 20));
+
+    std::string description = summary;
+    std::pair<bool, const char *> flags[] = {
+        {capabilities.dedicatedTransferQueue, "transfer queue"},
+        {capabilities.asyncComputeQueue, "async compute"},
+        {capabilities.timestamps, "timestamps"},
+        {capabilities.multiDrawIndirect, "multi draw indirect"},
+        {capabilities.drawIndirectCount, "draw indirect count"},
+        {capabilities.bindlessDescriptors, "bindless"},
+        {capabilities.nonUniformIndexing, "non-uniform indexing"},
+        {capabilities.pipelineStatistics, "pipeline statistics"},
+        {capabilities.presentWait, "present wait"},
+    };
+    for (auto &[supported, name] : flags) {
+        if (supported) description += std::string(", ") + name;
+    }
+    return description;
+}
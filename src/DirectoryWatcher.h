@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#else
+#include <unordered_map>
+#endif
+
+// How often the portable fallback rescans the directory. inotify needs no such limit since reading it is free when
+// nothing happened
+const std::chrono::milliseconds DIRECTORY_SCAN_INTERVAL(250);
+
+// Reports files in one directory that were written since the last poll(). poll() never blocks, so the render loop can
+// call it every frame.
+//
+// On Linux this is an inotify watch on the directory rather than on the files themselves, because many editors save by
+// writing a new file and renaming it over the old one. Elsewhere it compares modification times
+class DirectoryWatcher {
+    std::filesystem::path directory;
+
+#ifdef __linux__
+    int fd = -1;
+#else
+    std::unordered_map<std::string, std::filesystem::file_time_type> modificationTimes;
+    std::chrono::steady_clock::time_point lastScan;
+#endif
+
+public:
+    explicit DirectoryWatcher(const std::filesystem::path &directory) : directory(directory) {
+        if (!std::filesystem::is_directory(directory)) {
+            throw std::runtime_error("Not a directory: " + directory.string());
+        }
+
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Failed to initialize inotify");
+        if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close(fd);
+            throw std::runtime_error("Failed to watch directory: " + directory.string());
+        }
+#else
+        scan();  // Everything that exists now is the baseline
+        lastScan = std::chrono::steady_clock::now();
+#endif
+    }
+
+    ~DirectoryWatcher() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+    const std::filesystem::path &path() const { return directory; }
+
+    // Names (relative to the directory) of the files that changed, each only once no matter how many writes it took
+    std::vector<std::string> poll() {
+        std::set<std::string> changed;
+
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                if (length < 0 && errno != EAGAIN && errno != EINTR) {
+                    throw std::runtime_error("Failed to read inotify events");
+                }
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < length;) {
+                auto event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                if (event->len > 0) changed.insert(event->name);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+        }
+#else
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastScan < DIRECTORY_SCAN_INTERVAL) return {};
+        lastScan = now;
+        changed = scan();
+#endif
+
+        return {changed.begin(), changed.end()};
+    }
+
+private:
+#ifndef __linux__
+    std::set<std::string> scan() {
+        std::set<std::string> changed;
+        std::error_code error;
+        for (auto &entry : std::filesystem::directory_iterator(directory, error)) {
+            if (!entry.is_regular_file(error)) continue;
+
+            auto time = entry.last_write_time(error);
+            if (error) continue;  // Deleted or being replaced right now; the next scan picks it up
+
+            std::string name = entry.path().filename().string();
+            auto [existing, inserted] = modificationTimes.try_emplace(name, time);
+            if (!inserted && existing->second != time) {
+                existing->second = time;
+                changed.insert(name);
+            }
+        }
+        return changed;
+    }
+#endif
+};
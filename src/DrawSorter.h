@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Draw lists are ordered by a packed 64 bit key, so sorting never has to look at the draws themselves:
+//
+//   bits 63..56  pipeline (state changes are the most expensive thing to get wrong, so they sort first)
+//   bits 55..32  depth, quantized to 24 bits
+//   bits 31..0   index of the draw in the unsorted list
+//
+// Only the upper 32 bits are sorted on. The sort is stable and the index starts out in ascending order, so it stays
+// that way within equal keys and the index does not need passes of its own
+const uint32_t DRAW_SORT_DEPTH_BITS = 24;
+const uint32_t DRAW_SORT_FIRST_BIT = 32;
+
+// `depth` in [0, 1], 0 being nearest. Back-to-front orders (for blending) pass 1 - depth
+inline uint64_t makeDrawSortKey(uint32_t pipeline, float depth, uint32_t drawIndex) {
+    const uint32_t maxDepth = (1u << DRAW_SORT_DEPTH_BITS) - 1;
+    uint32_t quantizedDepth = static_cast<uint32_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(maxDepth));
+    return static_cast<uint64_t>(pipeline & 0xFF) << 56 | static_cast<uint64_t>(quantizedDepth) << 32 | drawIndex;
+}
+
+inline uint32_t drawSortKeyIndex(uint64_t key) { return static_cast<uint32_t>(key); }
+
+// Least significant digit radix sort on 8 bit digits, from DRAW_SORT_FIRST_BIT up. Linear in the number of draws,
+// unlike std::sort, and a pass is skipped entirely when every key has the same digit (e.g. a single pipeline).
+// `scratch` is only there so the caller can keep its capacity around between frames
+inline void radixSortDrawKeys(std::vector<uint64_t> &keys, std::vector<uint64_t> &scratch) {
+    scratch.resize(keys.size());
+
+    for (uint32_t shift = DRAW_SORT_FIRST_BIT; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (uint64_t key : keys) counts[(key >> shift) & 0xFF]++;
+        if (std::find(std::begin(counts), std::end(counts), keys.size()) != std::end(counts)) continue;
+
+        // Counts become the position of the first key with each digit
+        size_t offset = 0;
+        for (size_t &count : counts) offset += std::exchange(count, offset);
+
+        for (uint64_t key : keys) scratch[counts[(key >> shift) & 0xFF]++] = key;
+        keys.swap(scratch);
+    }
+}
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "ThreadPool.h"
+
+// Readback buffers in the ring. The GPU holds at most one per frame in flight and the writer one at a time; the rest
+// lets the writer fall behind for a moment without frames being dropped
+const uint32_t DEFAULT_CAPTURE_BUFFER_COUNT = 6;
+
+// The most a deflate stored block can hold
+const size_t PNG_STORED_BLOCK_SIZE = 65535;
+
+enum class CaptureFormat {
+    Raw,   // One file per frame with the tightly packed RGBA8 pixels, top row first
+    Png,   // One file per frame, RGB and uncompressed, see writePng()
+    Pipe,  // Raw RGBA8 frames back to back on the standard input of a command, e.g. a video encoder
+};
+
+inline const char *captureFormatName(CaptureFormat captureFormat) {
+    switch (captureFormat) {
+        case CaptureFormat::Raw:
+            return "raw";
+        case CaptureFormat::Png:
+            return "png";
+        case CaptureFormat::Pipe:
+            return "pipe";
+    }
+    return "unknown";
+}
+
+inline CaptureFormat parseCaptureFormat(const std::string &name) {
+    for (auto captureFormat : {CaptureFormat::Raw, CaptureFormat::Png, CaptureFormat::Pipe}) {
+        if (name == captureFormatName(captureFormat)) return captureFormat;
+    }
+    throw std::runtime_error("Unknown capture format: " + name);
+}
+
+// Gets rendered frames out without slowing the frame loop down. A captured frame copies its image into the next free
+// buffer of a ring of host visible buffers, as a pass at the end of its command buffer. Once the frame timeline shows
+// the frame has finished, the buffer goes to a writer thread, which converts and writes the pixels straight from the
+// mapped memory and then hands the buffer back.
+//
+// The frame loop never waits for any of it: when every buffer is still in use, the frame is just not captured and
+// counted as dropped. So is a frame whose size differs from the first one when piping, since an encoder reading raw
+// frames can't follow a resize
+class FrameCapture {
+    struct Slot {
+        Buffer buffer;
+        VkDeviceSize capacity = 0;
+        VkExtent2D extent{};
+        uint64_t frameNumber = 0;  // The frame whose copy is waiting to finish. 0 when there is none
+    };
+
+    DeviceMemoryAllocator &allocator;
+    CaptureFormat format;
+    std::string path;  // The output directory, or the command to pipe to
+    uint32_t interval;
+    bool swapRedBlue;  // BGRA images
+    VkMemoryPropertyFlags memoryProperties;
+
+    std::vector<Slot> slots;
+    std::unique_ptr<std::atomic<bool>[]> writing;  // Per slot, set while the writer has it
+    uint32_t nextSlot = 0;
+    uint64_t framesSeen = 0;
+    uint64_t framesCaptured = 0;
+    std::atomic<uint64_t> framesDropped = 0;  // The writer drops frames as well
+
+    FILE *pipe = nullptr;
+    VkExtent2D pipeExtent{};  // Of the first frame piped, only touched by the writer
+#ifndef _WIN32
+    void (*previousSigpipeHandler)(int) = SIG_DFL;  // Put back once the pipe is closed
+    bool sigpipeIgnored = false;
+#endif
+
+    std::vector<std::future<void>> pendingWrites;
+    std::unique_ptr<ThreadPool> writer;
+
+public:
+    // `imageFormat` is the format of the images that are copied, which has to be 8-bit RGBA or BGRA
+    FrameCapture(DeviceMemoryAllocator &allocator, VkFormat imageFormat, CaptureFormat format, const std::string &path,
+                 uint32_t interval, uint32_t bufferCount)
+        : allocator(allocator),
+          format(format),
+          path(path),
+          interval(interval),
+          slots(bufferCount),
+          writing(std::make_unique<std::atomic<bool>[]>(bufferCount)) {
+        if (!supportsImageFormat(imageFormat)) {
+            throw std::runtime_error("Frame capture needs an 8-bit RGBA or BGRA image format");
+        }
+        swapRedBlue = imageFormat == VK_FORMAT_B8G8R8A8_UNORM || imageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+
+        // The writer reads every byte, which is slow from uncached memory
+        memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        const VkPhysicalDeviceMemoryProperties &deviceMemory = allocator.getMemoryProperties();
+        for (uint32_t i = 0; i < deviceMemory.memoryTypeCount; i++) {
+            VkMemoryPropertyFlags cached = memoryProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            if ((deviceMemory.memoryTypes[i].propertyFlags & cached) == cached) {
+                memoryProperties = cached;
+                break;
+            }
+        }
+
+        if (format == CaptureFormat::Pipe) {
+#ifdef _WIN32
+            pipe = _popen(path.c_str(), "wb");
+#else
+            // Writing to a command that has exited raises SIGPIPE, which would end the renderer on the spot. Ignored,
+            // the write fails instead and the error comes out of collect() like any other
+            previousSigpipeHandler = std::signal(SIGPIPE, SIG_IGN);
+            sigpipeIgnored = true;
+            pipe = popen(path.c_str(), "w");
+#endif
+            if (pipe == nullptr) {
+                closePipe();
+                throw std::runtime_error("Failed to start capture command: " + path);
+            }
+        } else {
+            std::filesystem::create_directories(path);
+        }
+
+        writer = std::make_unique<ThreadPool>(1);  // One thread, so frames are written in order
+    }
+
+    // Only once the GPU is done with the buffers
+    ~FrameCapture() {
+        writer.reset();  // Finishes the writes that were already handed over
+        closePipe();
+        for (auto &slot : slots) {
+            if (slot.buffer.buffer != VK_NULL_HANDLE) allocator.destroyBuffer(slot.buffer);
+        }
+    }
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    static bool supportsImageFormat(VkFormat imageFormat) {
+        switch (imageFormat) {
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_B8G8R8A8_UNORM:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Records the copy of `image`, in TRANSFER_SRC_OPTIMAL layout, if this is one of the frames to capture and a
+    // buffer is free. `frameNumber` is the value the frame signals on the frame timeline
+    void recordCopy(VkCommandBuffer commandBuffer, VkImage image, VkExtent2D extent, uint64_t frameNumber) {
+        if (framesSeen++ % interval != 0) return;
+
+        Slot *slot = nullptr;
+        for (uint32_t i = 0; i < slots.size() && slot == nullptr; i++) {
+            uint32_t index = (nextSlot + i) % static_cast<uint32_t>(slots.size());
+            if (slots[index].frameNumber == 0 && !writing[index]) {
+                slot = &slots[index];
+                nextSlot = (index + 1) % static_cast<uint32_t>(slots.size());
+            }
+        }
+        if (slot == nullptr) {
+            framesDropped++;
+            return;
+        }
+
+        // A free buffer is done with both the GPU and the writer, so one that is too small can go right away
+        VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+        if (slot->capacity < size) {
+            if (slot->buffer.buffer != VK_NULL_HANDLE) allocator.destroyBuffer(slot->buffer);
+            slot->buffer = allocator.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties);
+            slot->capacity = size;
+        }
+
+        VkBufferImageCopy region{};
+        region.bufferRowLength = 0;  // Tightly packed
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer.buffer, 1,
+                               &region);
+
+        slot->extent = extent;
+        slot->frameNumber = frameNumber;
+        framesCaptured++;
+    }
+
+    // Once per frame, after reading the frame timeline. Hands the buffers of finished frames to the writer, oldest
+    // first, and rethrows whatever a write failed with
+    void collect(uint64_t completedFrame) {
+        for (auto write = pendingWrites.begin(); write != pendingWrites.end();) {
+            if (write->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++write;
+                continue;
+            }
+            write->get();
+            write = pendingWrites.erase(write);
+        }
+
+        std::vector<uint32_t> finished;
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            if (slots[i].frameNumber != 0 && slots[i].frameNumber <= completedFrame) finished.push_back(i);
+        }
+        std::sort(finished.begin(), finished.end(),
+                  [&](uint32_t a, uint32_t b) { return slots[a].frameNumber < slots[b].frameNumber; });
+
+        for (uint32_t index : finished) {
+            Slot &slot = slots[index];
+            writing[index] = true;
+            const uint8_t *pixels = static_cast<const uint8_t *>(slot.buffer.allocation.mapped);
+            pendingWrites.push_back(
+                writer->submit([this, index, pixels, extent = slot.extent, frameNumber = slot.frameNumber] {
+                    write(pixels, extent, frameNumber);
+                    writing[index] = false;
+                }));
+            slot.frameNumber = 0;
+        }
+    }
+
+    // Once the device is idle: writes out every frame that is left and closes the pipe, which throws if the capture
+    // command failed
+    void finish(uint64_t completedFrame) {
+        collect(completedFrame);
+        for (auto &write : pendingWrites) write.get();
+        pendingWrites.clear();
+        if (!closePipe()) throw std::runtime_error("The capture command failed: " + path);
+    }
+
+    void printSummary(std::ostream &out) const {
+        out << "Captured " << framesCaptured << " frames as " << captureFormatName(format) << " to " << path << " ("
+            << framesDropped << " dropped)\n";
+    }
+
+private:
+    // On the writer thread
+    void write(const uint8_t *pixels, VkExtent2D extent, uint64_t frameNumber) {
+        size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
+        size_t channels = format == CaptureFormat::Png ? 3 : 4;  // PNG leaves alpha out, it's always opaque anyway
+
+        std::vector<uint8_t> converted(pixelCount * channels);
+        size_t red = swapRedBlue ? 2 : 0;
+        size_t blue = swapRedBlue ? 0 : 2;
+        for (size_t i = 0; i < pixelCount; i++) {
+            converted[i * channels + 0] = pixels[i * 4 + red];
+            converted[i * channels + 1] = pixels[i * 4 + 1];
+            converted[i * channels + 2] = pixels[i * 4 + blue];
+            if (channels == 4) converted[i * channels + 3] = pixels[i * 4 + 3];
+        }
+
+        if (format == CaptureFormat::Pipe) {
+            if (pipeExtent.width == 0) pipeExtent = extent;
+            if (extent.width != pipeExtent.width || extent.height != pipeExtent.height) {
+                framesDropped++;
+                return;
+            }
+            if (std::fwrite(converted.data(), 1, converted.size(), pipe) != converted.size()) {
+                throw std::runtime_error("Failed to write a frame to the capture command");
+            }
+            return;
+        }
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06llu.%s", static_cast<unsigned long long>(frameNumber),
+                      format == CaptureFormat::Png ? "png" : "rgba");
+        std::filesystem::path filename = std::filesystem::path(path) / name;
+        if (format == CaptureFormat::Png) {
+            writePng(filename, converted, extent.width, extent.height);
+        } else {
+            std::ofstream file(filename, std::ios::binary);
+            if (!file.is_open()) throw std::runtime_error("Failed to open file " + filename.string());
+            file.write(reinterpret_cast<const char *>(converted.data()),
+                       static_cast<std::streamsize>(converted.size()));
+        }
+    }
+
+    // Waits for the capture command to exit. Returns false if it didn't exit cleanly
+    bool closePipe() {
+        int status = 0;
+#ifdef _WIN32
+        if (pipe != nullptr) status = _pclose(pipe);
+#else
+        if (pipe != nullptr) status = pclose(pipe);
+        if (sigpipeIgnored) std::signal(SIGPIPE, previousSigpipeHandler);
+        sigpipeIgnored = false;
+#endif
+        pipe = nullptr;
+        return status == 0;
+    }
+
+    static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            return table;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static void appendBigEndian(std::vector<uint8_t> &bytes, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) bytes.push_back(static_cast<uint8_t>(value >> shift));
+    }
+
+    static void appendChunk(std::vector<uint8_t> &png, const char type[4], const std::vector<uint8_t> &data) {
+        appendBigEndian(png, static_cast<uint32_t>(data.size()));
+        size_t typeStart = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        appendBigEndian(png, crc32(&png[typeStart], png.size() - typeStart));
+    }
+
+    // Stored deflate blocks, i.e. no compression at all: the files are about as large as raw ones, but writing one
+    // costs little more than a copy, which is what keeps the writer ahead of the frame rate. Recompress them afterwards
+    // if size matters
+    static void writePng(const std::filesystem::path &filename, const std::vector<uint8_t> &rgbPixels, uint32_t width,
+                         uint32_t height) {
+        // Every row starts with its filter type, 0 for none
+        size_t rowSize = static_cast<size_t>(width) * 3;
+        std::vector<uint8_t> rows;
+        rows.reserve((rowSize + 1) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            rows.push_back(0);
+            rows.insert(rows.end(), rgbPixels.begin() + y * rowSize, rgbPixels.begin() + (y + 1) * rowSize);
+        }
+
+        // A zlib stream: header, deflate blocks, Adler-32 of the uncompressed data
+        std::vector<uint8_t> compressed = {0x78, 0x01};
+        compressed.reserve(rows.size() + rows.size() / PNG_STORED_BLOCK_SIZE * 5 + 16);
+        for (size_t offset = 0; offset < rows.size(); offset += PNG_STORED_BLOCK_SIZE) {
+            size_t size = std::min(PNG_STORED_BLOCK_SIZE, rows.size() - offset);
+            compressed.push_back(offset + size == rows.size() ? 1 : 0);  // Last block flag, block type 0 (stored)
+            compressed.push_back(static_cast<uint8_t>(size));
+            compressed.push_back(static_cast<uint8_t>(size >> 8));
+            compressed.push_back(static_cast<uint8_t>(~size));
+            compressed.push_back(static_cast<uint8_t>(~size >> 8));
+            compressed.insert(compressed.end(), rows.begin() + offset, rows.begin() + offset + size);
+        }
+        uint32_t a = 1;
+        uint32_t b = 0;
+        for (uint8_t byte : rows) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        appendBigEndian(compressed, (b << 16) | a);
+
+        std::vector<uint8_t> header;
+        appendBigEndian(header, width);
+        appendBigEndian(header, height);
+        header.insert(header.end(), {8, 2, 0, 0, 0});  // 8-bit RGB, deflate, per row filters, not interlaced
+
+        std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        appendChunk(png, "IHDR", header);
+        appendChunk(png, "IDAT", compressed);
+        appendChunk(png, "IEND", {});
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.is_open()) throw std::runtime_error("Failed to open file " + filename.string());
+        file.write(reinterpret_cast<const char *>(png.data()), static_cast<std::streamsize>(png.size()));
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Display refresh rate when the monitor doesn't report one
+const double DEFAULT_REFRESH_RATE = 60.0;
+
+// How long to wait for a present before giving up on pacing that frame, e.g. while the window is being dragged
+const uint64_t PRESENT_WAIT_TIMEOUT_NANOSECONDS = 100'000'000;
+
+// sleep_until can wake up a millisecond or more late, so the last stretch before the frame starts is spun instead
+const std::chrono::microseconds FRAME_PACER_SPIN(500);
+
+// The start delay creeps up by this much for every frame that made its vblank and is halved by every frame that
+// missed it, so it settles just below the point where frames start missing
+const std::chrono::microseconds FRAME_PACER_STEP(100);
+
+// Always left between the start of a frame and the next vblank
+const std::chrono::microseconds FRAME_PACER_MARGIN(1000);
+
+// Latency samples kept for the percentiles
+const size_t FRAME_PACER_WINDOW = 1024;
+
+// Starts every frame as late as it can and still make the next vblank, and measures input to present latency.
+//
+// A frame's input is sampled when it starts, so the time it spends queued behind other frames is time its input grows
+// stale. With VK_KHR_present_wait the pacer waits for the previous frame to actually reach the screen, which keeps at
+// most one frame queued, and then sleeps for an adaptive delay before the next frame samples its input: the delay
+// grows while frames make their vblank and shrinks as soon as one doesn't.
+//
+// Presents are identified with VK_KHR_present_id, and the time a present wait returns is taken as the time the image
+// was shown. Without those extensions nothing is paced and latency is only measured up to the present call.
+// Only FIFO style present modes line presents up with vblanks; with the others pacing just caps the frame rate
+class FramePacer {
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingPresent {
+        uint64_t presentId;
+        Clock::time_point inputTime;
+    };
+
+    VkDevice device;
+    PFN_vkWaitForPresentKHR waitForPresent = nullptr;  // Null without present wait
+    bool pacing;
+    Clock::duration refreshInterval;
+
+    std::deque<PendingPresent> pendingPresents;  // Oldest first
+    Clock::duration startDelay{0};               // From the previous frame reaching the screen to the next one starting
+    Clock::time_point lastPresentTime;
+    bool hasLastPresent = false;
+    uint32_t missedFrames = 0;
+
+    std::vector<double> latencyMilliseconds;  // Rolling window
+    size_t nextLatency = 0;
+
+public:
+    // `presentWait` is whether VK_KHR_present_id and VK_KHR_present_wait are enabled on `device`
+    FramePacer(VkDevice device, bool presentWait, bool pacing, double refreshRate)
+        : device(device),
+          pacing(pacing),
+          refreshInterval(
+              std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / refreshRate))) {
+        if (presentWait) {
+            waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+            if (waitForPresent == nullptr) throw std::runtime_error("Failed to load vkWaitForPresentKHR");
+        }
+        latencyMilliseconds.reserve(FRAME_PACER_WINDOW);
+    }
+
+    FramePacer(const FramePacer &) = delete;
+    FramePacer &operator=(const FramePacer &) = delete;
+
+    bool measuresDisplayLatency() const { return waitForPresent != nullptr; }
+    uint32_t getMissedFrames() const { return missedFrames; }
+    double getStartDelayMilliseconds() const {
+        return std::chrono::duration<double, std::milli>(startDelay).count();
+    }
+
+    // Before the frame samples its input. Collects the presents that have reached the screen, waiting for the newest
+    // one when pacing, then sleeps until the frame should start
+    void beginFrame(VkSwapchainKHR swapChain) {
+        if (waitForPresent != nullptr) collectPresents(swapChain);
+        if (!pacing || !hasLastPresent) return;
+
+        Clock::time_point start = lastPresentTime + startDelay;
+        if (start - Clock::now() > FRAME_PACER_SPIN) std::this_thread::sleep_until(start - FRAME_PACER_SPIN);
+        while (Clock::now() < start) {
+        }
+    }
+
+    // After the frame's present call. `presentId` is what went into its VkPresentIdKHR, or anything without present
+    // ids, and `inputTime` is when it sampled its input
+    void presented(uint64_t presentId, Clock::time_point inputTime) {
+        if (waitForPresent != nullptr) {
+            pendingPresents.push_back({presentId, inputTime});
+        } else {
+            addLatency(Clock::now() - inputTime);
+        }
+    }
+
+    // Present ids belong to a swap chain, so the ones still pending are dropped when it is replaced
+    void swapChainRecreated() {
+        pendingPresents.clear();
+        hasLastPresent = false;
+    }
+
+    // p in [0, 100]. 0 before anything was measured
+    double latencyPercentile(double p) const {
+        if (latencyMilliseconds.empty()) return 0.0;
+        std::vector<double> sorted = latencyMilliseconds;
+        size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+
+private:
+    // Pacing blocks until the newest present is on screen. Otherwise this only polls, so a present is seen at most a
+    // frame after it happened and the latency is an upper bound
+    void collectPresents(VkSwapchainKHR swapChain) {
+        while (!pendingPresents.empty()) {
+            PendingPresent present = pendingPresents.front();
+            VkResult result = waitForPresent(device, swapChain, present.presentId,
+                                             pacing ? PRESENT_WAIT_TIMEOUT_NANOSECONDS : 0);
+            if (result == VK_TIMEOUT) {
+                if (pacing) hasLastPresent = false;  // Lost track of the vblanks; this frame starts right away
+                return;
+            }
+            pendingPresents.pop_front();
+            if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) continue;  // Out of date, never shown
+
+            Clock::time_point now = Clock::now();
+            addLatency(now - present.inputTime);
+            if (pacing && hasLastPresent) adjustStartDelay(now - lastPresentTime);
+            lastPresentTime = now;
+            hasLastPresent = true;
+        }
+    }
+
+    void adjustStartDelay(Clock::duration presentInterval) {
+        if (presentInterval > refreshInterval * 3 / 2) {
+            missedFrames++;
+            startDelay /= 2;
+        } else {
+            startDelay += FRAME_PACER_STEP;
+        }
+        startDelay = std::min<Clock::duration>(startDelay, refreshInterval - FRAME_PACER_MARGIN);
+        startDelay = std::max<Clock::duration>(startDelay, Clock::duration::zero());
+    }
+
+    void addLatency(Clock::duration latency) {
+        double milliseconds = std::chrono::duration<double, std::milli>(latency).count();
+        if (latencyMilliseconds.size() < FRAME_PACER_WINDOW) {
+            latencyMilliseconds.push_back(milliseconds);
+        } else {
+            latencyMilliseconds[nextLatency] = milliseconds;
+            nextLatency = (nextLatency + 1) % FRAME_PACER_WINDOW;
+        }
+    }
+};
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Culling.h"
+#include "DeletionQueue.h"
+#include "DescriptorHeap.h"
+#include "MemoryAllocator.h"
+#include "ShaderBundle.h"
+#include "SpirvReflection.h"
+#include "StagingRing.h"
+#include "VulkanHandle.h"
+
+const uint32_t CULL_GROUP_SIZE = 64;  // local_size_x in cull.comp
+const uint32_t HIZ_GROUP_SIZE = 8;    // local_size_x and local_size_y in hiz.comp
+
+// Every device can dispatch at least this many workgroups in x
+const uint32_t MIN_MAX_COMPUTE_WORK_GROUP_COUNT = 65535;
+
+// Frustum culling on the GPU. Every frame a compute pass (cull.comp) tests the bounding sphere of every object against
+// the view and appends the indirect command of each survivor to a compacted list; the draw then reads how many there
+// are from the GPU with vkCmdDrawIndexedIndirectCount, so the CPU never touches per object data.
+//
+// With occlusion culling a second pass (hiz.comp) turns the frame's depth buffer into a hierarchical Z pyramid once
+// the frame has been drawn, and the next frame's cull also drops objects that lie behind everything drawn over them.
+// Being a frame late is what makes it cheap: nothing has to be drawn twice. The pyramid is shared by every frame in
+// flight, which is fine since all of them run on the graphics queue in submission order
+//
+// Everything the shaders read and write is a storage buffer in the descriptor heap, the depth buffer is a texture in
+// it, and the heap elements go in the push constants. The passes are recorded by the render graph (see RenderGraph.h),
+// which also places the barriers between them; only the barriers within a pass are recorded here
+class GpuCuller {
+    // Written by the cull of each frame in flight, so a frame's draw is never overwritten by the next frame's cull
+    struct FrameBuffers {
+        Buffer drawBuffer;
+        Buffer countBuffer;
+        Buffer countReadback;  // The count copied back for the CPU, see drawnCount()
+        uint32_t drawSlot = 0;
+        uint32_t countSlot = 0;
+    };
+
+    VkDevice device;
+    DeviceMemoryAllocator &allocator;
+    DescriptorHeap &heap;
+    DeletionQueue &deletionQueue;
+    bool occlusionCulling;
+
+    UniquePipelineLayout cullLayout;
+    UniquePipeline cullPipeline;
+    UniquePipelineLayout hizLayout;  // Only with occlusion culling, and so is everything below that belongs to the
+    UniquePipeline hizPipeline;      // pyramid
+    UniqueSampler depthSampler;
+
+    std::vector<FrameBuffers> frames;
+    Buffer boundsBuffer;
+    uint32_t boundsSlot = 0;
+    uint32_t sourceDrawSlot = 0;
+    uint32_t objectCount = 0;
+
+    VkExtent2D depthExtent{};
+    uint32_t depthSlot = 0;
+    Buffer hizBuffer;
+    uint32_t hizSlot = 0;
+    std::vector<HiZLevel> hizLevels;
+    bool hizBuilt = false;  // False until the first frame after the depth buffer changed has been drawn
+    CullView hizView;       // The view of the frame the pyramid was built from
+
+public:
+    GpuCuller(VkDevice device, DeviceMemoryAllocator &allocator, DescriptorHeap &heap, DeletionQueue &deletionQueue,
+              uint32_t framesInFlight, const ShaderBundle &shaderBundle, VkPipelineCache pipelineCache,
+              bool occlusionCulling)
+        : device(device),
+          allocator(allocator),
+          heap(heap),
+          deletionQueue(deletionQueue),
+          occlusionCulling(occlusionCulling),
+          frames(framesInFlight) {
+        std::span<const uint32_t> cullCode = shaderBundle.find("cull.comp");
+        cullLayout = createLayout(cullCode, sizeof(CullConstants), "cull.comp");
+        cullPipeline = createPipeline(cullCode, cullLayout, pipelineCache);
+
+        if (!occlusionCulling) return;
+
+        std::span<const uint32_t> hizCode = shaderBundle.find("hiz.comp");
+        hizLayout = createLayout(hizCode, sizeof(HiZConstants), "hiz.comp");
+        hizPipeline = createPipeline(hizCode, hizLayout, pipelineCache);
+
+        // Only ever read with texelFetch, but a combined image sampler needs one
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, depthSampler.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create depth sampler");
+        }
+    }
+
+    // Only once the device is idle
+    ~GpuCuller() {
+        destroyObjects();
+        destroyDepthBuffer();
+    }
+
+    GpuCuller(const GpuCuller &) = delete;
+    GpuCuller &operator=(const GpuCuller &) = delete;
+
+    bool isOcclusionCulling() const { return occlusionCulling; }
+
+    // Uploads the bounds of every object. `sourceDraws` holds one indirect command per object, in the same order, and
+    // has to stay alive until the objects are replaced. Any previous objects have to be retired first
+    void setObjects(const std::vector<ObjectBounds> &bounds, VkBuffer sourceDraws, StagingRing &stagingRing) {
+        if ((bounds.size() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE > MIN_MAX_COMPUTE_WORK_GROUP_COUNT) {
+            throw std::runtime_error("Too many objects to cull in a single dispatch");
+        }
+        objectCount = static_cast<uint32_t>(bounds.size());
+
+        VkDeviceSize boundsSize = sizeof(ObjectBounds) * bounds.size();
+        boundsBuffer = allocator.createBuffer(boundsSize,
+                                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        stagingRing.upload(bounds.data(), boundsSize, boundsBuffer.buffer);
+        stagingRing.flush();
+        boundsSlot = heap.addBuffer(boundsBuffer.buffer);
+        sourceDrawSlot = heap.addBuffer(sourceDraws);
+
+        for (auto &frame : frames) {
+            frame.drawBuffer = allocator.createBuffer(
+                sizeof(VkDrawIndexedIndirectCommand) * objectCount,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.countBuffer = allocator.createBuffer(sizeof(uint32_t),
+                                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                           VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                                           VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.countReadback = allocator.createBuffer(
+                sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            *static_cast<uint32_t *>(frame.countReadback.allocation.mapped) = 0;
+            frame.drawSlot = heap.addBuffer(frame.drawBuffer.buffer);
+            frame.countSlot = heap.addBuffer(frame.countBuffer.buffer);
+        }
+    }
+
+    // The depth buffer the pyramid is built from, in SHADER_READ_ONLY_OPTIMAL layout whenever recordPyramid() runs.
+    // Set again whenever it is recreated, once the old one has been retired
+    void setDepthBuffer(VkImageView imageView, VkExtent2D extent) {
+        if (!occlusionCulling) return;
+
+        depthExtent = extent;
+        depthSlot = heap.addTexture(imageView, depthSampler);
+        hizLevels = ::hizLevels(extent.width, extent.height);
+        VkDeviceSize texelCount = hizLevels.back().offset + 1;
+        hizBuffer = allocator.createBuffer(sizeof(float) * texelCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        hizSlot = heap.addBuffer(hizBuffer.buffer);
+        hizBuilt = false;
+    }
+
+    // Before the frame's rendering, outside of any render pass. Fills `frame`'s draw and count buffers for
+    // recordDraws()
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t frame, VkDescriptorSet heapSet, const CullView &view) {
+        FrameBuffers &buffers = frames[frame];
+
+        vkCmdFillBuffer(commandBuffer, buffers.countBuffer.buffer, 0, sizeof(uint32_t), 0);
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+        CullConstants constants{};
+        constants.viewOffset[0] = view.offset[0];
+        constants.viewOffset[1] = view.offset[1];
+        constants.viewScale = view.scale;
+        constants.objectCount = objectCount;
+        constants.previousViewOffset[0] = hizView.offset[0];
+        constants.previousViewOffset[1] = hizView.offset[1];
+        constants.previousViewScale = hizView.scale;
+        constants.hizBuffer = hizBuilt ? hizSlot : NO_HIZ;
+        constants.boundsBuffer = boundsSlot;
+        constants.sourceDrawBuffer = sourceDrawSlot;
+        constants.drawBuffer = buffers.drawSlot;
+        constants.countBuffer = buffers.countSlot;
+        if (hizBuilt) {
+            constants.hizWidth = hizLevels[0].width;
+            constants.hizHeight = hizLevels[0].height;
+            constants.hizLevelCount = static_cast<uint32_t>(hizLevels.size());
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, DESCRIPTOR_HEAP_SET, 1,
+                                &heapSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    }
+
+    // After recordCull(), once the count has been made visible to transfers. Copies it to where drawnCount() reads it
+    void recordCountReadback(VkCommandBuffer commandBuffer, uint32_t frame) {
+        VkBufferCopy copy{0, 0, sizeof(uint32_t)};
+        vkCmdCopyBuffer(commandBuffer, frames[frame].countBuffer.buffer, frames[frame].countReadback.buffer, 1, &copy);
+    }
+
+    // After the frame's rendering, outside of any render pass, with the depth buffer in SHADER_READ_ONLY_OPTIMAL
+    // layout. Builds the pyramid the next frame culls against
+    void recordPyramid(VkCommandBuffer commandBuffer, VkDescriptorSet heapSet, const CullView &view) {
+        if (!occlusionCulling) return;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hizPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hizLayout, DESCRIPTOR_HEAP_SET, 1,
+                                &heapSet, 0, nullptr);
+
+        for (uint32_t level = 0; level < hizLevels.size(); level++) {
+            const HiZLevel &size = hizLevels[level];
+
+            HiZConstants constants{};
+            constants.depthTexture = depthSlot;
+            constants.hizBuffer = hizSlot;
+            constants.level = level;
+            if (level == 0) {
+                constants.sourceSize[0] = depthExtent.width;
+                constants.sourceSize[1] = depthExtent.height;
+            } else {
+                const HiZLevel &source = hizLevels[level - 1];
+                constants.sourceOffset = source.offset;
+                constants.sourceSize[0] = source.width;
+                constants.sourceSize[1] = source.height;
+            }
+            constants.offset = size.offset;
+            constants.size[0] = size.width;
+            constants.size[1] = size.height;
+
+            // Each level is built from the one before it
+            if (level > 0) {
+                memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                              VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                              VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+            }
+            vkCmdPushConstants(commandBuffer, hizLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                               &constants);
+            vkCmdDispatch(commandBuffer, (size.width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+                          (size.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        }
+
+        hizBuilt = true;
+        hizView = view;
+    }
+
+    VkBuffer drawBuffer(uint32_t frame) const { return frames[frame].drawBuffer.buffer; }
+    VkBuffer countBuffer(uint32_t frame) const { return frames[frame].countBuffer.buffer; }
+
+    // How many objects survived the last cull recorded for `frame`, once that frame has finished
+    uint32_t drawnCount(uint32_t frame) const {
+        return *static_cast<const uint32_t *>(frames[frame].countReadback.allocation.mapped);
+    }
+
+    // Frames still in flight may be reading the buffers, so they are destroyed once `retireFrame` has finished. The
+    // deletion queue entry only holds on to what outlives the culler, the allocator and the heap
+    void retireObjects(uint64_t retireFrame) {
+        if (boundsBuffer.buffer == VK_NULL_HANDLE) return;
+
+        std::vector<Buffer> buffers = {boundsBuffer};
+        std::vector<uint32_t> slots = {boundsSlot, sourceDrawSlot};
+        for (auto &frame : frames) {
+            buffers.insert(buffers.end(), {frame.drawBuffer, frame.countBuffer, frame.countReadback});
+            slots.insert(slots.end(), {frame.drawSlot, frame.countSlot});
+        }
+        deletionQueue.push(retireFrame, [allocator = &allocator, heap = &heap, buffers, slots]() mutable {
+            for (uint32_t slot : slots) heap->removeBuffer(slot);
+            for (auto &buffer : buffers) allocator->destroyBuffer(buffer);
+        });
+        boundsBuffer = {};
+    }
+
+    // Before the depth buffer is replaced, same as retireObjects()
+    void retireDepthBuffer(uint64_t retireFrame) {
+        if (hizBuffer.buffer == VK_NULL_HANDLE) return;
+
+        deletionQueue.push(retireFrame, [allocator = &allocator, heap = &heap, buffer = hizBuffer, hizSlot = hizSlot,
+                                         depthSlot = depthSlot]() mutable {
+            heap->removeBuffer(hizSlot);
+            heap->removeTexture(depthSlot);
+            allocator->destroyBuffer(buffer);
+        });
+        hizBuffer = {};
+    }
+
+private:
+    UniquePipelineLayout createLayout(std::span<const uint32_t> code, uint32_t pushConstantSize, const char *name) {
+        ShaderReflection reflection = reflectSpirv(code);
+        if (reflection.pushConstantOffset != 0 || reflection.pushConstantSize != pushConstantSize) {
+            throw std::runtime_error(std::string("Push constant block in ") + name + " doesn't match Culling.h");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = pushConstantSize;
+
+        VkDescriptorSetLayout heapLayout = heap.layout();
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;  // DESCRIPTOR_HEAP_SET
+        layoutInfo.pSetLayouts = &heapLayout;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        UniquePipelineLayout layout;
+        if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, layout.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline layout");
+        }
+        return layout;
+    }
+
+    UniquePipeline createPipeline(std::span<const uint32_t> code, VkPipelineLayout layout, VkPipelineCache cache) {
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size_bytes();
+        moduleInfo.pCode = code.data();
+
+        UniqueShaderModule shaderModule;  // Pipelines don't need the module they were built from
+        if (vkCreateShaderModule(device, &moduleInfo, nullptr, shaderModule.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
+
+        UniquePipeline pipeline;
+        if (vkCreateComputePipelines(device, cache, 1, &pipelineInfo, nullptr, pipeline.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+        return pipeline;
+    }
+
+    static void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags2 srcStageMask,
+                              VkAccessFlags2 srcAccessMask, VkPipelineStageFlags2 dstStageMask,
+                              VkAccessFlags2 dstAccessMask) {
+        VkMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = srcStageMask;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstStageMask = dstStageMask;
+        barrier.dstAccessMask = dstAccessMask;
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.memoryBarrierCount = 1;
+        dependencyInfo.pMemoryBarriers = &barrier;
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+
+    void destroyObjects() {
+        if (boundsBuffer.buffer == VK_NULL_HANDLE) return;
+
+        heap.removeBuffer(boundsSlot);
+        heap.removeBuffer(sourceDrawSlot);
+        allocator.destroyBuffer(boundsBuffer);
+        for (auto &frame : frames) {
+            heap.removeBuffer(frame.drawSlot);
+            heap.removeBuffer(frame.countSlot);
+            allocator.destroyBuffer(frame.drawBuffer);
+            allocator.destroyBuffer(frame.countBuffer);
+            allocator.destroyBuffer(frame.countReadback);
+        }
+    }
+
+    void destroyDepthBuffer() {
+        if (hizBuffer.buffer == VK_NULL_HANDLE) return;
+
+        heap.removeBuffer(hizSlot);
+        heap.removeTexture(depthSlot);
+        allocator.destroyBuffer(hizBuffer);
+    }
+};
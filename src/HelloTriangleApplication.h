@@ -0,0 +1,3571 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "CommandRecorder.h"
+#include "Culling.h"
+#include "DeletionQueue.h"
+#include "DescriptorHeap.h"
+#include "DeviceSelection.h"
+#include "DirectoryWatcher.h"
+#include "DrawSorter.h"
+#include "FrameCapture.h"
+#include "FramePacer.h"
+#include "GpuCuller.h"
+#include "MemoryAllocator.h"
+#include "Mesh.h"
+#include "PipelineCompiler.h"
+#include "Process.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "ShaderBundle.h"
+#include "SpirvReflection.h"
+#include "StagingRing.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+#include "TimelineSemaphore.h"
+#include "VulkanHandle.h"
+
+const uint32_t WIDTH = 800;
+const uint32_t HEIGHT = 600;
+
+// Headless rendering has no swap chain, so it renders into a small pool of offscreen images instead
+const uint32_t DEFAULT_OFFSCREEN_IMAGE_COUNT = 3;
+const uint32_t DEFAULT_HEADLESS_FRAME_COUNT = 1000;
+
+// How many frames the CPU is allowed to record ahead of the GPU. 1 means the CPU and GPU never overlap, 2 lets the CPU
+// record frame N+1 while the GPU is still busy with frame N
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+// Looked for next to the executable unless a path is given, so the working directory does not matter
+inline const char *DEFAULT_SHADER_BUNDLE_NAME = "shaders.bundle";
+
+// Where hot reload finds the GLSL sources and the compiler, baked in by CMake
+#ifdef VK_LEARNING_SHADER_SOURCE_DIR
+inline const char *DEFAULT_SHADER_SOURCE_DIR = VK_LEARNING_SHADER_SOURCE_DIR;
+#else
+inline const char *DEFAULT_SHADER_SOURCE_DIR = "shaders";
+#endif
+#ifdef VK_LEARNING_GLSLC
+inline const char *DEFAULT_GLSLC = VK_LEARNING_GLSLC;
+#else
+inline const char *DEFAULT_GLSLC = "glslc";
+#endif
+
+#ifdef VK_LEARNING_EMBEDDED_SHADERS
+// Generated at build time by vk-learning-pack-shaders
+extern const uint32_t embeddedShaderBundle[];
+extern const size_t embeddedShaderBundleSize;
+#endif
+
+inline const char *validationLayers[] = {"VK_LAYER_KHRONOS_validation"};
+inline const char *presentationDeviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+
+// Enabled when the device has both, for frame pacing and display latency, see FramePacer.h
+inline const char *presentWaitDeviceExtensions[] = {VK_KHR_PRESENT_ID_EXTENSION_NAME,
+                                                    VK_KHR_PRESENT_WAIT_EXTENSION_NAME};
+
+#ifdef NDEBUG
+const bool enableValidationLayers = false;
+#else
+const bool enableValidationLayers = true;
+#endif
+
+// Because this function is an extension function, it is not automatically loaded. We have to look up its address
+// ourselves
+inline VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
+                                             const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+                                             const VkAllocationCallbacks *pAllocator,
+                                             VkDebugUtilsMessengerEXT *pDebugMessenger) {
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+    } else {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+inline void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
+                                          const VkAllocationCallbacks *pAllocator) {
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        func(instance, debugMessenger, pAllocator);
+    }
+}
+
+using UniqueDebugMessenger = UniqueHandle<DestroyDebugUtilsMessengerEXT>;
+
+// We need to check which queue families are supported by the device
+struct QueueFamilyIndices {
+    std::optional<uint32_t> graphicsFamily;
+    std::optional<uint32_t> presentationFamily;  // In case the drawing queue and the presentation queue do not overlap
+    std::optional<uint32_t> transferFamily;      // Transfer without graphics, usually the copy engine. Optional
+    uint32_t graphicsQueueCount = 0;
+
+    bool isComplete() const { return graphicsFamily.has_value() && presentationFamily.has_value(); }
+};
+
+struct SwapChainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities;
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentationModes;
+};
+
+// Everything queried about a physical device while picking one. Kept for the chosen device so none of it is queried
+// again; only the surface capabilities change afterwards (e.g. the current extent on resize)
+struct PhysicalDeviceInfo {
+    VkPhysicalDeviceProperties properties;
+    QueueFamilyIndices queueFamilies;
+    std::set<std::string> extensions;
+    SwapChainSupportDetails swapChainSupport;  // Empty when running headless
+    DeviceCapabilities capabilities;
+    int64_t score = 0;  // See scoreDevice()
+};
+
+// How the objects of the scene are turned into draw calls
+enum class DrawMode {
+    Direct,         // One vkCmdDrawIndexed per object
+    Instanced,      // One vkCmdDrawIndexed for all objects
+    Indirect,       // vkCmdDrawIndexedIndirect reading one command per object from a GPU buffer
+    IndirectCount,  // Like Indirect, but the GPU also reads the number of draws from a buffer
+};
+
+inline const char *drawModeName(DrawMode drawMode) {
+    switch (drawMode) {
+        case DrawMode::Direct:
+            return "direct";
+        case DrawMode::Instanced:
+            return "instanced";
+        case DrawMode::Indirect:
+            return "indirect";
+        case DrawMode::IndirectCount:
+            return "indirect-count";
+    }
+    return "unknown";
+}
+
+inline DrawMode parseDrawMode(const std::string &name) {
+    for (auto drawMode : {DrawMode::Direct, DrawMode::Instanced, DrawMode::Indirect, DrawMode::IndirectCount}) {
+        if (name == drawModeName(drawMode)) return drawMode;
+    }
+    throw std::runtime_error("Unknown draw mode: " + name);
+}
+
+// The order opaque objects are drawn in. Front to back lets the early depth test reject hidden fragments before they
+// are shaded; back to front is the worst case, every object in front is shaded over what is behind it
+enum class DrawOrder {
+    Unsorted,
+    FrontToBack,
+    BackToFront,
+};
+
+inline const char *drawOrderName(DrawOrder drawOrder) {
+    switch (drawOrder) {
+        case DrawOrder::Unsorted:
+            return "unsorted";
+        case DrawOrder::FrontToBack:
+            return "front-to-back";
+        case DrawOrder::BackToFront:
+            return "back-to-front";
+    }
+    return "unknown";
+}
+
+inline DrawOrder parseDrawOrder(const std::string &name) {
+    for (auto drawOrder : {DrawOrder::Unsorted, DrawOrder::FrontToBack, DrawOrder::BackToFront}) {
+        if (name == drawOrderName(drawOrder)) return drawOrder;
+    }
+    throw std::runtime_error("Unknown draw order: " + name);
+}
+
+// How the color attachment is set up for drawing
+enum class RenderPath {
+    RenderPass,  // VkRenderPass plus one VkFramebuffer per swap chain image, layouts changed by the render pass
+    Dynamic,     // vkCmdBeginRendering straight on the image view, layouts changed by synchronization2 barriers
+};
+
+inline const char *renderPathName(RenderPath renderPath) {
+    switch (renderPath) {
+        case RenderPath::RenderPass:
+            return "render-pass";
+        case RenderPath::Dynamic:
+            return "dynamic";
+    }
+    return "unknown";
+}
+
+inline RenderPath parseRenderPath(const std::string &name) {
+    for (auto renderPath : {RenderPath::RenderPass, RenderPath::Dynamic}) {
+        if (name == renderPathName(renderPath)) return renderPath;
+    }
+    throw std::runtime_error("Unknown render path: " + name);
+}
+
+// How the descriptor heap (see DescriptorHeap.h) reaches the shaders. Bindless needs the update after bind features
+// of descriptor indexing; pooled is the fallback for devices without them and writes a fresh set every frame
+enum class DescriptorMode {
+    Bindless,
+    Pooled,
+};
+
+inline const char *descriptorModeName(DescriptorMode descriptorMode) {
+    switch (descriptorMode) {
+        case DescriptorMode::Bindless:
+            return "bindless";
+        case DescriptorMode::Pooled:
+            return "pooled";
+    }
+    return "unknown";
+}
+
+inline DescriptorMode parseDescriptorMode(const std::string &name) {
+    for (auto descriptorMode : {DescriptorMode::Bindless, DescriptorMode::Pooled}) {
+        if (name == descriptorModeName(descriptorMode)) return descriptorMode;
+    }
+    throw std::runtime_error("Unknown descriptor mode: " + name);
+}
+
+// How finished frames are handed to the display. The FIFO modes wait for vblank, which caps the frame rate at the
+// refresh rate but queues frames up; mailbox replaces the queued frame with a newer one, and immediate doesn't wait at
+// all and tears
+enum class PresentPolicy {
+    Fifo,         // Always available
+    FifoRelaxed,  // Like FIFO, but a frame that missed its vblank is shown right away, tearing instead of stuttering
+    Mailbox,      // Uncapped without tearing, at the cost of rendering frames that are never shown
+    Immediate,
+};
+
+inline const char *presentPolicyName(PresentPolicy presentPolicy) {
+    switch (presentPolicy) {
+        case PresentPolicy::Fifo:
+            return "fifo";
+        case PresentPolicy::FifoRelaxed:
+            return "fifo-relaxed";
+        case PresentPolicy::Mailbox:
+            return "mailbox";
+        case PresentPolicy::Immediate:
+            return "immediate";
+    }
+    return "unknown";
+}
+
+inline PresentPolicy parsePresentPolicy(const std::string &name) {
+    for (auto presentPolicy :
+         {PresentPolicy::Fifo, PresentPolicy::FifoRelaxed, PresentPolicy::Mailbox, PresentPolicy::Immediate}) {
+        if (name == presentPolicyName(presentPolicy)) return presentPolicy;
+    }
+    throw std::runtime_error("Unknown present policy: " + name);
+}
+
+inline VkPresentModeKHR presentPolicyMode(PresentPolicy presentPolicy) {
+    switch (presentPolicy) {
+        case PresentPolicy::Fifo:
+            return VK_PRESENT_MODE_FIFO_KHR;
+        case PresentPolicy::FifoRelaxed:
+            return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+        case PresentPolicy::Mailbox:
+            return VK_PRESENT_MODE_MAILBOX_KHR;
+        case PresentPolicy::Immediate:
+            return VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// Where objects outside the view are dropped before drawing. Either way the draw mode is replaced: the CPU writes the
+// commands of the visible objects for an indirect draw, the GPU writes them along with their count for an indirect
+// count draw
+enum class CullMode {
+    None,  // Everything is drawn and the rasterizer clips what is off screen
+    Cpu,   // Every object's bounds tested on the CPU while recording
+    Gpu,   // A compute pass before the frame's rendering, see GpuCuller.h
+};
+
+inline const char *cullModeName(CullMode cullMode) {
+    switch (cullMode) {
+        case CullMode::None:
+            return "none";
+        case CullMode::Cpu:
+            return "cpu";
+        case CullMode::Gpu:
+            return "gpu";
+    }
+    return "unknown";
+}
+
+inline CullMode parseCullMode(const std::string &name) {
+    for (auto cullMode : {CullMode::None, CullMode::Cpu, CullMode::Gpu}) {
+        if (name == cullModeName(cullMode)) return cullMode;
+    }
+    throw std::runtime_error("Unknown cull mode: " + name);
+}
+
+// Options that can be changed from the command line
+struct AppConfig {
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    uint32_t width = WIDTH;
+    uint32_t height = HEIGHT;
+
+    // The physical device to use, by index as listed with printDeviceInfo or by part of its name. Empty means the
+    // value of DEVICE_OVERRIDE_VARIABLE, and if that isn't set either the highest scoring device, see DeviceSelection.h
+    std::string deviceOverride;
+    bool preferCpuDevice = false;  // Score a CPU implementation such as lavapipe above any GPU, e.g. for benchmarks
+    bool printDeviceInfo = false;  // List every device with its capabilities and score while picking one
+
+    // Render without a window, surface or swap chain (e.g. CI machines that only have lavapipe)
+    bool headless = false;
+    uint32_t offscreenImageCount = DEFAULT_OFFSCREEN_IMAGE_COUNT;
+    uint32_t frameCount = 0;   // Frames to render before exiting. 0 means until the window is closed
+    std::string dumpFramePath;  // Where to write the last rendered frame as a PPM file. Empty means don't
+
+    // Copy frames back while rendering and write them out on a worker thread, see FrameCapture.h. Empty means don't.
+    // A directory for raw and PNG files, a command that reads raw frames from its standard input for pipe, e.g.
+    // "ffmpeg -f rawvideo -pixel_format rgba -video_size 800x600 -framerate 60 -i - capture.mp4". Only works on
+    // surfaces that offer an 8-bit RGBA or BGRA format, which is then preferred over anything else but sRGB BGRA
+    std::string capturePath;
+    CaptureFormat captureFormat = CaptureFormat::Png;
+    uint32_t captureInterval = 1;  // Every nth frame
+    uint32_t captureBufferCount = DEFAULT_CAPTURE_BUFFER_COUNT;
+
+    // Falls back to FIFO when the surface doesn't support it
+    PresentPolicy presentPolicy = PresentPolicy::Mailbox;
+    uint32_t swapChainImageCount = 0;  // Clamped to what the surface allows. 0 means one more than its minimum
+
+    // Start every frame as late as possible before the next vblank, see FramePacer.h. Needs VK_KHR_present_wait
+    bool framePacing = false;
+
+    // The SPIR-V bundle to load shaders from. Empty means the bundle embedded in the executable if there is one,
+    // otherwise DEFAULT_SHADER_BUNDLE_NAME next to the executable
+    std::string shaderBundlePath;
+
+    // Compiled pipelines are kept on disk between runs so only the first launch pays for shader compilation
+    bool usePipelineCache = true;
+    std::string pipelineCachePath = "pipeline_cache.bin";
+
+    // Specializes OPACITY in shader.frag. Below 1 the mesh is also alpha blended
+    float opacity = 1.0f;
+
+    // Watch the GLSL sources and swap in rebuilt pipelines while running
+    bool hotReload = false;
+    std::string shaderSourceDir = DEFAULT_SHADER_SOURCE_DIR;
+    std::string glslcPath = DEFAULT_GLSLC;
+
+    // Size of the generated triangle grid. 1 draws the classic single triangle
+    uint32_t triangleCount = 1;
+
+    // Number of copies of the mesh in the scene and how they are drawn
+    uint32_t objectCount = 1;
+    DrawMode drawMode = DrawMode::Instanced;
+
+    // Above 1 objects overlap their neighbours (see generateInstanceGrid()), for scenes that overdraw
+    float objectScale = 1.0f;
+    DrawOrder drawOrder = DrawOrder::FrontToBack;
+
+    // Count fragment shader invocations and report them per pixel
+    bool countOverdraw = false;
+
+    // Above 1 the view is zoomed in and circles around the scene (see animatedView()), so most objects are off screen
+    // and culling has something to do
+    float viewZoom = 1.0f;
+    CullMode cullMode = CullMode::None;
+
+    // GPU culling also drops objects hidden behind what the previous frame drew. Dynamic rendering only
+    bool occlusionCulling = false;
+
+    // PPM files loaded on a background thread and uploaded on the transfer queue while rendering. Objects cycle
+    // through them by instance index, each one showing up as soon as it is resident
+    std::vector<std::string> texturePaths;
+    VkDeviceSize textureUploadBudget = DEFAULT_TEXTURE_UPLOAD_BUDGET;  // Bytes per frame. 0 is unlimited
+
+    // Materials the objects cycle through, all in one buffer in the descriptor heap. 1 keeps the mesh colors
+    uint32_t materialCount = 1;
+
+    // Falls back to pooled when the device can't do bindless
+    DescriptorMode descriptorMode = DescriptorMode::Bindless;
+
+    // Dynamic rendering is core in Vulkan 1.3, which we require anyway, so the render pass is only kept for comparison
+    RenderPath renderPath = RenderPath::Dynamic;
+
+    // Worker threads recording secondary command buffers. 0 records everything inline on the main thread
+    uint32_t recordThreads = 0;
+
+    // Render a fixed number of frames for each object count and draw mode and report CPU record and frame times
+    bool benchmarkObjects = false;
+    std::vector<uint32_t> benchmarkObjectCounts = {1000, 10000, 100000};
+
+    // Compile every pipeline variant with an increasing number of threads instead of rendering
+    bool benchmarkPipelines = false;
+
+    // CPU spans around the frame stages and GPU timestamps, summarized as percentiles and optionally written out as a
+    // Chrome trace
+    bool profile = false;
+    std::string profileTracePath;
+
+    // Where to write a Chrome trace of the startup stages, up to the first frame being submitted. Time to first frame
+    // is printed either way
+    std::string startupTracePath;
+};
+
+// What a fixed-length headless run measured, for the benchmark harness
+struct BenchmarkResult {
+    std::string deviceName;
+    std::vector<double> frameMilliseconds;  // CPU time of every measured drawFrame, in order
+    double recordMilliseconds[3] = {};      // p50, p95, p99
+    double gpuFrameMilliseconds[3] = {};    // p50, p95, p99. Zero without timestamp support
+    VkDeviceSize allocatedBytes = 0;        // Device memory blocks
+    VkDeviceSize usedBytes = 0;             // Sub-allocated out of those blocks
+    double fragmentsPerPixel = 0.0;         // Only when counting overdraw
+    // What was used, which is pooled if bindless was asked for but unsupported
+    DescriptorMode descriptorMode = DescriptorMode::Pooled;
+    uint32_t texturesResident = 0;          // Streamed textures visible by the last frame
+    uint32_t objectsDrawn = 0;              // What was left after culling in the last frame
+    double cullMilliseconds = 0.0;          // p50 of the CPU cull or of the GPU cull pass, whichever was used
+};
+
+// How often the windowed loop prints the rolling percentiles while profiling
+const std::chrono::seconds PROFILE_REPORT_INTERVAL(5);
+
+// What drawFrame() got done
+enum class FrameStatus {
+    Drawn,
+    OutOfDate,  // The swap chain went out of date again right after being recreated, e.g. mid resize. Just retry
+    Minimized,  // Nothing to draw to until the window comes back
+};
+
+// Members are destroyed in reverse declaration order, and that is what tears the renderer down: everything created
+// from the device is declared after it, the device after the instance, and the window before all of them
+class HelloTriangleApplication {
+    struct WindowDeleter {
+        void operator()(GLFWwindow *window) const {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
+    };
+
+    AppConfig config;
+    std::unique_ptr<GLFWwindow, WindowDeleter> window;
+    UniqueInstance instance;
+    UniqueDebugMessenger debugMessenger;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;  // implicitly destroyed when `instance` is destroyed
+    PhysicalDeviceInfo deviceInfo;
+    UniqueDevice device;
+    VkPhysicalDeviceFeatures enabledDeviceFeatures{};
+    VkPhysicalDeviceVulkan12Features enabledVulkan12Features{};
+    uint32_t maxDrawIndirectCount = 1;
+    bool presentWaitEnabled = false;  // VK_KHR_present_id and VK_KHR_present_wait
+    VkQueue graphicsQueue;  // Queues are implicitly destroyed with the device is destroyed
+    VkQueue presentationQueue;
+
+    // Texture streaming's queue, see createLogicalDevice(). The streamer submits to it from its own thread, so this one
+    // has to hold transferQueueMutex to touch it, which includes waiting for the whole device to go idle
+    VkQueue transferQueue;
+    uint32_t transferFamily;
+    std::mutex transferQueueMutex;
+    UniqueSurface surface;                      // Stays null when running headless
+    UniqueSwapchain swapChain;                  // Stays null when running headless
+    std::vector<VkImage> swapChainsImages;      // Offscreen pool images when running headless
+    std::vector<Image> offscreenImages;
+    uint32_t nextOffscreenImage = 0;
+    VkFormat swapChainImageFormat;  // Needed for later after swap chain creation
+    VkExtent2D swapChainExtent;     // Needed for later after swap chain creation
+    std::vector<UniqueImageView> swapChainImageViews;
+
+    // A single depth image is enough for every frame in flight: each frame clears it and at most the HiZ pyramid reads
+    // it afterwards, so frames only have to be kept from writing it at the same time. It is a transient image of the
+    // render graph, which owns it
+    VkFormat depthFormat;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+
+    UniqueRenderPass renderPass;  // Stays null with dynamic rendering, and so do the framebuffers
+    std::unique_ptr<ShaderBundle> shaderBundle;
+    UniqueShaderModule vertShaderModule;
+    UniqueShaderModule fragShaderModule;
+    ShaderReflection vertReflection;  // What the shaders declare, see SpirvReflection.h
+    ShaderReflection fragReflection;
+    std::unique_ptr<DescriptorHeap> descriptorHeap;
+    VkDescriptorSet frameDescriptorSet = VK_NULL_HANDLE;  // The heap's set for the frame being recorded
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts;  // Indexed by set number. The heap owns its own layout
+    std::vector<UniqueDescriptorSetLayout> ownedSetLayouts;   // All the others, in no particular order
+    UniquePipelineLayout pipelineLayout;
+    VkShaderStageFlags pushConstantStages = 0;  // Stages that declare the DrawConstants block
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    UniquePipeline graphicsPipeline;
+    UniquePipelineCache pipelineCache;
+    bool pipelineCacheWarm = false;  // Whether the cache was seeded from a valid blob on disk
+    std::vector<UniqueFramebuffer> swapChainFramebuffers;
+    UniqueCommandPool commandPool;
+
+    std::unique_ptr<DeviceMemoryAllocator> allocator;
+    std::unique_ptr<StagingRing> stagingRing;
+    Buffer vertexBuffer;
+    Buffer indexBuffer;
+    uint32_t indexCount = 0;
+
+    // One InstanceData and one VkDrawIndexedIndirectCommand per object
+    Buffer instanceBuffer;
+    Buffer indirectBuffer;
+    Buffer indirectCountBuffer;
+    uint32_t objectCount = 0;
+
+    ObjectBounds meshBounds{};
+    std::vector<ObjectBounds> objectBounds;  // Only kept for CPU culling, in instance buffer order
+
+    // CPU culling writes the commands of the visible objects into the frame's buffer while recording
+    std::vector<Buffer> cpuCulledDrawBuffers;
+    uint32_t cpuVisibleCount = 0;  // In the buffer of the frame recorded last
+
+    Buffer materialBuffer;
+    DrawConstants drawConstants{};  // Pushed before every draw list
+
+    std::unique_ptr<TextureStreamer> textureStreamer;  // Only when there are textures to stream
+    std::vector<StreamedTexture> streamedTextures;     // The resident ones, in the order they arrived
+    UniqueSampler textureSampler;
+
+    // Heap element of each requested texture, NO_TEXTURE until it is resident. The shaders read it from a per frame
+    // copy in a storage buffer, since a frame still in flight may be using an older version
+    std::vector<uint32_t> textureSlots;
+    std::vector<Buffer> textureTables;
+    std::vector<uint32_t> textureTableSlots;
+    uint64_t textureWaitValue = 0;  // Timeline value the frame being recorded has to wait for. 0 when there is none
+    double lastRecordMilliseconds = 0.0;
+
+    // Everything the CPU touches while recording a frame is duplicated per frame in flight so that recording frame N+1
+    // never has to wait for the GPU to finish frame N
+    std::vector<VkCommandBuffer> commandBuffers;
+    std::unique_ptr<ParallelCommandRecorder> commandRecorder;  // Only when recording on worker threads
+    uint32_t recordThreadLimit = 0;                             // Lets the benchmark use fewer threads than it has
+    uint32_t currentFrame = 0;
+
+    // Frames are numbered in submission order, and each frame's submit signals its number on this timeline. Waiting for
+    // a frame slot is waiting for the number it last submitted, and anything that has to outlive the frames using it
+    // goes into the deletion queue with a number instead of holding on to a fence
+    std::unique_ptr<TimelineSemaphore> frameTimeline;
+    uint64_t completedFrameCount = 0;  // Read from the timeline once per frame
+    std::vector<uint64_t> frameSlotSubmitCounts;
+
+    // Replaced swap chains, reloaded pipelines and buffers that are swapped out mid-run. Emptied as frames complete,
+    // so nothing is released by waiting for the device to go idle. Declared after the allocator since some entries
+    // give memory back to it
+    DeletionQueue deletionQueue;
+
+    std::unique_ptr<GpuCuller> gpuCuller;  // Only with GPU culling
+    std::unique_ptr<FrameCapture> frameCapture;  // Only when capturing
+
+    // The passes of a frame and the barriers between them, see createRenderGraph(). Rebuilt with the swap chain, and
+    // declared after the deletion queue since replaced graphs are retired to it
+    std::unique_ptr<RenderGraph> renderGraph;
+    uint32_t swapChainResource = 0;  // The acquired image in the graph
+    uint32_t frameImageIndex = 0;    // What the passes are recorded for, set before the graph is executed
+    CullView frameView;
+
+    // Acquire and present only take binary semaphores, so those two stay. The presentation engine holds on to the
+    // "render finished" semaphore until the image is presented, so it is tied to the swap chain image rather than to
+    // the frame slot
+    std::vector<UniqueSemaphore> imageAvailableSemaphores;
+    std::vector<UniqueSemaphore> renderFinishedSemaphores;
+
+    // The number of the frame that last rendered into each swap chain image. The swap chain can hand out images in any
+    // order so an image may still be in use by an older frame than the one this slot last submitted
+    std::vector<uint64_t> imageFrameNumbers;
+
+    bool swapChainOutOfDate = false;  // Set on resize or when acquire/present report the chain no longer matches
+
+    std::unique_ptr<FramePacer> framePacer;  // Null when headless
+    std::chrono::steady_clock::time_point frameInputTime;  // When the frame being drawn polled its input
+
+    std::unique_ptr<Profiler> startupProfiler;  // From construction until the first frame is submitted, then null
+    std::unique_ptr<Profiler> profiler;        // Null unless profiling
+    std::unique_ptr<GpuProfiler> gpuProfiler;  // Also null if the queue has no timestamp support
+    std::unique_ptr<OverdrawCounter> overdrawCounter;  // Null unless counting overdraw
+
+    // Hot shader reload. Changed sources are compiled and the pipeline rebuilt on a worker thread; the render loop only
+    // ever checks whether the result is ready, and swaps it in between frames
+    struct ShaderReload {
+        UniqueShaderModule vertShaderModule;  // Null if shader.vert did not change
+        UniqueShaderModule fragShaderModule;
+        UniquePipeline pipeline;
+    };
+    std::unique_ptr<DirectoryWatcher> shaderWatcher;  // Null unless hot reloading
+    std::unique_ptr<ThreadPool> shaderReloadThread;
+    std::future<ShaderReload> pendingShaderReload;
+    std::set<std::string> changedShaders;  // Changed while a reload was already running
+
+public:
+    explicit HelloTriangleApplication(const AppConfig &config) : config(config) {
+        if (this->config.framesInFlight == 0) throw std::runtime_error("At least one frame in flight is required");
+        if (this->config.offscreenImageCount == 0) throw std::runtime_error("At least one offscreen image is required");
+        if (this->config.triangleCount == 0) throw std::runtime_error("At least one triangle is required");
+        if (this->config.objectCount == 0) throw std::runtime_error("At least one object is required");
+        if (this->config.viewZoom < 1.0f) throw std::runtime_error("The view zoom can't be below 1");
+        if (this->config.occlusionCulling && this->config.cullMode != CullMode::Gpu) {
+            throw std::runtime_error("Occlusion culling needs GPU culling");
+        }
+        if (this->config.occlusionCulling && this->config.renderPath != RenderPath::Dynamic) {
+            throw std::runtime_error("Occlusion culling needs dynamic rendering");
+        }
+        if (this->config.captureInterval == 0) throw std::runtime_error("The capture interval can't be 0");
+        if (this->config.captureBufferCount == 0) throw std::runtime_error("At least one capture buffer is required");
+        // Blended objects only come out right when the ones behind are drawn first, whatever order was asked for
+        if (this->config.opacity < 1.0f) this->config.drawOrder = DrawOrder::BackToFront;
+        startupProfiler = std::make_unique<Profiler>();
+    }
+
+    // The members destroy themselves. This only makes sure the GPU is done with them, which matters when run() was
+    // left by an exception and never got to cleanup()
+    ~HelloTriangleApplication() {
+        if (device != VK_NULL_HANDLE) waitDeviceIdle();
+    }
+
+    void run() {
+        if (!config.headless) {
+            ProfileScope scope(startupProfiler.get(), "window");
+            initWindow();
+        }
+        initVulkan();
+        if (config.benchmarkPipelines) {
+            benchmarkPipelineCompilation();
+        } else if (config.benchmarkObjects) {
+            benchmarkObjectCounts();
+        } else {
+            mainLoop();
+        }
+        if (frameCapture != nullptr) {
+            frameCapture->finish(frameTimeline->completedValue());  // The loops leave the device idle
+            frameCapture->printSummary(std::cout);
+        }
+        reportProfile();
+        reportLatency();
+        if (overdrawCounter != nullptr) {
+            std::cout << "Overdraw: " << collectFragmentsPerPixel() << " fragments shaded per pixel ("
+                      << drawOrderName(config.drawOrder) << ")\n";
+        }
+        cleanup();
+    }
+
+    // Renders `warmupFrames` frames that are thrown away, then `measuredFrames` that are timed. Meant for headless
+    // configurations, which are not throttled by the display
+    BenchmarkResult runBenchmark(uint32_t warmupFrames, uint32_t measuredFrames) {
+        config.profile = true;
+        config.frameCount = measuredFrames;  // Sizes the profiler window so no measured frame is dropped
+        if (!config.headless) initWindow();
+        initVulkan();
+
+        for (uint32_t i = 0; i < warmupFrames; i++) drawFrame();
+        waitDeviceIdle();
+        profiler->clear();
+        if (overdrawCounter != nullptr) collectFragmentsPerPixel();  // Drops the warm-up frames
+
+        BenchmarkResult result;
+        result.frameMilliseconds.reserve(measuredFrames);
+        for (uint32_t i = 0; i < measuredFrames; i++) {
+            auto start = std::chrono::steady_clock::now();
+            drawFrame();
+            result.frameMilliseconds.push_back(
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        waitDeviceIdle();
+
+        // GPU timestamps are collected one lap of the frame ring late, so the first frames in flight worth of "gpu
+        // frame" samples belong to the warm-up and the last ones are never read. The distribution is the same
+        const double percentiles[3] = {50.0, 95.0, 99.0};
+        for (int i = 0; i < 3; i++) {
+            result.recordMilliseconds[i] = profiler->percentile("record", percentiles[i]);
+            result.gpuFrameMilliseconds[i] = profiler->percentile("gpu frame", percentiles[i]);
+        }
+
+        result.deviceName = deviceInfo.properties.deviceName;
+        result.allocatedBytes = allocator->getAllocatedBytes();
+        result.usedBytes = allocator->getUsedBytes();
+        result.descriptorMode = config.descriptorMode;
+        result.texturesResident = static_cast<uint32_t>(streamedTextures.size());
+        result.objectsDrawn = lastObjectsDrawn();
+        if (config.cullMode != CullMode::None) {
+            result.cullMilliseconds =
+                profiler->percentile(config.cullMode == CullMode::Cpu ? "cpu cull" : "gpu cull", 50.0);
+        }
+        if (overdrawCounter != nullptr) result.fragmentsPerPixel = collectFragmentsPerPixel();
+
+        cleanup();
+        return result;
+    }
+
+private:
+    void initWindow() {
+        glfwInit();  // Initialize the GLFW Library
+
+        // Do not create an OpenGL context
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+        // Create the actual window
+        window.reset(glfwCreateWindow(static_cast<int>(config.width), static_cast<int>(config.height), "Vulkan",
+                                      nullptr, nullptr));
+
+        // Drivers are not required to report VK_ERROR_OUT_OF_DATE_KHR after a resize, so listen for it ourselves
+        glfwSetWindowUserPointer(window.get(), this);
+        glfwSetFramebufferSizeCallback(window.get(), framebufferResizeCallback);
+    }
+
+    static void framebufferResizeCallback(GLFWwindow *window, int, int) {
+        auto app = reinterpret_cast<HelloTriangleApplication *>(glfwGetWindowUserPointer(window));
+        app->swapChainOutOfDate = true;
+    }
+
+    void createInstance() {
+        // This is the connection between my app and the Vulkan lib
+
+        // Included later - Enable Vk Validation Layers
+        if (enableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error("Validation layers requested but not available.");
+        }
+
+        // Info about our application
+        // It's optional but helps the driver optimize
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Vk First Triangle";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_3;  // Core 1.2+ commands like vkCmdDrawIndexedIndirectCount need it
+
+        // Not optional and includes information on what Vulkan extensions and validation layers to include
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+
+        // GLFW will handle windows for us so we need to get the extensions it needs and pass it to Vulkan
+        auto extensions = getRequiredExtensions();
+        const uint32_t extensionsCount = extensions.size();
+        checkSupportedExtensions(extensions.data(), &extensionsCount);
+
+        createInfo.enabledExtensionCount = extensionsCount;
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        // Now Includes validation layers
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = std::size(validationLayers);
+            createInfo.ppEnabledLayerNames = validationLayers;
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = &debugCreateInfo;
+        } else {
+            createInfo.enabledLayerCount = 0;
+            createInfo.pNext = nullptr;
+        }
+
+        // That's everything specified. Create the Vulkan Instance. If everything goes well, then all the information is
+        // stored in the instance handle. vkCreateInstance will either return VK_SUCCESS or an error for us to check
+        if (vkCreateInstance(&createInfo, nullptr, instance.put()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create Vk Instance");
+        }
+    }
+
+    std::vector<const char *> getRequiredExtensions() {
+        std::vector<const char *> extensions;
+
+        // Headless rendering never presents, so it doesn't need any of the surface extensions GLFW asks for
+        if (!config.headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
+
+        if (enableValidationLayers) extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+
+        return extensions;
+    }
+
+    void checkSupportedExtensions(const char **requiredExtensions, const uint32_t *requiredExtensionCount) {
+        // Request just the number of supported Extensions
+        uint32_t supportedExtensionCount = 0;
+        vkEnumerateInstanceExtensionProperties(nullptr, &supportedExtensionCount, nullptr);
+
+        // Get the extension details
+        std::vector<VkExtensionProperties> extensions(supportedExtensionCount);
+        vkEnumerateInstanceExtensionProperties(nullptr, &supportedExtensionCount, extensions.data());
+
+        // Extra credit to check if the required extensions are supported
+        std::set<std::string> supportedExtensionsLut{};
+
+        for (const VkExtensionProperties &extension : extensions) {
+            supportedExtensionsLut.insert({extension.extensionName});
+        }
+
+        std::cout << "Required Extensions:\n";
+        for (int i = 0; i < *requiredExtensionCount; i++) {
+            std::cout << "\t" << requiredExtensions[i];
+
+            if (supportedExtensionsLut.contains(requiredExtensions[i])) {
+                std::cout << " (supported)" << "\n";
+            } else {
+                std::cout << " (not supported)" << "\n";
+            }
+        }
+    }
+
+    bool checkValidationLayerSupport() {
+        // Get the number of layer properties
+        uint32_t layerCount;
+        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+        std::vector<VkLayerProperties> availableLayers(layerCount);
+        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+        // My method again for checking two lists
+        std::unordered_map<std::string, bool> requestedValidationLayersLut{};
+        for (const char *requestedLayer : validationLayers) {
+            requestedValidationLayersLut.insert({requestedLayer, false});
+        }
+
+        for (const auto &layer : availableLayers) {
+            if (requestedValidationLayersLut.contains(layer.layerName)) {
+                requestedValidationLayersLut[layer.layerName] = true;
+            }
+        }
+
+        for (auto &pair : requestedValidationLayersLut) {
+            if (pair.second == false) return false;
+        }
+
+        return true;
+    }
+
+    void setupDebugMessenger() {
+        if (!enableValidationLayers) return;
+
+        // Setup the debugger
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        populateDebugMessengerCreateInfo(createInfo);
+
+        // Pass it to Vulkan
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, debugMessenger.put(instance)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to set up debug messenger");
+        }
+    }
+
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                                 VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                                 VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+        createInfo.pUserData = nullptr;  // Optional
+        createInfo.flags = 0;
+    }
+
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+                                                        VkDebugUtilsMessageTypeFlagsEXT messageTypes,
+                                                        const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+                                                        void *pUserData) {
+        switch (messageSeverity) {
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
+                std::cout << "[DEBUG]\t" << pCallbackData->pMessage << "\n";
+                break;
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
+                std::cout << "[WARN]\t" << pCallbackData->pMessage << "\n";
+                break;
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
+                std::cerr << "[ERROR]\t" << pCallbackData->pMessage << "\n";
+                break;
+            default:
+                std::cerr << "[UNKNOWN]\t" << pCallbackData->pMessage << "\n";
+        }
+
+        // Indicates if the Vulkan call that triggered the validation layer message should be aborted
+        return VK_FALSE;  // Normally keep false
+    }
+
+    void createSurface() {
+        if (config.headless) return;
+
+        if (glfwCreateWindowSurface(instance, window.get(), nullptr, surface.put(instance)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create window surface");
+        }
+    }
+
+    // The first suitable device is often an integrated GPU or a CPU implementation even when there is a discrete card,
+    // so every suitable device is scored and the best one wins. Ties go to the device enumerated first. An override
+    // skips the scoring but must still name a suitable device
+    void pickPhysicalDevice() {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+        if (deviceCount == 0) throw std::runtime_error("Failed to find GPUs that support Vulkan");
+
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        std::vector<PhysicalDeviceInfo> infos(deviceCount);
+        std::vector<bool> suitable(deviceCount);
+        std::vector<std::string> names;
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            suitable[i] = isDeviceSuitable(devices[i], infos[i]);
+            infos[i].capabilities = queryDeviceCapabilities(devices[i], infos[i].properties, infos[i].extensions);
+            if (suitable[i]) infos[i].score = scoreDevice(infos[i].capabilities, config.preferCpuDevice);
+            names.push_back(infos[i].properties.deviceName);
+        }
+
+        std::string deviceOverride = config.deviceOverride;
+        if (deviceOverride.empty()) {
+            const char *variable = std::getenv(DEVICE_OVERRIDE_VARIABLE);
+            if (variable != nullptr) deviceOverride = variable;
+        }
+
+        std::optional<size_t> chosen;
+        if (!deviceOverride.empty()) {
+            chosen = findOverriddenDevice(deviceOverride, names);
+            if (!chosen.has_value()) throw std::runtime_error("No device matches " + deviceOverride);
+        } else {
+            for (size_t i = 0; i < deviceCount; i++) {
+                if (suitable[i] && (!chosen.has_value() || infos[i].score > infos[chosen.value()].score)) chosen = i;
+            }
+        }
+
+        if (config.printDeviceInfo) printDevices(infos, suitable, chosen);
+        if (!chosen.has_value()) throw std::runtime_error("No suitable GPUs");
+        if (!suitable[chosen.value()]) {
+            throw std::runtime_error("The requested device is not suitable: " + names[chosen.value()]);
+        }
+
+        physicalDevice = devices[chosen.value()];
+        deviceInfo = std::move(infos[chosen.value()]);
+        if (config.preferCpuDevice && deviceInfo.properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU) {
+            std::cout << "No suitable CPU implementation, using " << deviceInfo.properties.deviceName << "\n";
+        }
+    }
+
+    void printDevices(const std::vector<PhysicalDeviceInfo> &infos, const std::vector<bool> &suitable,
+                      std::optional<size_t> chosen) {
+        std::cout << "Vulkan devices:\n";
+        for (size_t i = 0; i < infos.size(); i++) {
+            std::cout << (chosen == i ? " * " : "   ") << i << ": " << infos[i].properties.deviceName << " (";
+            if (suitable[i]) {
+                std::cout << "score " << infos[i].score;
+            } else {
+                std::cout << "not suitable";
+            }
+            std::cout << ")\n       " << describeDevice(infos[i].properties, infos[i].capabilities) << "\n";
+        }
+    }
+
+    // Fills in `info` along the way
+    bool isDeviceSuitable(VkPhysicalDevice device, PhysicalDeviceInfo &info) {
+        // Basic device properties like the name, type and supported Vulkan version
+        VkPhysicalDeviceProperties &deviceProperties = info.properties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+        // Optional features like texture compression, 64-bit floats and multi viewport rendering
+        VkPhysicalDeviceFeatures deviceFeatures;
+        vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+
+        // As an example
+        // return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU && deviceFeatures.geometryShader;
+
+        // We care about supported: vulkan version, queue families, extensions, swap chain
+        bool supportsVulkan1_3 = deviceProperties.apiVersion >= VK_API_VERSION_1_3;
+        info.queueFamilies = findQueueFamilies(device);
+        info.extensions = queryDeviceExtensions(device);
+        bool extensionsSupported = checkDeviceExtensionSupport(info.extensions);
+        bool swapChainAdequate = config.headless;  // There is no swap chain to be adequate when running headless
+        if (extensionsSupported && !config.headless) {
+            info.swapChainSupport = querySwapChainSupport(device);
+            swapChainAdequate = !info.swapChainSupport.surfaceFormats.empty() &&
+                                !info.swapChainSupport.presentationModes.empty();
+        }
+
+        return supportsVulkan1_3 && info.queueFamilies.isComplete() && extensionsSupported && swapChainAdequate;
+    }
+
+    static std::set<std::string> queryDeviceExtensions(VkPhysicalDevice physicalDevice) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+        std::set<std::string> names;
+        for (const auto &extension : availableExtensions) {
+            names.insert(extension.extensionName);
+        }
+        return names;
+    }
+
+    bool checkDeviceExtensionSupport(const std::set<std::string> &availableExtensions) {
+        auto deviceExtensions = getRequiredDeviceExtensions();
+        return std::all_of(deviceExtensions.begin(), deviceExtensions.end(),
+                           [&](const char *name) { return availableExtensions.count(name) != 0; });
+    }
+
+    // For extensions that are used when they are there
+    bool isDeviceExtensionSupported(const char *name) const { return deviceInfo.extensions.count(name) != 0; }
+
+    std::vector<const char *> getRequiredDeviceExtensions() {
+        std::vector<const char *> extensions;
+        if (!config.headless) {
+            extensions.insert(extensions.end(), std::begin(presentationDeviceExtensions),
+                              std::end(presentationDeviceExtensions));
+        }
+
+        return extensions;
+    }
+
+    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice physicalDevice) {
+        SwapChainSupportDetails details;
+
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &details.capabilities);
+
+        uint32_t formatCount;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, nullptr);
+        if (formatCount != 0) {
+            details.surfaceFormats.resize(formatCount);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, details.surfaceFormats.data());
+        }
+
+        uint32_t presentationModeCount;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentationModeCount, nullptr);
+        if (presentationModeCount != 0) {
+            details.presentationModes.resize(presentationModeCount);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentationModeCount,
+                                                      details.presentationModes.data());
+        }
+
+        return details;
+    }
+
+    // Chooses the best swap chain format; we will prefer 32-bit SRGB colors
+    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats) {
+        for (const auto &availableFormat : availableFormats) {
+            if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB &&
+                availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                return availableFormat;
+            }
+        }
+
+        // Frame capture only writes out 8-bit RGBA and BGRA, so any other fallback (e.g. 10-bit) won't do then
+        if (!config.capturePath.empty()) {
+            for (const auto &availableFormat : availableFormats) {
+                if (FrameCapture::supportsImageFormat(availableFormat.format)) return availableFormat;
+            }
+            throw std::runtime_error("Frame capture needs an 8-bit RGBA or BGRA surface format");
+        }
+
+        return availableFormats[0];
+    }
+
+    // The most important part of the swap chain with 4 different modes including immediate, v-sync, triple buffer, etc.
+    VkPresentModeKHR chooseSwapPresentationMode(const std::vector<VkPresentModeKHR> &availablePresentationModes) {
+        // Mailbox, the default, is a good trade-off of low latency and no tearing if energy is not a concern
+        VkPresentModeKHR wanted = presentPolicyMode(config.presentPolicy);
+        for (const auto &availableMode : availablePresentationModes) {
+            if (availableMode == wanted) return availableMode;
+        }
+
+        if (config.presentPolicy != PresentPolicy::Mailbox) {
+            std::cout << "Present policy " << presentPolicyName(config.presentPolicy)
+                      << " is not supported by this surface, falling back to fifo\n";
+        }
+        return VK_PRESENT_MODE_FIFO_KHR;  // v-sync similar option is the only one guaranteed to be available
+    }
+
+    // The resolution of the swap chain images. It's almost always exactly equal to the resolution of the window that
+    // we're drawing to in pixels (can differ on high pixel-density displays)
+    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
+        if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) return capabilities.currentExtent;
+
+        // If the width was the max, we are dealing with a high density display and need to get true pixel locations
+        int width, height;
+        glfwGetFramebufferSize(window.get(), &width, &height);
+
+        VkExtent2D actualExtent = {
+            static_cast<uint32_t>(width),
+            static_cast<uint32_t>(height),
+        };
+
+        actualExtent.width =
+            std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+        actualExtent.height =
+            std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+        return actualExtent;
+    }
+
+    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
+        QueueFamilyIndices indices;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+        // Find the indices in the queue families of the queues we need
+        VkBool32 presentationSupport = false;
+        int i = 0;
+        for (const auto &queueFamily : queueFamilies) {
+            if (!indices.isComplete()) {
+                if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) indices.graphicsFamily = i;
+
+                // Will likely be the graphics family too but this is a more general support. Without a surface nothing
+                // is presented, so any queue will do
+                if (surface == VK_NULL_HANDLE) {
+                    presentationSupport = indices.graphicsFamily.has_value();
+                    if (presentationSupport) indices.presentationFamily = indices.graphicsFamily;
+                } else if (!presentationSupport) {
+                    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
+                    if (presentationSupport) indices.presentationFamily = i;
+                }
+            }
+
+            // A family without compute as well is the dedicated copy engine; async compute families come second
+            bool transferOnly = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                                !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+            bool copyEngine = transferOnly && !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT);
+            if (copyEngine || (transferOnly && !indices.transferFamily.has_value())) indices.transferFamily = i;
+            i++;
+        }
+
+        if (indices.graphicsFamily.has_value()) {
+            indices.graphicsQueueCount = queueFamilies[indices.graphicsFamily.value()].queueCount;
+        }
+        return indices;
+    }
+
+    void createLogicalDevice() {
+        const QueueFamilyIndices &indices = deviceInfo.queueFamilies;
+        std::set queueFamilySet = {indices.graphicsFamily.value(), indices.presentationFamily.value()};
+        if (indices.transferFamily.has_value()) queueFamilySet.insert(indices.transferFamily.value());
+
+        // Texture streaming gets a queue of its own: the transfer family's if there is one, else a second graphics
+        // queue, and only as a last resort the graphics queue itself
+        bool secondGraphicsQueue = !indices.transferFamily.has_value() && indices.graphicsQueueCount >= 2;
+
+        // This is not pre-allocated because values in the set could map to the same key, so the set could be smaller
+        // than it appears e.g. graphics and presentation families are typically the same but might not be.
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+
+        // Specifies the queues we want. Uploads can wait, so a second graphics queue gets the lower priority
+        float queuePriorities[] = {1.0f, 0.5f};
+        for (uint32_t queueFamily : queueFamilySet) {
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = queueFamily;
+            queueCreateInfo.queueCount = secondGraphicsQueue && queueFamily == indices.graphicsFamily.value() ? 2 : 1;
+            queueCreateInfo.pQueuePriorities = queuePriorities;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        // The specifies what special features we want to use
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+        VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+        supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supportedFeatures2{};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &supportedVulkan12Features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+
+        // Extension feature structs may only be chained once the extension is known to be there. Present wait needs
+        // both extensions and both features, and a swap chain to wait on
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentIdFeatures.pNext = &presentWaitFeatures;
+        if (!config.headless && std::all_of(std::begin(presentWaitDeviceExtensions),
+                                            std::end(presentWaitDeviceExtensions),
+                                            [&](const char *name) { return isDeviceExtensionSupported(name); })) {
+            VkPhysicalDeviceFeatures2 presentFeatures2{};
+            presentFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            presentFeatures2.pNext = &presentIdFeatures;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &presentFeatures2);
+            presentWaitEnabled = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+        }
+
+        // Newer features are enabled through a pNext chain instead of pEnabledFeatures
+        VkPhysicalDeviceFeatures2 deviceFeatures2{};
+        deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        VkPhysicalDeviceFeatures &deviceFeatures = deviceFeatures2.features;
+        deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;  // Wireframe pipeline variants
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;  // Many draws per indirect call
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;  // Overdraw counter
+        deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;  // ... around secondary command buffers
+        // Indexing the descriptor heap with push constants
+        deviceFeatures.shaderSampledImageArrayDynamicIndexing =
+            supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+        deviceFeatures.shaderStorageBufferArrayDynamicIndexing =
+            supportedFeatures.shaderStorageBufferArrayDynamicIndexing;
+        enabledDeviceFeatures = deviceFeatures;
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+        // The descriptor heap, see createDescriptorHeap()
+        vulkan12Features.runtimeDescriptorArray = supportedVulkan12Features.runtimeDescriptorArray;
+        vulkan12Features.descriptorBindingPartiallyBound = supportedVulkan12Features.descriptorBindingPartiallyBound;
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind =
+            supportedVulkan12Features.descriptorBindingSampledImageUpdateAfterBind;
+        vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind =
+            supportedVulkan12Features.descriptorBindingStorageBufferUpdateAfterBind;
+        vulkan12Features.descriptorBindingUpdateUnusedWhilePending =
+            supportedVulkan12Features.descriptorBindingUpdateUnusedWhilePending;
+        // Streamed textures: neighbouring objects sample different ones, and uploads are tracked on a timeline
+        vulkan12Features.shaderSampledImageArrayNonUniformIndexing =
+            supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+        vulkan12Features.timelineSemaphore = VK_TRUE;  // Mandatory in Vulkan 1.2
+        // The depth image only ever uses the depth-only layouts, also for formats with stencil. Mandatory in Vulkan 1.2
+        vulkan12Features.separateDepthStencilLayouts = VK_TRUE;
+        deviceFeatures2.pNext = &vulkan12Features;
+
+        // Both are mandatory in Vulkan 1.3, so there is nothing to check
+        VkPhysicalDeviceVulkan13Features vulkan13Features{};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        vulkan13Features.dynamicRendering = VK_TRUE;
+        vulkan13Features.synchronization2 = VK_TRUE;
+        vulkan12Features.pNext = &vulkan13Features;
+        if (presentWaitEnabled) vulkan13Features.pNext = &presentIdFeatures;  // Both features as queried, so both on
+        enabledVulkan12Features = vulkan12Features;
+        enabledVulkan12Features.pNext = nullptr;
+
+        maxDrawIndirectCount =
+            enabledDeviceFeatures.multiDrawIndirect ? deviceInfo.properties.limits.maxDrawIndirectCount : 1;
+
+        // Finally create the logical device
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = &deviceFeatures2;
+        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        createInfo.pEnabledFeatures = nullptr;  // Passed through deviceFeatures2 instead
+
+        // Similar to VkInstanceCreateInfo but device specific
+        auto deviceExtensions = getRequiredDeviceExtensions();
+        if (presentWaitEnabled) {
+            deviceExtensions.insert(deviceExtensions.end(), std::begin(presentWaitDeviceExtensions),
+                                    std::end(presentWaitDeviceExtensions));
+        }
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+        if (enableValidationLayers) {  // Newer versions don't need this but good for compatibility
+            createInfo.enabledLayerCount = std::size(validationLayers);
+            createInfo.ppEnabledLayerNames = validationLayers;
+        } else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, device.put()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create logical device");
+        }
+
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.presentationFamily.value(), 0, &presentationQueue);
+
+        if (indices.transferFamily.has_value()) {
+            transferFamily = indices.transferFamily.value();
+            vkGetDeviceQueue(device, transferFamily, 0, &transferQueue);
+        } else {
+            transferFamily = indices.graphicsFamily.value();
+            if (secondGraphicsQueue) {
+                vkGetDeviceQueue(device, transferFamily, 1, &transferQueue);
+            } else {
+                transferQueue = graphicsQueue;
+            }
+        }
+    }
+
+    // Only the transfer queue is shared with another thread, and the graphics queue only is when the device has no
+    // queue to spare for streaming
+    std::mutex *sharedQueueMutex(VkQueue queue) { return queue == transferQueue ? &transferQueueMutex : nullptr; }
+
+    // Held around every submit and present on a queue the texture streamer may be submitting to at the same time
+    std::unique_lock<std::mutex> lockSharedQueue(VkQueue queue) {
+        std::mutex *mutex = sharedQueueMutex(queue);
+        if (mutex == nullptr) return {};
+        return std::unique_lock(*mutex);
+    }
+
+    void waitDeviceIdle() {
+        std::lock_guard lock(transferQueueMutex);
+        vkDeviceWaitIdle(device);
+    }
+
+    void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE) {
+        const SwapChainSupportDetails &swapChainSupport = deviceInfo.swapChainSupport;
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.surfaceFormats);
+        VkPresentModeKHR presentMode = chooseSwapPresentationMode(swapChainSupport.presentationModes);
+        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+        swapChainExtent = extent;  // The format was already picked by chooseAttachmentFormats()
+
+        // We need to specify how many images to keep in the swap chain. There is a required minimum amount, but it is
+        // recommended to keep 1 more than the required minimum. Fewer images means fewer frames can be queued for the
+        // display, which is less latency but less slack when a frame runs long
+        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (config.swapChainImageCount != 0) {
+            imageCount = std::max(config.swapChainImageCount, swapChainSupport.capabilities.minImageCount);
+        }
+
+        // We also need to set below the maximum images allowed in the swap chain (0 means there is no max)
+        if (swapChainSupport.capabilities.maxImageCount > 0 &&
+            imageCount > swapChainSupport.capabilities.maxImageCount) {
+            imageCount = swapChainSupport.capabilities.maxImageCount;
+        }
+
+        // Now the Create Info struct
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = surface;
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1;  // Amount of layers each image has. Always 1 unless a 3D app
+        createInfo.imageUsage =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;  // What we are going to use the images in the chain for. We are
+                                                  // rendering them directly so use this one
+
+        // Captured frames are copied out of the image. Only asked for when needed, since some drivers can't keep
+        // images that allow copies compressed
+        if (!config.capturePath.empty()) {
+            if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+                throw std::runtime_error("Frame capture needs swap chain images that can be copied from");
+            }
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+
+        // We now need to handle if images are used across queues. Again, the graphics and presentation queues are
+        // typically the same, but it is possible it can differ
+        const QueueFamilyIndices &indices = deviceInfo.queueFamilies;
+        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentationFamily.value()};
+
+        if (indices.graphicsFamily != indices.presentationFamily) {
+            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;  // Images can be used across multiple queue
+                                                                       // families without explicit ownership transfers
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+        } else {
+            createInfo.imageSharingMode =
+                VK_SHARING_MODE_EXCLUSIVE;  // An image is owned by one queue family at a time and ownership must be
+                                            // explicitly transferred before using it in another queue family. This
+                                            // option offers the best performance
+            createInfo.queueFamilyIndexCount = 0;      // Optional
+            createInfo.pQueueFamilyIndices = nullptr;  // Optional
+        }
+
+        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;  // Dont perform any extra transforms
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;             // No blending on the alpha channel
+        createInfo.presentMode = presentMode;
+        createInfo.clipped = VK_TRUE;  // Clips out pixels if the window is obscured
+        createInfo.oldSwapchain = oldSwapChain;  // Null on the first call. When recreating, lets the driver hand
+                                                 // resources over from the chain being replaced
+
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, swapChain.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create swap chain");
+        }
+
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+        swapChainsImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainsImages.data());
+    }
+
+    // Stand-in for the swap chain when running headless. The rest of the renderer only sees `swapChainsImages`,
+    // `swapChainImageFormat` and `swapChainExtent`, so the same render pass, pipeline and command recording are used
+    void createOffscreenImages() {
+        swapChainExtent = {config.width, config.height};
+
+        swapChainsImages.resize(config.offscreenImageCount);
+        offscreenImages.resize(config.offscreenImageCount);
+
+        for (uint32_t i = 0; i < config.offscreenImageCount; i++) {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = swapChainImageFormat;
+            imageInfo.extent = {swapChainExtent.width, swapChainExtent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;  // Draw, read back
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            offscreenImages[i] = allocator->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            swapChainsImages[i] = offscreenImages[i].image;
+        }
+    }
+
+    // An image view is quite literally a view into an image. It describes how to access the image and which part of the
+    // image to access.
+    void createImageViews() {
+        swapChainImageViews.resize(swapChainsImages.size());
+
+        for (size_t i = 0; i < swapChainsImages.size(); i++) {
+            VkImageViewCreateInfo createInfo{};
+            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            createInfo.image = swapChainsImages[i];
+
+            // Specify how the image should be interpreted
+            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            createInfo.format = swapChainImageFormat;
+
+            // Keep default color mappings
+            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+            // Describe what the image's purpose is and which part of the image should be accessed. Our images will be
+            // used as color targets without any mipmapping levels or multiple layers.
+            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            createInfo.subresourceRange.baseMipLevel = 0;
+            createInfo.subresourceRange.levelCount = 1;
+            createInfo.subresourceRange.baseArrayLayer = 0;
+            createInfo.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(device, &createInfo, nullptr, swapChainImageViews[i].put(device)) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create image views");
+            }
+        }
+    }
+
+    static std::vector<char> readFile(const std::string &filename) {
+        // 'ate' means to read at the end of the file so we can get the size ahead of time
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+        if (!file.is_open()) throw std::runtime_error("Failed to open file");
+
+        // Allocate buffer for file
+        size_t fileSize = (size_t)file.tellg();
+        std::vector<char> buffer(fileSize);
+
+        // Read in the file
+        file.seekg(0);  // go to the beginning
+        file.read(buffer.data(), fileSize);
+
+        file.close();
+        return buffer;
+    }
+
+    static std::string executableDirectory() {
+        std::string path;
+#ifdef _WIN32
+        char buffer[MAX_PATH];
+        DWORD length = GetModuleFileNameA(nullptr, buffer, MAX_PATH);
+        path.assign(buffer, length);
+#else
+        char buffer[4096];
+        ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer));
+        if (length > 0) path.assign(buffer, static_cast<size_t>(length));
+#endif
+        size_t separator = path.find_last_of("/\\");
+        return separator == std::string::npos ? std::string(".") : path.substr(0, separator);
+    }
+
+    void loadShaderBundle() {
+        if (!config.shaderBundlePath.empty()) {
+            shaderBundle = std::make_unique<ShaderBundle>(config.shaderBundlePath);
+            return;
+        }
+
+#ifdef VK_LEARNING_EMBEDDED_SHADERS
+        shaderBundle = std::make_unique<ShaderBundle>(embeddedShaderBundle, embeddedShaderBundleSize);
+#else
+        shaderBundle = std::make_unique<ShaderBundle>(executableDirectory() + "/" + DEFAULT_SHADER_BUNDLE_NAME);
+#endif
+    }
+
+    // The bundle and what the shaders declare. Nothing here needs the device
+    void loadShaders() {
+        loadShaderBundle();
+        vertReflection = reflectSpirv(shaderBundle->find("shader.vert"));
+        fragReflection = reflectSpirv(shaderBundle->find("shader.frag"));
+    }
+
+    // The code points straight into the bundle, which is already 4 byte aligned
+    UniqueShaderModule createShaderModule(std::span<const uint32_t> shaderCode) {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = shaderCode.size_bytes();
+        createInfo.pCode = shaderCode.data();
+
+        UniqueShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &createInfo, nullptr, shaderModule.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module");
+        }
+
+        return shaderModule;
+    }
+
+    // Both formats are known as soon as the device is, and neither changes when the swap chain is recreated. Picking
+    // them up front lets the render pass and the pipeline be built while the swap chain is still being created
+    void chooseAttachmentFormats() {
+        if (config.headless) {
+            swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;  // RGBA so read back frames can be written out directly
+        } else {
+            swapChainImageFormat = chooseSwapSurfaceFormat(deviceInfo.swapChainSupport.surfaceFormats).format;
+        }
+        depthFormat = findDepthFormat();
+    }
+
+    VkFormat findDepthFormat() {
+        // The HiZ pyramid is built by sampling the depth image
+        VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if (config.occlusionCulling) features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+        // Depth only; nothing uses stencil. D16 support is guaranteed, the others are preferred for their precision
+        for (VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM}) {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+            if ((properties.optimalTilingFeatures & features) == features) return format;
+        }
+
+        throw std::runtime_error("Failed to find a supported depth format");
+    }
+
+    // The frame as passes of a render graph: GPU culling and its count readback, the scene, and the HiZ pyramid. Each
+    // pass declares how it uses the swap chain image, the depth buffer and the culling buffers, and the graph works out
+    // the barriers between them (see RenderGraph.h). Queue ownership transfers of streamed textures stay outside, since
+    // they pair up with a release recorded on another queue.
+    //
+    // The depth image never leaves the GPU: it is cleared on load and its contents are discarded on store. On tiled
+    // GPUs it can then live entirely in tile memory, so it is a transient attachment, which the graph backs with lazily
+    // allocated memory when the device has any. Occlusion culling is the exception, it keeps the contents to build the
+    // HiZ pyramid from
+    void createRenderGraph() {
+        renderGraph = std::make_unique<RenderGraph>(device, *allocator);
+        RenderGraph &graph = *renderGraph;
+
+        // The acquire semaphore is waited for at the color attachment output stage, and presentation is ordered by the
+        // render finished semaphore, so that side needs no stage. Offscreen images are read back with a copy instead
+        ResourceState acquired{VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE,
+                               VK_IMAGE_LAYOUT_UNDEFINED};
+        ResourceState presented{VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+        if (config.headless) {
+            presented = {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        }
+        swapChainResource = graph.importImage("swap chain", VK_IMAGE_ASPECT_COLOR_BIT, acquired, presented);
+
+        TransientImageInfo depthInfo{};
+        depthInfo.format = depthFormat;
+        depthInfo.extent = swapChainExtent;
+        depthInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        depthInfo.usage |=
+            config.occlusionCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        depthInfo.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        uint32_t depth = graph.createImage("depth", depthInfo);
+
+        // The render pass path changes the attachment layouts itself, see createRenderPass()
+        bool renderPassLayouts = config.renderPath == RenderPath::RenderPass;
+        std::vector<RenderGraphAccess> drawAccesses = {
+            {swapChainResource,
+             {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+             renderPassLayouts ? renderPassColorFinalLayout() : VK_IMAGE_LAYOUT_UNDEFINED},
+            {depth,
+             {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+              VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL},
+             renderPassLayouts ? VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED},
+        };
+
+        uint32_t hizBuffer = UINT32_MAX;
+        if (config.cullMode == CullMode::Gpu) {
+            // Each frame slot has its own draw and count buffers, last used by the slot's previous draw. The pyramid is
+            // shared and last written by the previous frame's HiZ pass. It outlives the frame, so it counts as output
+            ResourceState indirectRead{VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT};
+            uint32_t drawBuffer = graph.importBuffer("draw buffer", indirectRead);
+            uint32_t countBuffer = graph.importBuffer(
+                "count buffer", {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
+                                 VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT});
+            uint32_t countReadback =
+                graph.importBuffer("count readback", {}, {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT});
+
+            std::vector<RenderGraphAccess> cullAccesses = {
+                {countBuffer,
+                 {VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT}},
+                {drawBuffer, {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT}},
+            };
+            if (config.occlusionCulling) {
+                hizBuffer = graph.importBuffer(
+                    "hiz", {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT});
+                graph.markOutput(hizBuffer);
+                cullAccesses.push_back(
+                    {hizBuffer, {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT}});
+            }
+
+            graph.addPass("cull", cullAccesses, [this](VkCommandBuffer commandBuffer) {
+                uint32_t region =
+                    gpuProfiler != nullptr ? gpuProfiler->begin(commandBuffer, currentFrame, "gpu cull") : UINT32_MAX;
+                gpuCuller->recordCull(commandBuffer, currentFrame, frameDescriptorSet, frameView);
+                if (gpuProfiler != nullptr) gpuProfiler->end(commandBuffer, currentFrame, region);
+            });
+            graph.addPass("cull readback",
+                          {{countBuffer, {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT}},
+                           {countReadback, {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT}}},
+                          [this](VkCommandBuffer commandBuffer) {
+                              gpuCuller->recordCountReadback(commandBuffer, currentFrame);
+                          });
+            drawAccesses.push_back({drawBuffer, indirectRead});
+            drawAccesses.push_back({countBuffer, indirectRead});
+        }
+
+        graph.addPass("draw", drawAccesses, [this](VkCommandBuffer commandBuffer) { recordScene(commandBuffer); });
+
+        // Runs every frame, also the ones that aren't captured or find no free buffer; those only pay for the layout
+        // transitions around it
+        if (!config.capturePath.empty()) {
+            uint32_t captureBuffer =
+                graph.importBuffer("capture buffer", {}, {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT});
+            graph.addPass("capture",
+                          {{swapChainResource,
+                            {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL}},
+                           {captureBuffer, {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT}}},
+                          [this](VkCommandBuffer commandBuffer) {
+                              frameCapture->recordCopy(commandBuffer, swapChainsImages[frameImageIndex],
+                                                       swapChainExtent, frameTimeline->lastSubmittedValue() + 1);
+                          });
+        }
+
+        // The next frame culls against this frame's depth
+        if (config.occlusionCulling) {
+            graph.addPass("hiz",
+                          {{depth,
+                            {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}},
+                           {hizBuffer,
+                            {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                             VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT}}},
+                          [this](VkCommandBuffer commandBuffer) {
+                              uint32_t region = gpuProfiler != nullptr
+                                                    ? gpuProfiler->begin(commandBuffer, currentFrame, "gpu hiz")
+                                                    : UINT32_MAX;
+                              gpuCuller->recordPyramid(commandBuffer, frameDescriptorSet, frameView);
+                              if (gpuProfiler != nullptr) gpuProfiler->end(commandBuffer, currentFrame, region);
+                          });
+        }
+
+        graph.compile();
+        depthImageView = graph.imageView(depth);
+    }
+
+    // Offscreen images are only ever read back after rendering, so the render pass leaves them ready for a copy
+    // instead. The capture pass copies within the frame though, and the transition at the end of the render pass isn't
+    // ordered against that copy, so when capturing the image stays an attachment and the render graph moves it on
+    VkImageLayout renderPassColorFinalLayout() const {
+        if (!config.capturePath.empty()) return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        return config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+
+    void createRenderPass() {
+        if (config.renderPath == RenderPath::Dynamic) return;  // Described at record time instead
+
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = renderPassColorFinalLayout();
+
+        // Cleared on load and thrown away on store, see createRenderGraph()
+        VkAttachmentDescription depthAttachment{};
+        depthAttachment.format = depthFormat;
+        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference colorAttachmentRef{};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthAttachmentRef{};
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        // The depth image is shared between frames in flight, so its clear also has to wait for the depth tests of
+        // the previous frame, early or late depending on the shader. The render graph orders the attachments against
+        // its other passes, but the layout transitions happen inside the render pass and are only covered by this
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                  VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                  VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment};
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(std::size(attachments));
+        renderPassInfo.pAttachments = attachments;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, renderPass.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create render pass");
+        }
+    }
+
+    // A pipeline cache blob starts with a VkPipelineCacheHeaderVersionOne. The driver is supposed to reject blobs from
+    // a different device or driver itself, but not all of them do so reliably, so check before handing it over
+    bool isPipelineCacheCompatible(const std::vector<char> &cacheData) {
+        VkPipelineCacheHeaderVersionOne header;
+        if (cacheData.size() < sizeof(header)) return false;
+        std::memcpy(&header, cacheData.data(), sizeof(header));  // The blob has no alignment guarantees
+
+        const VkPhysicalDeviceProperties &deviceProperties = deviceInfo.properties;
+        return header.headerSize >= sizeof(header) && header.headerSize <= cacheData.size() &&
+               header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == deviceProperties.vendorID && header.deviceID == deviceProperties.deviceID &&
+               std::memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    // Only file I/O, so it can run before there is a device to check the blob against
+    std::vector<char> readPipelineCacheFile() {
+        if (!config.usePipelineCache) return {};
+
+        try {
+            return readFile(config.pipelineCachePath);
+        } catch (const std::runtime_error &) {
+            return {};  // No cache yet, e.g. the first run
+        }
+    }
+
+    void createPipelineCache(std::vector<char> cacheData) {
+        if (!config.usePipelineCache) return;
+
+        if (!cacheData.empty() && !isPipelineCacheCompatible(cacheData)) {
+            std::cout << "Ignoring stale or corrupt pipeline cache " << config.pipelineCachePath << "\n";
+            cacheData.clear();
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = cacheData.size();
+        cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+        VkPipelineCache cache;
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+            // The header looked right but the driver still didn't like the contents; fall back to an empty cache
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = nullptr;
+            if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create pipeline cache");
+            }
+            cacheData.clear();
+        }
+        pipelineCache = UniquePipelineCache(device, cache);
+
+        pipelineCacheWarm = !cacheData.empty();
+    }
+
+    void savePipelineCache() {
+        if (pipelineCache == VK_NULL_HANDLE) return;
+
+        size_t dataSize = 0;
+        vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+        std::vector<char> cacheData(dataSize);
+        if (dataSize == 0 || vkGetPipelineCacheData(device, pipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS) {
+            std::cerr << "Failed to read back pipeline cache data\n";
+            return;
+        }
+
+        // Write next to the real file and swap it in, so a crash mid-write can't leave a truncated cache behind
+        std::string tempPath = config.pipelineCachePath + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                std::cerr << "Failed to write pipeline cache " << tempPath << "\n";
+                return;
+            }
+            file.write(cacheData.data(), static_cast<std::streamsize>(dataSize));
+        }
+        // Unlike std::rename, this replaces an existing file on Windows too, so the old cache is never removed first
+        std::error_code error;
+        std::filesystem::rename(tempPath, config.pipelineCachePath, error);
+        if (error) {
+            std::cerr << "Failed to write pipeline cache " << config.pipelineCachePath << "\n";
+            std::filesystem::remove(tempPath, error);
+        }
+    }
+
+    // Both modes need runtime sized, partially bound descriptor arrays in the shaders; bindless additionally needs to
+    // update the heap while frames using it are in flight
+    void createDescriptorHeap() {
+        if (!enabledVulkan12Features.runtimeDescriptorArray ||
+            !enabledVulkan12Features.descriptorBindingPartiallyBound ||
+            !enabledDeviceFeatures.shaderSampledImageArrayDynamicIndexing ||
+            !enabledDeviceFeatures.shaderStorageBufferArrayDynamicIndexing) {
+            throw std::runtime_error("Descriptor indexing is not supported by this device");
+        }
+
+        VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+        vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &vulkan12Properties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        const VkPhysicalDeviceLimits &limits = properties2.properties.limits;
+
+        // A combined image sampler counts as both a sampler and a sampled image, and as the heap is visible to every
+        // stage each array counts against the per-stage limits as well as the per-set ones. Both arrays together
+        // also count against the per-stage resource limit, which the rest of the pipeline layout shares
+        uint32_t textureCapacity = DEFAULT_DESCRIPTOR_HEAP_TEXTURES;
+        uint32_t bufferCapacity = DEFAULT_DESCRIPTOR_HEAP_BUFFERS;
+        auto clampCapacities = [&](std::initializer_list<uint32_t> textureLimits,
+                                   std::initializer_list<uint32_t> bufferLimits, uint32_t resourceLimit) {
+            textureCapacity = std::min({textureCapacity, std::min(textureLimits)});
+            bufferCapacity = std::min({bufferCapacity, std::min(bufferLimits)});
+            resourceLimit -= std::min(resourceLimit, DESCRIPTOR_HEAP_RESERVED_RESOURCES);
+            bufferCapacity = std::min(bufferCapacity, resourceLimit / 2);  // Textures get the larger share
+            textureCapacity = std::min(textureCapacity, resourceLimit - bufferCapacity);
+        };
+
+        if (config.descriptorMode == DescriptorMode::Bindless) {
+            bool bindlessSupported = enabledVulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+                                     enabledVulkan12Features.descriptorBindingStorageBufferUpdateAfterBind &&
+                                     enabledVulkan12Features.descriptorBindingUpdateUnusedWhilePending;
+            if (bindlessSupported) {
+                clampCapacities({vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers,
+                                 vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                 vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                 vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages},
+                                {vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                 vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers},
+                                vulkan12Properties.maxPerStageUpdateAfterBindResources);
+                // Bindless is only worth it when the whole heap fits, the pooled limits are good enough otherwise
+                bindlessSupported = textureCapacity == DEFAULT_DESCRIPTOR_HEAP_TEXTURES &&
+                                    bufferCapacity == DEFAULT_DESCRIPTOR_HEAP_BUFFERS;
+            }
+            if (!bindlessSupported) {
+                std::cout << "Bindless descriptors are not supported by this device, falling back to pooled\n";
+                config.descriptorMode = DescriptorMode::Pooled;
+                textureCapacity = DEFAULT_DESCRIPTOR_HEAP_TEXTURES;
+                bufferCapacity = DEFAULT_DESCRIPTOR_HEAP_BUFFERS;
+            }
+        }
+
+        // Without update after bind the heap is bound by the regular, much lower, limits
+        if (config.descriptorMode == DescriptorMode::Pooled) {
+            clampCapacities({limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages,
+                             limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages},
+                            {limits.maxDescriptorSetStorageBuffers, limits.maxPerStageDescriptorStorageBuffers},
+                            limits.maxPerStageResources);
+        }
+        if (textureCapacity == 0 || bufferCapacity == 0) {
+            throw std::runtime_error("The descriptor heap does not fit the limits of this device");
+        }
+
+        descriptorHeap = std::make_unique<DescriptorHeap>(device, config.framesInFlight, textureCapacity,
+                                                          bufferCapacity,
+                                                          config.descriptorMode == DescriptorMode::Bindless);
+    }
+
+    // Needs loadShaders() to have run
+    void createGraphicsPipeline() {
+        auto start = std::chrono::steady_clock::now();
+
+        // Kept for the lifetime of the application so more pipeline variants can be built from them later
+        vertShaderModule = createShaderModule(shaderBundle->find("shader.vert"));
+        fragShaderModule = createShaderModule(shaderBundle->find("shader.frag"));
+
+        createPipelineLayout();
+        vertexAttributes = buildVertexAttributes();
+
+        graphicsPipeline = UniquePipeline(device, buildPipeline(defaultPipelineVariant(), pipelineCache));
+
+        // Cold start latency is dominated by this step, so make the effect of the cache visible
+        auto end = std::chrono::steady_clock::now();
+        const char *cacheState = pipelineCache == VK_NULL_HANDLE ? "no cache" : pipelineCacheWarm ? "warm" : "cold";
+        std::cout << "Time to pipeline: " << std::chrono::duration<double, std::milli>(end - start).count() << " ms ("
+                  << cacheState << " pipeline cache)\n";
+    }
+
+    // One descriptor set layout per set number the shaders use, with empty layouts filling any gaps since set numbers
+    // index straight into pSetLayouts, and a single push constant range covering the blocks of every stage. The
+    // descriptor heap's set is always there, whether the shaders use it or not, and is checked rather than built
+    void createPipelineLayout() {
+        std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets(DESCRIPTOR_HEAP_SET + 1);
+        VkPushConstantRange pushConstantRange{};
+        uint32_t pushConstantEnd = 0;
+
+        for (const ShaderReflection *reflection : {&vertReflection, &fragReflection}) {
+            for (auto &binding : reflection->descriptorBindings) {
+                if (binding.set == DESCRIPTOR_HEAP_SET) {
+                    bool isHeapBinding = (binding.binding == DESCRIPTOR_HEAP_TEXTURE_BINDING &&
+                                          binding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) ||
+                                         (binding.binding == DESCRIPTOR_HEAP_BUFFER_BINDING &&
+                                          binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+                    if (!isHeapBinding || binding.descriptorCount != 0) {
+                        throw std::runtime_error("Descriptor does not match the descriptor heap: " + binding.name);
+                    }
+                    continue;
+                }
+                if (binding.descriptorCount == 0) {
+                    throw std::runtime_error("Runtime sized descriptor arrays are not supported: " + binding.name);
+                }
+                if (binding.set >= sets.size()) sets.resize(binding.set + 1);
+                auto &bindings = sets[binding.set];
+
+                // The same binding used by both stages
+                auto existing = std::find_if(bindings.begin(), bindings.end(),
+                                             [&](auto &other) { return other.binding == binding.binding; });
+                if (existing != bindings.end()) {
+                    if (existing->descriptorType != binding.descriptorType ||
+                        existing->descriptorCount != binding.descriptorCount) {
+                        throw std::runtime_error("Shader stages disagree about descriptor " + binding.name);
+                    }
+                    existing->stageFlags |= reflection->stage;
+                    continue;
+                }
+
+                VkDescriptorSetLayoutBinding layoutBinding{};
+                layoutBinding.binding = binding.binding;
+                layoutBinding.descriptorType = binding.descriptorType;
+                layoutBinding.descriptorCount = binding.descriptorCount;
+                layoutBinding.stageFlags = reflection->stage;
+                bindings.push_back(layoutBinding);
+            }
+
+            if (reflection->pushConstantSize > 0) {
+                uint32_t end = reflection->pushConstantOffset + reflection->pushConstantSize;
+                pushConstantRange.offset = pushConstantRange.stageFlags == 0
+                                               ? reflection->pushConstantOffset
+                                               : std::min(pushConstantRange.offset, reflection->pushConstantOffset);
+                pushConstantEnd = std::max(pushConstantEnd, end);
+                pushConstantRange.stageFlags |= reflection->stage;
+            }
+        }
+        pushConstantRange.size = pushConstantEnd - pushConstantRange.offset;
+        pushConstantStages = pushConstantRange.stageFlags;
+        if (pushConstantRange.stageFlags != 0 &&
+            (pushConstantRange.offset != 0 || pushConstantRange.size != sizeof(DrawConstants))) {
+            throw std::runtime_error("Push constant blocks in the shaders don't match DrawConstants");
+        }
+
+        for (uint32_t set = 0; set < sets.size(); set++) {
+            if (set == DESCRIPTOR_HEAP_SET) {
+                descriptorSetLayouts.push_back(descriptorHeap->layout());
+                continue;
+            }
+
+            auto &bindings = sets[set];
+            VkDescriptorSetLayoutCreateInfo layoutInfo{};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+            layoutInfo.pBindings = bindings.data();
+
+            UniqueDescriptorSetLayout layout;
+            if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, layout.put(device)) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create descriptor set layout");
+            }
+            descriptorSetLayouts.push_back(layout);
+            ownedSetLayouts.push_back(std::move(layout));
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = pushConstantRange.stageFlags == 0 ? 0 : 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, pipelineLayout.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout");
+        }
+    }
+
+    // Attributes for every input of the vertex shader. Which binding an input reads from is decided by its location
+    // (see INSTANCE_FIRST_LOCATION) and within a binding they are packed in location order, so the packed size has to
+    // match the struct the binding steps through or the shader and Mesh.h have drifted apart
+    std::vector<VkVertexInputAttributeDescription> buildVertexAttributes() {
+        VkVertexInputBindingDescription bindings[] = {Vertex::getBindingDescription(),
+                                                      InstanceData::getBindingDescription()};
+        uint32_t offsets[] = {0, 0};
+
+        std::vector<VkVertexInputAttributeDescription> attributes;
+        for (auto &input : vertReflection.vertexInputs) {
+            uint32_t binding = input.location < INSTANCE_FIRST_LOCATION ? 0 : 1;
+
+            VkVertexInputAttributeDescription attribute{};
+            attribute.location = input.location;
+            attribute.binding = bindings[binding].binding;
+            attribute.format = input.format;
+            attribute.offset = offsets[binding];
+            attributes.push_back(attribute);
+
+            offsets[binding] += vertexFormatSize(input.format);
+        }
+
+        if (offsets[0] != bindings[0].stride || offsets[1] != bindings[1].stride) {
+            throw std::runtime_error("shader.vert inputs do not match the layout of Vertex and InstanceData");
+        }
+
+        return attributes;
+    }
+
+    // Sets a specialization constant by the name it has in the shaders
+    void specialize(PipelineVariant &variant, const std::string &name, uint32_t value) const {
+        for (const ShaderReflection *reflection : {&vertReflection, &fragReflection}) {
+            for (auto &constant : reflection->specializationConstants) {
+                if (constant.name != name) continue;
+                if (constant.constantId >= MAX_SPECIALIZATION_CONSTANTS) {
+                    throw std::runtime_error("Specialization constant id out of range: " + name);
+                }
+
+                variant.specializationMask |= 1u << constant.constantId;
+                variant.specializationValues[constant.constantId] = value;
+                return;
+            }
+        }
+
+        throw std::runtime_error("No specialization constant named " + name);
+    }
+
+    // The variant the scene is drawn with. It is built at startup, so with a warm pipeline cache its specialized
+    // shaders come straight from disk
+    PipelineVariant defaultPipelineVariant() const {
+        PipelineVariant variant;
+        if (config.opacity < 1.0f) {
+            variant.blendMode = BlendMode::Alpha;
+            specialize(variant, "OPACITY", std::bit_cast<uint32_t>(config.opacity));
+        }
+        return variant;
+    }
+
+    // Map entries for the constants of one stage that the variant specializes. The data is the variant's value array
+    static std::vector<VkSpecializationMapEntry> specializationEntries(const ShaderReflection &reflection,
+                                                                       const PipelineVariant &variant) {
+        std::vector<VkSpecializationMapEntry> entries;
+        for (auto &constant : reflection.specializationConstants) {
+            uint32_t id = constant.constantId;
+            if (id >= MAX_SPECIALIZATION_CONSTANTS || (variant.specializationMask & (1u << id)) == 0) continue;
+            entries.push_back({id, static_cast<uint32_t>(id * sizeof(uint32_t)), sizeof(uint32_t)});
+        }
+        return entries;
+    }
+
+    VkPipeline buildPipeline(const PipelineVariant &variant, VkPipelineCache cache) {
+        return buildPipeline(variant, cache, vertShaderModule, fragShaderModule);
+    }
+
+    // Only touches state that is immutable after initVulkan(), so it is safe to call from several threads at once. Hot
+    // reload passes in the modules it just compiled, which must have the same interface as the current ones
+    VkPipeline buildPipeline(const PipelineVariant &variant, VkPipelineCache cache, VkShaderModule vertModule,
+                             VkShaderModule fragModule) {
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertModule;
+        vertShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragModule;
+        fragShaderStageInfo.pName = "main";
+
+        // Both stages read their values out of the variant, indexed by constant_id
+        auto vertSpecializationEntries = specializationEntries(vertReflection, variant);
+        auto fragSpecializationEntries = specializationEntries(fragReflection, variant);
+        VkSpecializationInfo vertSpecialization{static_cast<uint32_t>(vertSpecializationEntries.size()),
+                                                vertSpecializationEntries.data(),
+                                                sizeof(variant.specializationValues),
+                                                variant.specializationValues.data()};
+        VkSpecializationInfo fragSpecialization{static_cast<uint32_t>(fragSpecializationEntries.size()),
+                                                fragSpecializationEntries.data(),
+                                                sizeof(variant.specializationValues),
+                                                variant.specializationValues.data()};
+        if (!vertSpecializationEntries.empty()) vertShaderStageInfo.pSpecializationInfo = &vertSpecialization;
+        if (!fragSpecializationEntries.empty()) fragShaderStageInfo.pSpecializationInfo = &fragSpecialization;
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+
+        // describes the format of the vertex data that will be passed to the vertex shader
+        VkVertexInputBindingDescription bindingDescriptions[] = {Vertex::getBindingDescription(),
+                                                                 InstanceData::getBindingDescription()};
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(std::size(bindingDescriptions));
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributes.size());
+        vertexInputInfo.pVertexAttributeDescriptions = vertexAttributes.data();
+
+        // describes two things: what kind of geometry will be drawn from the vertices and if primitive restart should
+        // be enabled
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = variant.topology;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        // The viewport and scissor themselves are dynamic and set in recordCommandBuffer()
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = variant.polygonMode;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = variant.cullMode;
+        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+        rasterizer.depthBiasConstantFactor = 0.0f;  // Optional
+        rasterizer.depthBiasClamp = 0.0f;           // Optional
+        rasterizer.depthBiasSlopeFactor = 0.0f;     // Optional
+
+        // configures multisampling, which is one of the ways to perform antialiasing -- disabled for now
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;           // Optional
+        multisampling.pSampleMask = nullptr;             // Optional
+        multisampling.alphaToCoverageEnable = VK_FALSE;  // Optional
+        multisampling.alphaToOneEnable = VK_FALSE;       // Optional
+
+        // Blended objects are tested against the depth buffer but don't occlude anything themselves
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = variant.blendMode == BlendMode::Opaque ? VK_TRUE : VK_FALSE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = variant.blendMode == BlendMode::Opaque ? VK_FALSE : VK_TRUE;
+        colorBlendAttachment.srcColorBlendFactor =
+            variant.blendMode == BlendMode::Alpha ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstColorBlendFactor = variant.blendMode == BlendMode::Alpha
+                                                       ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA
+                                                   : variant.blendMode == BlendMode::Additive ? VK_BLEND_FACTOR_ONE
+                                                                                              : VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstAlphaBlendFactor =
+            variant.blendMode == BlendMode::Opaque ? VK_BLEND_FACTOR_ZERO : VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;  // Optional
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+        colorBlending.blendConstants[0] = 0.0f;  // Optional
+        colorBlending.blendConstants[1] = 0.0f;  // Optional
+        colorBlending.blendConstants[2] = 0.0f;  // Optional
+        colorBlending.blendConstants[3] = 0.0f;  // Optional
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        // With dynamic rendering there is no render pass to take the attachment formats from
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+        if (config.renderPath == RenderPath::Dynamic) pipelineInfo.pNext = &renderingInfo;
+
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;  // Optional
+        pipelineInfo.basePipelineIndex = -1;               // Optional
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create graphics pipeline");
+        }
+
+        return pipeline;
+    }
+
+    // Every combination of the fixed function state we care about. Point topologies and point polygon mode are left
+    // out because our vertex shader doesn't write gl_PointSize
+    std::vector<PipelineVariant> enumeratePipelineVariants() {
+        std::vector<PipelineVariant> variants;
+
+        std::vector<VkPolygonMode> polygonModes = {VK_POLYGON_MODE_FILL};
+        if (enabledDeviceFeatures.fillModeNonSolid) polygonModes.push_back(VK_POLYGON_MODE_LINE);
+
+        for (auto topology : {VK_PRIMITIVE_TOPOLOGY_LINE_LIST, VK_PRIMITIVE_TOPOLOGY_LINE_STRIP,
+                              VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP}) {
+            for (auto polygonMode : polygonModes) {
+                for (auto cullMode : {VK_CULL_MODE_NONE, VK_CULL_MODE_FRONT_BIT, VK_CULL_MODE_BACK_BIT,
+                                      VK_CULL_MODE_FRONT_AND_BACK}) {
+                    for (auto blendMode : {BlendMode::Opaque, BlendMode::Alpha, BlendMode::Additive}) {
+                        variants.push_back({topology, polygonMode, cullMode, blendMode});
+                    }
+                }
+            }
+        }
+
+        return variants;
+    }
+
+    // Builds every variant with 1, 2, 4, ... threads. Each run gets its own empty pipeline cache, otherwise every run
+    // after the first would just be measuring cache hits
+    void benchmarkPipelineCompilation() {
+        auto variants = enumeratePipelineVariants();
+        uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::cout << "Compiling " << variants.size() << " pipeline variants\n";
+        std::cout << "threads\ttime (ms)\tvariants/s\n";
+
+        for (uint32_t threadCount = 1;; threadCount = std::min(threadCount * 2, maxThreads)) {
+            VkPipelineCacheCreateInfo cacheInfo{};
+            cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+            UniquePipelineCache benchmarkCache;
+            if (vkCreatePipelineCache(device, &cacheInfo, nullptr, benchmarkCache.put(device)) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create pipeline cache");
+            }
+
+            double milliseconds;
+            {
+                PipelineCompiler compiler(
+                    device, [this, cache = benchmarkCache.get()](const PipelineVariant &variant) {
+                        return buildPipeline(variant, cache);
+                    },
+                    threadCount);
+
+                auto start = std::chrono::steady_clock::now();
+                for (const auto &variant : variants) compiler.request(variant);
+                compiler.waitAll();
+                auto end = std::chrono::steady_clock::now();
+
+                milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+            }  // Destroys the pipelines, and the cache goes at the end of the iteration
+
+            std::cout << threadCount << "\t" << milliseconds << "\t" << variants.size() / (milliseconds / 1000.0)
+                      << "\n";
+
+            if (threadCount == maxThreads) break;
+        }
+    }
+
+    void createShaderWatcher() {
+        shaderWatcher = std::make_unique<DirectoryWatcher>(config.shaderSourceDir);
+        shaderReloadThread = std::make_unique<ThreadPool>(1);
+        std::cout << "Watching " << config.shaderSourceDir << " for shader changes\n";
+    }
+
+    // Runs glslc on one of the watched sources. Compile errors go straight to the terminal. Every compile writes to a
+    // file of its own, so neither other instances nor overlapping reloads can swap the SPIR-V underneath it
+    std::vector<uint32_t> compileShaderSource(const std::string &name) {
+        std::filesystem::path source = std::filesystem::path(config.shaderSourceDir) / name;
+        std::filesystem::path output = uniqueTempPath(name + ".spv");
+
+        int exitCode =
+            runProcess({config.glslcPath, "--target-env=vulkan1.3", "-o", output.string(), source.string()});
+        std::vector<char> bytes;
+        if (exitCode == 0 && std::filesystem::exists(output)) bytes = readFile(output.string());
+        std::error_code error;
+        std::filesystem::remove(output, error);  // Also whatever a failed compile left behind
+        if (exitCode != 0) throw std::runtime_error("Failed to compile " + name);
+        if (bytes.empty() || bytes.size() % sizeof(uint32_t) != 0) throw std::runtime_error("Not a SPIR-V module");
+
+        std::vector<uint32_t> code(bytes.size() / sizeof(uint32_t));
+        std::memcpy(code.data(), bytes.data(), bytes.size());
+        return code;
+    }
+
+    // Worker thread. Only the stages whose sources changed are recompiled. A change to the interface (inputs,
+    // descriptors, push constants, specialization constants) would need a new pipeline layout and vertex input state,
+    // which every other pipeline shares, so that still needs a restart
+    ShaderReload reloadShaders(const std::set<std::string> &names) {
+        ShaderReload reload;  // Whatever was already created is destroyed with it if a later step throws
+        for (auto &name : names) {
+            std::vector<uint32_t> code = compileShaderSource(name);
+            bool vertex = name == "shader.vert";
+            if (!hasSameInterface(reflectSpirv(code), vertex ? vertReflection : fragReflection)) {
+                throw std::runtime_error(name + " changed its interface, restart to pick it up");
+            }
+            (vertex ? reload.vertShaderModule : reload.fragShaderModule) = createShaderModule(code);
+        }
+
+        VkPipeline pipeline =
+            buildPipeline(defaultPipelineVariant(), pipelineCache,
+                          reload.vertShaderModule != VK_NULL_HANDLE ? reload.vertShaderModule : vertShaderModule,
+                          reload.fragShaderModule != VK_NULL_HANDLE ? reload.fragShaderModule : fragShaderModule);
+        reload.pipeline = UniquePipeline(device, pipeline);
+
+        return reload;
+    }
+
+    // Called at the start of every frame and never blocks. Picks up a finished reload and starts the next one. There is
+    // at most one in flight; changes arriving meanwhile are batched into the next
+    void pollShaderReload() {
+        for (auto &name : shaderWatcher->poll()) {
+            if (name == "shader.vert" || name == "shader.frag") changedShaders.insert(name);
+        }
+
+        if (pendingShaderReload.valid()) {
+            if (pendingShaderReload.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+            try {
+                applyShaderReload(pendingShaderReload.get());
+            } catch (const std::exception &e) {
+                std::cerr << "Shader reload failed: " << e.what() << "\n";
+            }
+        }
+
+        if (!changedShaders.empty()) {
+            pendingShaderReload = shaderReloadThread->submit(
+                [this, names = std::move(changedShaders)] { return reloadShaders(names); });
+            changedShaders.clear();
+        }
+    }
+
+    // The old pipeline may still be used by frames in flight. The old modules are not, pipelines don't need the modules
+    // they were built from
+    void applyShaderReload(ShaderReload reload) {
+        deletionQueue.retire(frameTimeline->lastSubmittedValue(), std::move(graphicsPipeline));
+        graphicsPipeline = std::move(reload.pipeline);
+
+        if (reload.vertShaderModule != VK_NULL_HANDLE) vertShaderModule = std::move(reload.vertShaderModule);
+        if (reload.fragShaderModule != VK_NULL_HANDLE) fragShaderModule = std::move(reload.fragShaderModule);
+
+        std::cout << "Reloaded shaders\n";
+    }
+
+    // Lets a reload that is still compiling finish, and throws its result away
+    void stopShaderReload() {
+        if (pendingShaderReload.valid()) {
+            try {
+                pendingShaderReload.get();
+            } catch (const std::exception &) {
+                // The reload failed, so nothing was left behind
+            }
+        }
+        shaderReloadThread.reset();
+        shaderWatcher.reset();
+    }
+
+    void createFramebuffer() {
+        if (config.renderPath == RenderPath::Dynamic) return;  // Rendering goes straight to the image views
+
+        swapChainFramebuffers.resize(swapChainImageViews.size());
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            VkImageView attachments[] = {swapChainImageViews[i], depthImageView};
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = static_cast<uint32_t>(std::size(attachments));
+            framebufferInfo.pAttachments = attachments;
+            framebufferInfo.width = swapChainExtent.width;
+            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, swapChainFramebuffers[i].put(device)) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Failed to create framebuffer");
+            }
+        }
+    }
+
+    void createCommandPool() {
+        const QueueFamilyIndices &queueFamilyIndices = deviceInfo.queueFamilies;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool");
+        }
+    }
+
+    void createAllocator() {
+        allocator = std::make_unique<DeviceMemoryAllocator>(physicalDevice, device);
+
+        const QueueFamilyIndices &queueFamilyIndices = deviceInfo.queueFamilies;
+        stagingRing =
+            std::make_unique<StagingRing>(device, graphicsQueue, queueFamilyIndices.graphicsFamily.value(), *allocator,
+                                          DEFAULT_STAGING_RING_SIZE, sharedQueueMutex(graphicsQueue));
+    }
+
+    // Vertex and index data live in device local memory, which the CPU generally can't write to directly, so they are
+    // filled through the staging ring
+    void createMeshBuffers() {
+        Mesh mesh = generateTriangleGrid(config.triangleCount);
+
+        VkDeviceSize vertexBufferSize = sizeof(mesh.vertices[0]) * mesh.vertices.size();
+        vertexBuffer = allocator->createBuffer(vertexBufferSize,
+                                               VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        stagingRing->upload(mesh.vertices.data(), vertexBufferSize, vertexBuffer.buffer);
+
+        VkDeviceSize indexBufferSize = sizeof(mesh.indices[0]) * mesh.indices.size();
+        indexBuffer = allocator->createBuffer(indexBufferSize,
+                                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        stagingRing->upload(mesh.indices.data(), indexBufferSize, indexBuffer.buffer);
+        indexCount = static_cast<uint32_t>(mesh.indices.size());
+        meshBounds = computeMeshBounds(mesh);
+
+        stagingRing->flush();
+    }
+
+    bool isDrawModeSupported(DrawMode drawMode) const {
+        switch (drawMode) {
+            case DrawMode::Direct:
+            case DrawMode::Instanced:
+                return true;
+            case DrawMode::Indirect:
+                return enabledDeviceFeatures.drawIndirectFirstInstance;  // Every command picks its own instance
+            case DrawMode::IndirectCount:
+                // The whole list goes into one call, which without multiDrawIndirect could only draw a single object
+                return enabledDeviceFeatures.drawIndirectFirstInstance && enabledVulkan12Features.drawIndirectCount &&
+                       enabledDeviceFeatures.multiDrawIndirect;
+        }
+        return false;
+    }
+
+    // The scene never moves, so the draw list is put in order once, as it is uploaded. Instances and indirect commands
+    // are drawn in buffer order whatever the draw mode
+    std::vector<InstanceData> sortInstances(const std::vector<InstanceData> &instances) {
+        if (config.drawOrder == DrawOrder::Unsorted) return instances;
+
+        std::vector<uint64_t> keys(instances.size());
+        for (uint32_t i = 0; i < instances.size(); i++) {
+            float depth = instances[i].depth;
+            // Everything is drawn with the same pipeline for now
+            keys[i] = makeDrawSortKey(0, config.drawOrder == DrawOrder::FrontToBack ? depth : 1.0f - depth, i);
+        }
+
+        std::vector<uint64_t> scratch;
+        radixSortDrawKeys(keys, scratch);
+
+        std::vector<InstanceData> sorted(instances.size());
+        for (size_t i = 0; i < keys.size(); i++) sorted[i] = instances[drawSortKeyIndex(keys[i])];
+        return sorted;
+    }
+
+    // Per object data: the instance attributes and a ready made indirect command for every object, so every draw mode
+    // can be switched to without touching the GPU buffers
+    void createObjectBuffers(uint32_t count) {
+        objectCount = count;
+
+        std::vector<InstanceData> instances = sortInstances(generateInstanceGrid(objectCount, config.objectScale));
+        VkDeviceSize instanceBufferSize = sizeof(instances[0]) * instances.size();
+        instanceBuffer = allocator->createBuffer(instanceBufferSize,
+                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        stagingRing->upload(instances.data(), instanceBufferSize, instanceBuffer.buffer);
+
+        std::vector<VkDrawIndexedIndirectCommand> drawCommands(objectCount);
+        for (uint32_t i = 0; i < objectCount; i++) {
+            drawCommands[i].indexCount = indexCount;
+            drawCommands[i].instanceCount = 1;
+            drawCommands[i].firstIndex = 0;
+            drawCommands[i].vertexOffset = 0;
+            drawCommands[i].firstInstance = i;  // Selects this object's InstanceData
+        }
+        VkDeviceSize indirectBufferSize = sizeof(drawCommands[0]) * drawCommands.size();
+        indirectBuffer = allocator->createBuffer(
+            indirectBufferSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        stagingRing->upload(drawCommands.data(), indirectBufferSize, indirectBuffer.buffer);
+
+        indirectCountBuffer = allocator->createBuffer(
+            sizeof(uint32_t),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        stagingRing->upload(&objectCount, sizeof(objectCount), indirectCountBuffer.buffer);
+
+        stagingRing->flush();
+
+        if (config.cullMode == CullMode::None) return;
+        objectBounds = computeObjectBounds(meshBounds, instances);
+        if (config.cullMode == CullMode::Cpu) {
+            for (uint32_t i = 0; i < config.framesInFlight; i++) {
+                cpuCulledDrawBuffers.push_back(allocator->createBuffer(
+                    indirectBufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+            }
+        } else {
+            gpuCuller->setObjects(objectBounds, indirectBuffer.buffer, *stagingRing);
+            objectBounds.clear();  // Only the GPU needs them
+        }
+    }
+
+    // Culling draws with indirect commands, see CullMode. The GPU culler reads the bounding spheres, writes the
+    // surviving commands and clears their count with compute and transfer work on the graphics queue
+    void createCulling() {
+        if (config.cullMode == CullMode::None) return;
+        if (config.cullMode == CullMode::Cpu && !isDrawModeSupported(DrawMode::Indirect)) {
+            throw std::runtime_error("CPU culling needs indirect draws");
+        }
+        if (config.cullMode == CullMode::Cpu) return;
+
+        if (!isDrawModeSupported(DrawMode::IndirectCount)) {
+            throw std::runtime_error("GPU culling needs indirect count draws");
+        }
+        gpuCuller = std::make_unique<GpuCuller>(device, *allocator, *descriptorHeap, deletionQueue,
+                                                config.framesInFlight, *shaderBundle, pipelineCache,
+                                                config.occlusionCulling);
+        gpuCuller->setDepthBuffer(depthImageView, swapChainExtent);
+    }
+
+    // The materials are an ordinary storage buffer; the shaders find it through its element in the descriptor heap
+    void createMaterialBuffer() {
+        if (config.materialCount == 0) throw std::runtime_error("At least one material is required");
+
+        std::vector<Material> materials = generateMaterials(config.materialCount);
+        VkDeviceSize materialBufferSize = sizeof(materials[0]) * materials.size();
+        materialBuffer = allocator->createBuffer(materialBufferSize,
+                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        stagingRing->upload(materials.data(), materialBufferSize, materialBuffer.buffer);
+        stagingRing->flush();
+
+        drawConstants.materialBuffer = descriptorHeap->addBuffer(materialBuffer.buffer);
+        drawConstants.materialCount = config.materialCount;
+    }
+
+    // Textures are requested right away and show up over the following frames, see acquireStreamedTextures()
+    void createTextureStreamer() {
+        if (!enabledVulkan12Features.shaderSampledImageArrayNonUniformIndexing) {
+            throw std::runtime_error("Texture streaming needs non-uniform indexing of sampled image arrays");
+        }
+
+        textureStreamer = std::make_unique<TextureStreamer>(device, *allocator, transferQueue, transferFamily,
+                                                            deviceInfo.queueFamilies.graphicsFamily.value(),
+                                                            &transferQueueMutex, DEFAULT_TEXTURE_STAGING_SIZE,
+                                                            config.textureUploadBudget);
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, textureSampler.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create texture sampler");
+        }
+
+        textureSlots.assign(config.texturePaths.size(), NO_TEXTURE);
+        for (uint32_t i = 0; i < config.framesInFlight; i++) {
+            textureTables.push_back(allocator->createBuffer(
+                sizeof(uint32_t) * textureSlots.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+            textureTableSlots.push_back(descriptorHeap->addBuffer(textureTables.back().buffer));
+        }
+        drawConstants.textureCount = static_cast<uint32_t>(textureSlots.size());
+
+        for (auto &path : config.texturePaths) {
+            textureStreamer->request(path);
+        }
+    }
+
+    void destroyStreamedTextures() {
+        textureStreamer.reset();  // Stops the loader and waits for the copies still in flight
+        for (auto &texture : streamedTextures) {
+            vkDestroyImageView(device, texture.imageView, nullptr);
+            allocator->destroyImage(texture.image);
+        }
+        for (auto &table : textureTables) {
+            allocator->destroyBuffer(table);
+        }
+    }
+
+    // When the objects are replaced while running. Frames still in flight may be reading the old buffers
+    void retireObjectBuffers() {
+        uint64_t retireFrame = frameTimeline->lastSubmittedValue();
+        std::vector<Buffer> oldBuffers = {instanceBuffer, indirectBuffer, indirectCountBuffer};
+        oldBuffers.insert(oldBuffers.end(), cpuCulledDrawBuffers.begin(), cpuCulledDrawBuffers.end());
+        cpuCulledDrawBuffers.clear();
+        deletionQueue.push(retireFrame, [this, oldBuffers]() mutable {
+            for (auto &buffer : oldBuffers) allocator->destroyBuffer(buffer);
+        });
+        if (gpuCuller != nullptr) gpuCuller->retireObjects(retireFrame);
+    }
+
+    void destroyObjectBuffers() {
+        for (auto &buffer : cpuCulledDrawBuffers) {
+            allocator->destroyBuffer(buffer);
+        }
+        allocator->destroyBuffer(indirectCountBuffer);
+        allocator->destroyBuffer(indirectBuffer);
+        allocator->destroyBuffer(instanceBuffer);
+    }
+
+    void createCommandBuffers() {
+        commandBuffers.resize(config.framesInFlight);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers");
+        }
+
+        if (config.recordThreads > 0) {
+            const QueueFamilyIndices &queueFamilyIndices = deviceInfo.queueFamilies;
+            commandRecorder = std::make_unique<ParallelCommandRecorder>(
+                device, queueFamilyIndices.graphicsFamily.value(), config.framesInFlight, config.recordThreads);
+            recordThreadLimit = config.recordThreads;
+        }
+    }
+
+    // For one-off work outside of the frame loop, like reading an image back
+    VkCommandBuffer beginSingleTimeCommands() {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        return commandBuffer;
+    }
+
+    void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        auto queueLock = lockSharedQueue(graphicsQueue);
+        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(graphicsQueue);
+
+        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    }
+
+    // Copies a rendered offscreen image to host memory as tightly packed RGBA8 pixels
+    std::vector<uint8_t> readbackOffscreenImage(uint32_t imageIndex) {
+        frameTimeline->wait(imageFrameNumbers[imageIndex]);
+
+        VkDeviceSize size = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+
+        Buffer readbackBuffer =
+            allocator->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        // Both render paths leave offscreen images in TRANSFER_SRC_OPTIMAL, so no layout transition is needed
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;  // Tightly packed
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainsImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               readbackBuffer.buffer, 1, &region);
+
+        endSingleTimeCommands(commandBuffer);
+
+        std::vector<uint8_t> pixels(size);
+        std::memcpy(pixels.data(), readbackBuffer.allocation.mapped, size);  // Host visible memory stays mapped
+
+        allocator->destroyBuffer(readbackBuffer);
+
+        return pixels;
+    }
+
+    static void writePpm(const std::string &filename, const std::vector<uint8_t> &rgbaPixels, uint32_t width,
+                         uint32_t height) {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.is_open()) throw std::runtime_error("Failed to open file " + filename);
+
+        file << "P6\n" << width << " " << height << "\n255\n";
+        for (size_t i = 0; i < rgbaPixels.size(); i += 4) {
+            file.write(reinterpret_cast<const char *>(&rgbaPixels[i]), 3);  // PPM has no alpha channel
+        }
+    }
+
+    // Textures whose copies have finished become visible from this frame on: the graphics queue acquires them from the
+    // transfer family, they get an element in the descriptor heap and the frame's texture table points at it. The
+    // frame's submit waits on the streamer's timeline for them, see drawFrame()
+    void acquireStreamedTextures(VkCommandBuffer commandBuffer) {
+        std::vector<StreamedTexture> completed = textureStreamer->takeCompleted();
+        textureStreamer->recordAcquire(commandBuffer, completed);
+        for (auto &texture : completed) {
+            textureSlots[texture.id] = descriptorHeap->addTexture(texture.imageView, textureSampler);
+            textureWaitValue = std::max(textureWaitValue, texture.uploadValue);
+            streamedTextures.push_back(texture);
+        }
+
+        std::memcpy(textureTables[currentFrame].allocation.mapped, textureSlots.data(),
+                    sizeof(uint32_t) * textureSlots.size());
+        drawConstants.textureTable = textureTableSlots[currentFrame];
+    }
+
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = 0;                   // Optional
+        beginInfo.pInheritanceInfo = nullptr;  // Optional
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording command buffer");
+        }
+
+        if (textureStreamer != nullptr) acquireStreamedTextures(commandBuffer);
+        frameDescriptorSet = descriptorHeap->beginFrame(currentFrame);
+
+        uint32_t gpuFrameRegion = UINT32_MAX;
+        if (gpuProfiler != nullptr) {
+            gpuProfiler->beginFrame(commandBuffer, currentFrame);
+            gpuFrameRegion = gpuProfiler->begin(commandBuffer, currentFrame, "gpu frame");
+        }
+
+        CullView view = animatedView(config.viewZoom, frameTimeline->lastSubmittedValue() + 1);
+        drawConstants.viewOffset[0] = view.offset[0];
+        drawConstants.viewOffset[1] = view.offset[1];
+        drawConstants.viewScale = view.scale;
+        if (config.cullMode == CullMode::Cpu) cullOnCpu(view);
+
+        frameImageIndex = imageIndex;
+        frameView = view;
+        renderGraph->setImage(swapChainResource, swapChainsImages[imageIndex]);
+        renderGraph->execute(commandBuffer);
+
+        if (gpuProfiler != nullptr) gpuProfiler->end(commandBuffer, currentFrame, gpuFrameRegion);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer");
+        }
+    }
+
+    // The render graph's draw pass: every object, into the swap chain image and the depth buffer
+    void recordScene(VkCommandBuffer commandBuffer) {
+        uint32_t imageIndex = frameImageIndex;
+        uint32_t gpuRenderPassRegion = UINT32_MAX;
+        if (gpuProfiler != nullptr) {
+            gpuRenderPassRegion = gpuProfiler->begin(commandBuffer, currentFrame, "gpu render pass");
+        }
+
+        bool useSecondaries = commandRecorder != nullptr && recordThreadLimit > 0;
+        if (overdrawCounter != nullptr) overdrawCounter->begin(commandBuffer, currentFrame);
+
+        if (config.renderPath == RenderPath::Dynamic) {
+            beginDynamicRendering(commandBuffer, imageIndex, useSecondaries);
+        } else {
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = renderPass;
+            renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = swapChainExtent;
+
+            VkClearValue clearValues[2] = {};
+            clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+            clearValues[1].depthStencil = {1.0f, 0};
+            renderPassInfo.clearValueCount = static_cast<uint32_t>(std::size(clearValues));
+            renderPassInfo.pClearValues = clearValues;
+
+            // With secondaries the subpass contents come entirely from the command buffers recorded on the workers
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                                 useSecondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                                                : VK_SUBPASS_CONTENTS_INLINE);
+        }
+
+        if (useSecondaries) {
+            // Dynamic rendering has no render pass or framebuffer to inherit, only the attachment formats
+            VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{};
+            inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+            inheritanceRenderingInfo.colorAttachmentCount = 1;
+            inheritanceRenderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+            inheritanceRenderingInfo.depthAttachmentFormat = depthFormat;
+            inheritanceRenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+            VkCommandBufferInheritanceInfo inheritanceInfo{};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            if (overdrawCounter != nullptr) {
+                inheritanceInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+            }
+            if (config.renderPath == RenderPath::Dynamic) {
+                inheritanceInfo.pNext = &inheritanceRenderingInfo;
+            } else {
+                inheritanceInfo.renderPass = renderPass;
+                inheritanceInfo.subpass = 0;
+                inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            }
+
+            // Only per object draws can be split; the other modes are a handful of commands whatever the object count.
+            // So is a culled list, whose length is only known once it has been culled
+            bool splittable = config.cullMode == CullMode::None &&
+                              (config.drawMode == DrawMode::Direct || config.drawMode == DrawMode::Indirect);
+            std::vector<VkCommandBuffer> secondaries = commandRecorder->record(
+                currentFrame, inheritanceInfo, objectCount, splittable ? recordThreadLimit : 1,
+                [this](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+                    recordPassState(secondary);  // Secondaries inherit no state besides the attachments
+                    recordDraws(secondary, first, count);
+                });
+
+            vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+        } else {
+            recordPassState(commandBuffer);
+            recordDraws(commandBuffer, 0, objectCount);
+        }
+
+        if (config.renderPath == RenderPath::Dynamic) {
+            vkCmdEndRendering(commandBuffer);
+        } else {
+            vkCmdEndRenderPass(commandBuffer);
+        }
+
+        if (overdrawCounter != nullptr) overdrawCounter->end(commandBuffer, currentFrame);
+        if (gpuProfiler != nullptr) gpuProfiler->end(commandBuffer, currentFrame, gpuRenderPassRegion);
+    }
+
+    // The render graph has the images in their attachment layouts by now, and takes them on from there afterwards
+    void beginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool useSecondaries) {
+        VkRenderingAttachmentInfo colorAttachment{};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        colorAttachment.imageView = swapChainImageViews[imageIndex];
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.clearValue = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+
+        VkRenderingAttachmentInfo depthAttachment{};
+        depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        depthAttachment.imageView = depthImageView;
+        depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp =
+            config.occlusionCulling ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.clearValue.depthStencil = {1.0f, 0};
+
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.flags = useSecondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+        renderingInfo.renderArea.offset = {0, 0};
+        renderingInfo.renderArea.extent = swapChainExtent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+        renderingInfo.pDepthAttachment = &depthAttachment;
+
+        vkCmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+
+
+    // Pipeline, descriptors, dynamic state and geometry shared by every draw
+    void recordPassState(VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+        // The only set ever bound. Everything else a draw needs is an index into it
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DESCRIPTOR_HEAP_SET, 1,
+                                &frameDescriptorSet, 0, nullptr);
+        if (pushConstantStages != 0) {
+            vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, 0, sizeof(drawConstants),
+                               &drawConstants);
+        }
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(swapChainExtent.width);
+        viewport.height = static_cast<float>(swapChainExtent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = swapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        VkBuffer vertexBuffers[] = {vertexBuffer.buffer, instanceBuffer.buffer};
+        VkDeviceSize offsets[] = {0, 0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    }
+
+    // The frame slot has been waited for, so the GPU is done with what the frame's buffer held before
+    void cullOnCpu(const CullView &view) {
+        ProfileScope scope(profiler.get(), "cpu cull");
+
+        auto *commands =
+            static_cast<VkDrawIndexedIndirectCommand *>(cpuCulledDrawBuffers[currentFrame].allocation.mapped);
+        uint32_t visibleCount = 0;
+        for (uint32_t i = 0; i < objectCount; i++) {
+            if (isInView(objectBounds[i], view)) commands[visibleCount++] = {indexCount, 1, 0, 0, i};
+        }
+        cpuVisibleCount = visibleCount;
+    }
+
+    // Draws objects [firstObject, firstObject + count). With culling it is always the whole list
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstObject, uint32_t count) {
+        const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        uint32_t endObject = firstObject + count;
+
+        if (config.cullMode == CullMode::Cpu) {
+            VkBuffer culledBuffer = cpuCulledDrawBuffers[currentFrame].buffer;
+            for (uint32_t first = 0; first < cpuVisibleCount; first += maxDrawIndirectCount) {
+                uint32_t drawCount = std::min(maxDrawIndirectCount, cpuVisibleCount - first);
+                vkCmdDrawIndexedIndirect(commandBuffer, culledBuffer, first * stride, drawCount, stride);
+            }
+            return;
+        }
+        if (config.cullMode == CullMode::Gpu) {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, gpuCuller->drawBuffer(currentFrame), 0,
+                                          gpuCuller->countBuffer(currentFrame), 0,
+                                          std::min(objectCount, maxDrawIndirectCount), stride);
+            return;
+        }
+
+        switch (config.drawMode) {
+            case DrawMode::Direct:
+                for (uint32_t i = firstObject; i < endObject; i++) {
+                    vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, i);
+                }
+                break;
+            case DrawMode::Instanced:
+                vkCmdDrawIndexed(commandBuffer, indexCount, count, 0, 0, firstObject);
+                break;
+            case DrawMode::Indirect:
+                // Without multiDrawIndirect every indirect call is limited to a single command
+                for (uint32_t first = firstObject; first < endObject; first += maxDrawIndirectCount) {
+                    uint32_t drawCount = std::min(maxDrawIndirectCount, endObject - first);
+                    vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer.buffer, first * stride, drawCount, stride);
+                }
+                break;
+            case DrawMode::IndirectCount:
+                // The count buffer always covers the whole list, so this mode is never split
+                vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer.buffer, 0, indirectCountBuffer.buffer, 0,
+                                              std::min(objectCount, maxDrawIndirectCount), stride);
+                break;
+        }
+    }
+
+    void createProfiler() {
+        profiler = std::make_unique<Profiler>(std::max<size_t>(DEFAULT_PROFILE_WINDOW, config.frameCount));
+
+        try {
+            const QueueFamilyIndices &queueFamilyIndices = deviceInfo.queueFamilies;
+            gpuProfiler = std::make_unique<GpuProfiler>(
+                physicalDevice, device, queueFamilyIndices.graphicsFamily.value(), config.framesInFlight, *profiler);
+        } catch (const std::exception &e) {
+            std::cout << "GPU timestamps disabled: " << e.what() << "\n";  // CPU spans still work
+        }
+    }
+
+    void createOverdrawCounter() {
+        if (!enabledDeviceFeatures.pipelineStatisticsQuery) {
+            throw std::runtime_error("Counting overdraw needs pipeline statistics queries");
+        }
+        if (config.recordThreads > 0 && !enabledDeviceFeatures.inheritedQueries) {
+            throw std::runtime_error("Counting overdraw with secondary command buffers needs inherited queries");
+        }
+        overdrawCounter = std::make_unique<OverdrawCounter>(device, config.framesInFlight);
+    }
+
+    // Fragments shaded per pixel of the render target, averaged over every frame since the last call
+    double collectFragmentsPerPixel() {
+        waitDeviceIdle();
+        overdrawCounter->collectAll();
+        double fragmentsPerPixel = overdrawCounter->fragmentsPerFrame() /
+                                   (static_cast<double>(swapChainExtent.width) * swapChainExtent.height);
+        overdrawCounter->reset();
+        return fragmentsPerPixel;
+    }
+
+    // How many objects were left after culling in the last frame recorded, once the device is idle
+    uint32_t lastObjectsDrawn() const {
+        switch (config.cullMode) {
+            case CullMode::None:
+                return objectCount;
+            case CullMode::Cpu:
+                return cpuVisibleCount;
+            case CullMode::Gpu:
+                return gpuCuller->drawnCount((currentFrame + config.framesInFlight - 1) % config.framesInFlight);
+        }
+        return 0;
+    }
+
+    // The monitor's refresh rate tells the pacer how far apart vblanks are
+    void createFramePacer() {
+        double refreshRate = DEFAULT_REFRESH_RATE;
+        if (GLFWmonitor *monitor = glfwGetPrimaryMonitor(); monitor != nullptr) {
+            const GLFWvidmode *mode = glfwGetVideoMode(monitor);
+            if (mode != nullptr && mode->refreshRate > 0) refreshRate = mode->refreshRate;
+        }
+
+        if (config.framePacing && !presentWaitEnabled) {
+            std::cout << "Frame pacing needs VK_KHR_present_wait, which this device doesn't have; not pacing\n";
+        }
+        framePacer = std::make_unique<FramePacer>(device, presentWaitEnabled, config.framePacing && presentWaitEnabled,
+                                                  refreshRate);
+    }
+
+    // Whatever the frame does with input, it sees it as of now. With frame pacing this is as late as the pacer thinks
+    // the frame can start and still make the next vblank
+    void pollInput() {
+        framePacer->beginFrame(swapChain);
+        glfwPollEvents();
+        frameInputTime = std::chrono::steady_clock::now();
+    }
+
+    void reportLatency() {
+        if (framePacer == nullptr) return;
+
+        std::cout << "Input to " << (framePacer->measuresDisplayLatency() ? "display" : "present call")
+                  << " latency: p50 " << framePacer->latencyPercentile(50.0) << " ms, p99 "
+                  << framePacer->latencyPercentile(99.0) << " ms (" << presentPolicyName(config.presentPolicy) << ", "
+                  << swapChainsImages.size() << " swap chain images)\n";
+        if (config.framePacing && presentWaitEnabled) {
+            std::cout << "Frame pacing: starting " << framePacer->getStartDelayMilliseconds()
+                      << " ms after the previous present, " << framePacer->getMissedFrames() << " missed vblanks\n";
+        }
+    }
+
+    // Once, right after the first frame was submitted. The startup profiler is done after that
+    void reportStartup() {
+        std::cout << "Time to first frame: " << startupProfiler->nowMicroseconds() / 1000.0 << " ms\n";
+        if (!config.startupTracePath.empty()) {
+            startupProfiler->printSummary(std::cout);
+            startupProfiler->writeChromeTrace(config.startupTracePath);
+            std::cout << "Wrote startup trace to " << config.startupTracePath << "\n";
+        }
+        startupProfiler.reset();
+    }
+
+    void reportProfile() {
+        if (profiler == nullptr) return;
+
+        waitDeviceIdle();
+        profiler->printSummary(std::cout);
+        if (!config.profileTracePath.empty()) {
+            profiler->writeChromeTrace(config.profileTracePath);
+            std::cout << "Wrote trace to " << config.profileTracePath << "\n";
+        }
+    }
+
+    void createSyncObjects() {
+        VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+        imageAvailableSemaphores.resize(config.framesInFlight);
+        for (uint32_t i = 0; i < config.framesInFlight; i++) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, imageAvailableSemaphores[i].put(device)) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Failed to create synchronization objects");
+            }
+        }
+
+        // Starts at 0, which every slot's "last submitted frame" also starts at, so the first waits return immediately
+        frameTimeline = std::make_unique<TimelineSemaphore>(device);
+        frameSlotSubmitCounts.assign(config.framesInFlight, 0);
+
+        createSwapChainSyncObjects();
+    }
+
+    static VkSemaphoreSubmitInfo binarySemaphoreInfo(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask) {
+        VkSemaphoreSubmitInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        info.semaphore = semaphore;
+        info.stageMask = stageMask;
+        return info;
+    }
+
+    // The sync objects that are tied to swap chain images, recreated along with the swap chain
+    void createSwapChainSyncObjects() {
+        VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+        renderFinishedSemaphores.resize(swapChainsImages.size());
+        for (auto &semaphore : renderFinishedSemaphores) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, semaphore.put(device)) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create synchronization objects");
+            }
+        }
+
+        imageFrameNumbers.assign(swapChainsImages.size(), 0);
+    }
+
+    // Builds a new swap chain for the current surface size and retires the old one. Frames that are still in flight
+    // keep using the old image views and framebuffers, so those go into the deletion queue rather than being destroyed.
+    // Returns false while the window is minimized, since a zero sized swap chain cannot be created
+    bool recreateSwapChain() {
+        // The formats and present modes stay the same, only the capabilities follow the window
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &deviceInfo.swapChainSupport.capabilities);
+        VkExtent2D extent = chooseSwapExtent(deviceInfo.swapChainSupport.capabilities);
+        if (extent.width == 0 || extent.height == 0) return false;
+
+        // The last present of the old chain is queued before the first frame of its replacement, so once that frame
+        // has completed the presentation engine is done with the old semaphores as well
+        uint64_t retireFrame = frameTimeline->lastSubmittedValue() + 1;
+        UniqueSwapchain oldSwapChain = std::move(swapChain);
+        createSwapChain(oldSwapChain);
+
+        deletionQueue.retire(retireFrame, std::move(swapChainFramebuffers));
+        deletionQueue.retire(retireFrame, std::move(swapChainImageViews));
+        deletionQueue.retire(retireFrame, std::move(renderGraph));
+        if (gpuCuller != nullptr) gpuCuller->retireDepthBuffer(retireFrame);
+        deletionQueue.retire(retireFrame, std::move(renderFinishedSemaphores));
+        deletionQueue.retire(retireFrame, std::move(oldSwapChain));
+        if (framePacer != nullptr) framePacer->swapChainRecreated();
+
+        // The render pass (or the attachment format with dynamic rendering) only depends on the format, and
+        // viewport/scissor are dynamic, so the pipeline stays valid. Only the render pass path has framebuffers
+        createImageViews();
+        createRenderGraph();
+        if (gpuCuller != nullptr) gpuCuller->setDepthBuffer(depthImageView, swapChainExtent);
+        createFramebuffer();
+        createSwapChainSyncObjects();
+
+        swapChainOutOfDate = false;
+        return true;
+    }
+
+    // Startup is mostly waiting on the driver, one stage after the other. The stages that don't depend on each other
+    // are spread over two threads instead: the shaders and the pipeline cache are read from disk while the instance
+    // and device are created, and the pipeline, usually the slowest stage, is compiled while the swap chain and the
+    // buffers are created. Every stage ends up in the startup trace
+    void initVulkan() {
+        Profiler *trace = startupProfiler.get();
+        ThreadPool startupWorker(1);  // Joined before returning, also when a stage throws
+
+        auto shadersLoaded = startupWorker.submit([this, trace] {
+            ProfileScope scope(trace, "load shaders", ProfileTrack::StartupWorker);
+            loadShaders();
+        });
+        auto pipelineCacheRead = startupWorker.submit([this, trace] {
+            ProfileScope scope(trace, "read pipeline cache", ProfileTrack::StartupWorker);
+            return readPipelineCacheFile();
+        });
+
+        {
+            ProfileScope scope(trace, "instance");
+            createInstance();
+            setupDebugMessenger();
+            createSurface();
+        }
+        {
+            ProfileScope scope(trace, "pick device");
+            pickPhysicalDevice();
+        }
+        {
+            ProfileScope scope(trace, "device");
+            createLogicalDevice();
+            createAllocator();
+        }
+        {
+            ProfileScope scope(trace, "render pass");
+            chooseAttachmentFormats();
+            createRenderPass();
+        }
+        {
+            ProfileScope scope(trace, "pipeline cache");
+            createPipelineCache(pipelineCacheRead.get());
+        }
+        {
+            ProfileScope scope(trace, "descriptor heap");
+            createDescriptorHeap();
+        }
+
+        // From here until it is joined the worker owns the shader modules, the pipeline layout and the pipeline, and
+        // only reads state that is already final: the formats, the render pass, the heap layout and the config
+        shadersLoaded.get();  // Rethrows if the bundle could not be loaded
+        auto pipelineCreated = startupWorker.submit([this, trace] {
+            ProfileScope scope(trace, "pipeline", ProfileTrack::StartupWorker);
+            createGraphicsPipeline();
+        });
+
+        {
+            ProfileScope scope(trace, "swap chain");
+            if (config.headless) {
+                createOffscreenImages();
+            } else {
+                createSwapChain();
+            }
+            createImageViews();
+            createRenderGraph();
+            renderGraph->printSummary(std::cout);
+            createFramebuffer();
+        }
+        {
+            ProfileScope scope(trace, "buffers");
+            createCommandPool();
+            createMeshBuffers();
+            createMaterialBuffer();
+            if (!config.texturePaths.empty()) createTextureStreamer();
+        }
+        if (!isDrawModeSupported(config.drawMode)) {
+            throw std::runtime_error(std::string("Draw mode not supported by this device: ") +
+                                     drawModeName(config.drawMode));
+        }
+        {
+            ProfileScope scope(trace, "wait for pipeline");
+            pipelineCreated.get();
+        }
+
+        {
+            ProfileScope scope(trace, "culling");
+            createCulling();
+            createObjectBuffers(config.objectCount);
+        }
+        {
+            ProfileScope scope(trace, "frame resources");
+            createCommandBuffers();
+            createSyncObjects();
+            if (!config.headless) createFramePacer();
+        }
+        if (config.profile) createProfiler();
+        if (config.countOverdraw) createOverdrawCounter();
+        if (config.hotReload) createShaderWatcher();
+        if (!config.capturePath.empty()) {
+            frameCapture = std::make_unique<FrameCapture>(*allocator, swapChainImageFormat, config.captureFormat,
+                                                          config.capturePath, config.captureInterval,
+                                                          config.captureBufferCount);
+        }
+    }
+
+    void mainLoop() {
+        if (config.headless) {
+            headlessLoop();
+            return;
+        }
+
+        uint32_t framesRendered = 0;
+        auto lastProfileReport = std::chrono::steady_clock::now();
+        while (!glfwWindowShouldClose(window.get())) {
+            pollInput();
+            FrameStatus status = drawFrame();
+            if (status == FrameStatus::Minimized) glfwWaitEvents();
+            if (status != FrameStatus::Drawn) continue;
+
+            auto now = std::chrono::steady_clock::now();
+            if (profiler != nullptr && now - lastProfileReport >= PROFILE_REPORT_INTERVAL) {
+                profiler->printSummary(std::cout);
+                lastProfileReport = now;
+            }
+
+            if (config.frameCount != 0 && ++framesRendered >= config.frameCount) break;
+        }
+
+        waitDeviceIdle();
+    }
+
+    // For every object count, renders the scene with each supported draw mode and reports the average CPU time spent
+    // recording the command buffer and the average time per frame. With --record-threads every mode is also recorded
+    // inline and with 1, 2, 4 ... worker threads, to show how recording scales with cores
+    void benchmarkObjectCounts() {
+        const uint32_t warmupFrames = 20;
+        uint32_t measuredFrames = config.frameCount != 0 ? config.frameCount : 200;
+
+        std::vector<uint32_t> threadCounts = {0};
+        for (uint32_t threads = 1; threads < config.recordThreads; threads *= 2) threadCounts.push_back(threads);
+        if (config.recordThreads > 0) threadCounts.push_back(config.recordThreads);
+
+        std::cout << "objects\tdraw mode\trecord threads\trecord (ms)\tframe (ms)\n";
+        for (uint32_t count : config.benchmarkObjectCounts) {
+            retireObjectBuffers();
+            createObjectBuffers(count);
+
+            for (auto drawMode : {DrawMode::Direct, DrawMode::Instanced, DrawMode::Indirect, DrawMode::IndirectCount}) {
+                if (!isDrawModeSupported(drawMode)) continue;
+                config.drawMode = drawMode;
+
+                for (uint32_t threads : threadCounts) {
+                    recordThreadLimit = threads;
+                    for (uint32_t i = 0; i < warmupFrames; i++) drawFrame();
+
+                    double totalRecordMilliseconds = 0.0;
+                    auto start = std::chrono::steady_clock::now();
+                    for (uint32_t i = 0; i < measuredFrames; i++) {
+                        if (window != nullptr) pollInput();
+                        drawFrame();
+                        totalRecordMilliseconds += lastRecordMilliseconds;
+                    }
+                    waitDeviceIdle();
+                    double totalMilliseconds =
+                        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                    std::cout << count << "\t" << drawModeName(drawMode) << "\t" << threads << "\t"
+                              << totalRecordMilliseconds / measuredFrames << "\t" << totalMilliseconds / measuredFrames
+                              << "\n";
+                }
+            }
+        }
+        recordThreadLimit = config.recordThreads;
+    }
+
+    void headlessLoop() {
+        uint32_t frameCount = config.frameCount != 0 ? config.frameCount : DEFAULT_HEADLESS_FRAME_COUNT;
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frameCount; i++) {
+            drawFrame();
+        }
+        waitDeviceIdle();
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << "Rendered " << frameCount << " frames at " << swapChainExtent.width << "x"
+                  << swapChainExtent.height << " in " << seconds * 1000.0 << " ms (" << frameCount / seconds
+                  << " fps)\n";
+
+        if (!config.dumpFramePath.empty()) {
+            // The most recently rendered image is the one before the next one the pool would hand out
+            uint32_t lastImage = (nextOffscreenImage + config.offscreenImageCount - 1) % config.offscreenImageCount;
+            writePpm(config.dumpFramePath, readbackOffscreenImage(lastImage), swapChainExtent.width,
+                     swapChainExtent.height);
+            std::cout << "Wrote last frame to " << config.dumpFramePath << "\n";
+        }
+    }
+
+    FrameStatus drawFrame() {
+        ProfileScope frameScope(profiler.get(), "frame");
+
+        {
+            // Only wait for the frame that last used this slot; the other slots can still be executing on the GPU
+            ProfileScope scope(profiler.get(), "frame wait");
+            frameTimeline->wait(frameSlotSubmitCounts[currentFrame]);
+        }
+        completedFrameCount = frameTimeline->completedValue();
+        deletionQueue.collect(completedFrameCount);
+        if (frameCapture != nullptr) frameCapture->collect(completedFrameCount);
+        if (shaderWatcher != nullptr) pollShaderReload();
+        if (textureStreamer != nullptr) textureStreamer->beginFrame();
+
+        if (swapChainOutOfDate && !recreateSwapChain()) return FrameStatus::Minimized;
+
+        uint32_t imageIndex;
+        if (config.headless) {
+            // Nothing is presented, so the offscreen pool is simply used round-robin
+            imageIndex = nextOffscreenImage;
+            nextOffscreenImage = (nextOffscreenImage + 1) % config.offscreenImageCount;
+        } else {
+            ProfileScope scope(profiler.get(), "acquire");
+            VkSemaphore imageAvailable = imageAvailableSemaphores[currentFrame];
+            VkResult result =
+                vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailable, VK_NULL_HANDLE, &imageIndex);
+
+            // The semaphore is left untouched when out of date, so it can be reused right away with the new chain
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                if (!recreateSwapChain()) return FrameStatus::Minimized;
+                result =
+                    vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailable, VK_NULL_HANDLE, &imageIndex);
+            }
+
+            if (result == VK_SUBOPTIMAL_KHR) {
+                swapChainOutOfDate = true;  // Still presentable; draw this frame and recreate before the next one
+            } else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                swapChainOutOfDate = true;
+                return FrameStatus::OutOfDate;
+            } else if (result != VK_SUCCESS) {
+                throw std::runtime_error("Failed to acquire swap chain image");
+            }
+        }
+
+        // The acquired image may still be rendered to by a different frame slot (e.g. more frames in flight than swap
+        // chain images, or images returned out of order)
+        frameTimeline->wait(imageFrameNumbers[imageIndex]);
+
+        VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+        {
+            ProfileScope scope(profiler.get(), "record");
+            auto recordStart = std::chrono::steady_clock::now();
+            vkResetCommandBuffer(commandBuffer, 0);
+            recordCommandBuffer(commandBuffer, imageIndex);
+            lastRecordMilliseconds =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+        }
+
+        // Binary semaphores ignore the value. The frame's own number is signaled on the frame timeline, which is all
+        // the CPU and later frames wait for
+        std::vector<VkSemaphoreSubmitInfo> waitInfos;
+        if (!config.headless) {  // Nothing to acquire without a swap chain
+            waitInfos.push_back(binarySemaphoreInfo(imageAvailableSemaphores[currentFrame],
+                                                    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT));
+        }
+        if (textureWaitValue > 0) {  // Textures that became visible in this frame. Includes the acquire barriers
+            waitInfos.push_back(textureStreamer->uploadTimeline().submitInfo(std::exchange(textureWaitValue, 0),
+                                                                             VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+        }
+
+        uint64_t frameNumber = frameTimeline->nextValue();
+        std::vector<VkSemaphoreSubmitInfo> signalInfos = {
+            frameTimeline->submitInfo(frameNumber, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT)};
+        if (!config.headless) {  // Nothing to present without a swap chain
+            signalInfos.push_back(
+                binarySemaphoreInfo(renderFinishedSemaphores[imageIndex], VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+        }
+
+        VkCommandBufferSubmitInfo commandBufferInfo{};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandBufferInfo.commandBuffer = commandBuffer;
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waitInfos.size());
+        submitInfo.pWaitSemaphoreInfos = waitInfos.data();
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandBufferInfo;
+        submitInfo.signalSemaphoreInfoCount = static_cast<uint32_t>(signalInfos.size());
+        submitInfo.pSignalSemaphoreInfos = signalInfos.data();
+
+        {
+            ProfileScope scope(profiler.get(), "submit");
+            auto queueLock = lockSharedQueue(graphicsQueue);
+            if (vkQueueSubmit2(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to submit draw command buffer");
+            }
+        }
+        frameSlotSubmitCounts[currentFrame] = frameNumber;
+        imageFrameNumbers[imageIndex] = frameNumber;
+        if (startupProfiler != nullptr) reportStartup();
+
+        if (config.headless) {
+            currentFrame = (currentFrame + 1) % config.framesInFlight;
+            return FrameStatus::Drawn;
+        }
+
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        VkSemaphore renderFinished = renderFinishedSemaphores[imageIndex];
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &renderFinished;
+
+        VkSwapchainKHR swapChains[] = {swapChain};
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = swapChains;
+        presentInfo.pImageIndices = &imageIndex;
+        presentInfo.pResults = nullptr;  // Optional
+
+        // Tags the present with the frame's number, which only ever goes up, so the frame pacer can wait for it
+        VkPresentIdKHR presentId{};
+        presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        presentId.swapchainCount = 1;
+        presentId.pPresentIds = &frameNumber;
+        if (presentWaitEnabled) presentInfo.pNext = &presentId;
+
+        VkResult result;
+        {
+            ProfileScope scope(profiler.get(), "present");
+            auto queueLock = lockSharedQueue(presentationQueue);
+            result = vkQueuePresentKHR(presentationQueue, &presentInfo);
+        }
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) framePacer->presented(frameNumber, frameInputTime);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            swapChainOutOfDate = true;  // Recreated at the start of the next frame, after its slot wait
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to present swap chain image");
+        }
+
+        currentFrame = (currentFrame + 1) % config.framesInFlight;
+        return FrameStatus::Drawn;
+    }
+
+    // Only what the members don't own themselves: the allocator's buffers and images, and the pipeline cache contents
+    // that are saved to disk. Everything else is destroyed along with the application
+    void cleanup() {
+        stopShaderReload();
+        destroyStreamedTextures();
+        deletionQueue.flush();
+        destroyObjectBuffers();
+        allocator->destroyBuffer(materialBuffer);
+        allocator->destroyBuffer(indexBuffer);
+        allocator->destroyBuffer(vertexBuffer);
+        for (auto &image : offscreenImages) {
+            allocator->destroyImage(image);
+        }
+        savePipelineCache();
+    }
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// Drivers only guarantee maxMemoryAllocationCount (often 4096) live allocations and vkAllocateMemory is slow, so
+// resources are carved out of a few large blocks instead of getting their own VkDeviceMemory each
+const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;  // Points at `offset` inside the block for host visible memory, null otherwise
+    uint32_t poolIndex = 0;
+    uint32_t blockIndex = 0;
+};
+
+struct Buffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation allocation;
+};
+
+struct Image {
+    VkImage image = VK_NULL_HANDLE;
+    Allocation allocation;
+};
+
+class DeviceMemoryAllocator {
+    // A single VkDeviceMemory that is handed out in pieces. Free space is kept as offset -> size, so neighbouring free
+    // ranges can be merged back together when something is freed
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        void *mapped = nullptr;
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+    };
+
+    // Blocks are kept per memory type. Buffers (linear) and optimally tiled images also get separate pools so we never
+    // have to pad allocations to bufferImageGranularity to keep them from sharing a page
+    struct Pool {
+        uint32_t memoryType;
+        bool linear;
+        std::vector<Block> blocks;
+    };
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize blockSize;
+    std::vector<Pool> pools;
+    std::mutex mutex;
+
+    VkDeviceSize allocatedBytes = 0;  // Backing VkDeviceMemory
+    VkDeviceSize usedBytes = 0;       // Handed out to resources
+
+public:
+    DeviceMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device,
+                          VkDeviceSize blockSize = DEFAULT_MEMORY_BLOCK_SIZE)
+        : device(device), blockSize(blockSize) {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    }
+
+    ~DeviceMemoryAllocator() {
+        for (auto &pool : pools) {
+            for (auto &block : pool.blocks) {
+                if (block.memory != VK_NULL_HANDLE) vkFreeMemory(device, block.memory, nullptr);
+            }
+        }
+    }
+
+    DeviceMemoryAllocator(const DeviceMemoryAllocator &) = delete;
+    DeviceMemoryAllocator &operator=(const DeviceMemoryAllocator &) = delete;
+
+    VkDeviceSize getAllocatedBytes() const { return allocatedBytes; }
+    VkDeviceSize getUsedBytes() const { return usedBytes; }
+
+    const VkPhysicalDeviceMemoryProperties &getMemoryProperties() const { return memoryProperties; }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        // typeFilter is a bit field of the memory types that are suitable for the resource
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("Failed to find suitable memory type");
+    }
+
+    Allocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool linear) {
+        std::lock_guard lock(mutex);
+
+        uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+        uint32_t poolIndex = findOrCreatePool(memoryType, linear);
+        Pool &pool = pools[poolIndex];
+
+        for (uint32_t blockIndex = 0; blockIndex < pool.blocks.size(); blockIndex++) {
+            Allocation allocation;
+            if (tryAllocateFromBlock(pool.blocks[blockIndex], requirements, allocation)) {
+                allocation.poolIndex = poolIndex;
+                allocation.blockIndex = blockIndex;
+                usedBytes += allocation.size;
+                return allocation;
+            }
+        }
+
+        // Nothing fits; anything bigger than the default block size simply gets a block of its own
+        uint32_t blockIndex = createBlock(pool, std::max(blockSize, requirements.size));
+
+        Allocation allocation;
+        if (!tryAllocateFromBlock(pool.blocks[blockIndex], requirements, allocation)) {
+            throw std::runtime_error("Failed to sub-allocate from a new memory block");
+        }
+        allocation.poolIndex = poolIndex;
+        allocation.blockIndex = blockIndex;
+        usedBytes += allocation.size;
+        return allocation;
+    }
+
+    void free(Allocation &allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) return;
+
+        std::lock_guard lock(mutex);
+
+        Block &block = pools[allocation.poolIndex].blocks[allocation.blockIndex];
+        auto inserted = block.freeRanges.emplace(allocation.offset, allocation.size).first;
+
+        // Merge with the following free range
+        auto next = std::next(inserted);
+        if (next != block.freeRanges.end() && inserted->first + inserted->second == next->first) {
+            inserted->second += next->second;
+            block.freeRanges.erase(next);
+        }
+
+        // Merge with the preceding free range
+        if (inserted != block.freeRanges.begin()) {
+            auto previous = std::prev(inserted);
+            if (previous->first + previous->second == inserted->first) {
+                previous->second += inserted->second;
+                block.freeRanges.erase(inserted);
+            }
+        }
+
+        usedBytes -= allocation.size;
+        allocation = {};
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        Buffer buffer;
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create buffer");
+        }
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(device, buffer.buffer, &memoryRequirements);
+
+        buffer.allocation = allocate(memoryRequirements, properties, true);
+        vkBindBufferMemory(device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+
+        return buffer;
+    }
+
+    void destroyBuffer(Buffer &buffer) {
+        if (buffer.buffer != VK_NULL_HANDLE) vkDestroyBuffer(device, buffer.buffer, nullptr);
+        free(buffer.allocation);
+        buffer.buffer = VK_NULL_HANDLE;
+    }
+
+    Image createImage(const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties) {
+        Image image;
+        if (vkCreateImage(device, &imageInfo, nullptr, &image.image) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create image");
+        }
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetImageMemoryRequirements(device, image.image, &memoryRequirements);
+
+        image.allocation = allocate(memoryRequirements, properties, imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
+        vkBindImageMemory(device, image.image, image.allocation.memory, image.allocation.offset);
+
+        return image;
+    }
+
+    void destroyImage(Image &image) {
+        if (image.image != VK_NULL_HANDLE) vkDestroyImage(device, image.image, nullptr);
+        free(image.allocation);
+        image.image = VK_NULL_HANDLE;
+    }
+
+private:
+    uint32_t findOrCreatePool(uint32_t memoryType, bool linear) {
+        for (uint32_t i = 0; i < pools.size(); i++) {
+            if (pools[i].memoryType == memoryType && pools[i].linear == linear) return i;
+        }
+
+        pools.push_back({memoryType, linear, {}});
+        return static_cast<uint32_t>(pools.size() - 1);
+    }
+
+    uint32_t createBlock(Pool &pool, VkDeviceSize size) {
+        Block block;
+        block.size = size;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = pool.memoryType;
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate device memory block");
+        }
+
+        // Host visible blocks stay mapped for their whole life; mapping is not free and it can only be done once
+        if (memoryProperties.memoryTypes[pool.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+        }
+
+        block.freeRanges.emplace(0, size);
+        allocatedBytes += size;
+
+        pool.blocks.push_back(std::move(block));
+        return static_cast<uint32_t>(pool.blocks.size() - 1);
+    }
+
+    // First fit. The aligned start may leave a small gap at the front of the free range, which stays free
+    static bool tryAllocateFromBlock(Block &block, const VkMemoryRequirements &requirements, Allocation &allocation) {
+        for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+            VkDeviceSize rangeStart = it->first;
+            VkDeviceSize rangeEnd = it->first + it->second;
+            VkDeviceSize alignedStart = (rangeStart + requirements.alignment - 1) / requirements.alignment *
+                                        requirements.alignment;
+
+            if (alignedStart + requirements.size > rangeEnd) continue;
+
+            block.freeRanges.erase(it);
+            if (alignedStart > rangeStart) block.freeRanges.emplace(rangeStart, alignedStart - rangeStart);
+            if (alignedStart + requirements.size < rangeEnd) {
+                block.freeRanges.emplace(alignedStart + requirements.size,
+                                         rangeEnd - (alignedStart + requirements.size));
+            }
+
+            allocation.memory = block.memory;
+            allocation.offset = alignedStart;
+            allocation.size = requirements.size;
+            allocation.mapped = block.mapped ? static_cast<char *>(block.mapped) + alignedStart : nullptr;
+            return true;
+        }
+
+        return false;
+    }
+};
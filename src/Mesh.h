@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// The attributes themselves come from reflecting shader.vert: inputs below this location are read from the Vertex
+// binding and the rest from the InstanceData binding, tightly packed in location order
+const uint32_t INSTANCE_FIRST_LOCATION = 2;
+
+struct Vertex {
+    float position[2];
+    float color[3];
+
+    // How to step through the vertex buffer: one tightly packed Vertex per vertex
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+};
+
+struct Mesh {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// One triangle gives the classic RGB triangle. More triangles are laid out on a square grid covering the whole
+// viewport, with the same clockwise winding so back face culling keeps working
+inline Mesh generateTriangleGrid(uint32_t triangleCount) {
+    Mesh mesh;
+    if (triangleCount == 1) {
+        mesh.vertices = {
+            {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+            {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+            {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+        };
+        mesh.indices = {0, 1, 2};
+        return mesh;
+    }
+
+    uint32_t cellsPerRow = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(triangleCount))));
+    float cellSize = 2.0f / static_cast<float>(cellsPerRow);
+
+    mesh.vertices.reserve(static_cast<size_t>(triangleCount) * 3);
+    mesh.indices.reserve(static_cast<size_t>(triangleCount) * 3);
+
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        uint32_t column = i % cellsPerRow;
+        uint32_t row = i / cellsPerRow;
+
+        float left = -1.0f + column * cellSize;
+        float top = -1.0f + row * cellSize;
+        float u = static_cast<float>(column) / cellsPerRow;
+        float v = static_cast<float>(row) / cellsPerRow;
+
+        uint32_t firstVertex = static_cast<uint32_t>(mesh.vertices.size());
+        mesh.vertices.push_back({{left + cellSize * 0.5f, top + cellSize * 0.1f}, {1.0f, u, v}});
+        mesh.vertices.push_back({{left + cellSize * 0.9f, top + cellSize * 0.9f}, {u, 1.0f, v}});
+        mesh.vertices.push_back({{left + cellSize * 0.1f, top + cellSize * 0.9f}, {u, v, 1.0f}});
+
+        mesh.indices.push_back(firstVertex);
+        mesh.indices.push_back(firstVertex + 1);
+        mesh.indices.push_back(firstVertex + 2);
+    }
+
+    return mesh;
+}
+
+// Per object data, stepped once per instance instead of once per vertex
+struct InstanceData {
+    float offset[2];
+    float scale;
+    float depth;  // 0 is nearest
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(InstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescription;
+    }
+};
+
+// Shrinks the mesh (which spans the whole viewport) into one cell of a square grid per object. A single object is
+// left untouched. With `objectScale` above 1 every object covers that many cells in each direction, so objects overlap
+// and the scene overdraws. Depths are scattered pseudo-randomly, the same on every run, so the order the grid is laid
+// out in says nothing about what is in front
+inline std::vector<InstanceData> generateInstanceGrid(uint32_t objectCount, float objectScale = 1.0f) {
+    if (objectCount == 1) return {{{0.0f, 0.0f}, 1.0f, 0.0f}};
+
+    uint32_t cellsPerRow = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(objectCount))));
+    float cellSize = 2.0f / static_cast<float>(cellsPerRow);
+
+    std::vector<InstanceData> instances(objectCount);
+    for (uint32_t i = 0; i < objectCount; i++) {
+        uint32_t column = i % cellsPerRow;
+        uint32_t row = i / cellsPerRow;
+
+        instances[i].offset[0] = -1.0f + (column + 0.5f) * cellSize;
+        instances[i].offset[1] = -1.0f + (row + 0.5f) * cellSize;
+        instances[i].scale = objectScale / static_cast<float>(cellsPerRow);
+
+        // Knuth's multiplicative hash; the top 24 bits are plenty for a depth buffer
+        uint32_t hash = i * 2654435761u;
+        instances[i].depth = static_cast<float>(hash >> 8) / static_cast<float>(1u << 24);
+    }
+
+    return instances;
+}
+
+// Mirrors Material in shader.vert. Materials live in a storage buffer in the descriptor heap (see DescriptorHeap.h)
+struct Material {
+    float tint[4];  // Multiplies the vertex color; std430, so a vec3 would still take 16 bytes
+};
+
+// Mirrors the push constant block in shader.vert: where in the descriptor heap this draw finds its data
+struct DrawConstants {
+    uint32_t materialBuffer;  // Element of the heap's storage buffer array holding the materials
+    uint32_t materialCount;   // Objects cycle through the materials by instance index
+    uint32_t textureTable;    // Element holding the heap element of each streamed texture, see TextureStreamer.h
+    uint32_t textureCount;    // Objects cycle through those too. 0 leaves them untextured
+    float viewOffset[2];      // The camera, see CullView in Culling.h
+    float viewScale;
+};
+
+// Texture table entry of a texture that isn't resident yet
+const uint32_t NO_TEXTURE = UINT32_MAX;
+
+// A single material leaves the mesh colors untouched. More are spread around the color wheel
+inline std::vector<Material> generateMaterials(uint32_t materialCount) {
+    if (materialCount == 1) return {{{1.0f, 1.0f, 1.0f, 1.0f}}};
+
+    const float twoPi = 6.28318530718f;
+    std::vector<Material> materials(materialCount);
+    for (uint32_t i = 0; i < materialCount; i++) {
+        float hue = static_cast<float>(i) / static_cast<float>(materialCount);
+        for (int channel = 0; channel < 3; channel++) {
+            materials[i].tint[channel] = 0.5f + 0.5f * std::cos(twoPi * (hue + channel / 3.0f));
+        }
+        materials[i].tint[3] = 1.0f;
+    }
+
+    return materials;
+}
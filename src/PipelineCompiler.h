@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ThreadPool.h"
+
+enum class BlendMode : uint8_t {
+    Opaque,
+    Alpha,     // Classic "over" blending
+    Additive,  // Useful for particles and for visualizing overdraw
+};
+
+// Specialization constants with a constant_id below this can be set per variant
+const uint32_t MAX_SPECIALIZATION_CONSTANTS = 4;
+
+// The bits of fixed function state that differ between pipelines built from the same shaders. Everything else
+// (shaders, layout, render pass, dynamic viewport/scissor) is shared. Specialization constants also go here: the driver
+// compiles them into the pipeline like any other state, so a specialized variant costs nothing per draw
+struct PipelineVariant {
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    BlendMode blendMode = BlendMode::Opaque;
+
+    // Raw 32 bit values indexed by constant_id. Only constants whose bit is set in the mask are specialized, the rest
+    // keep the default declared in the shader
+    uint32_t specializationMask = 0;
+    std::array<uint32_t, MAX_SPECIALIZATION_CONSTANTS> specializationValues{};
+
+    bool operator==(const PipelineVariant &other) const = default;
+};
+
+struct PipelineVariantHash {
+    size_t operator()(const PipelineVariant &variant) const {
+        // Every fixed function field fits comfortably in 8 bits
+        size_t hash = static_cast<size_t>(variant.topology) | static_cast<size_t>(variant.polygonMode) << 8 |
+                      static_cast<size_t>(variant.cullMode) << 16 | static_cast<size_t>(variant.blendMode) << 24;
+        if (variant.specializationMask == 0) return hash;
+
+        hash ^= std::hash<uint32_t>{}(variant.specializationMask) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        for (uint32_t value : variant.specializationValues) {
+            hash ^= std::hash<uint32_t>{}(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+};
+
+// Builds pipeline variants on a pool of worker threads. vkCreateGraphicsPipelines is safe to call concurrently and the
+// pipeline cache handed to the build function is internally synchronized, so every worker can share one cache.
+// Each variant is only ever built once; asking for it again returns the same future
+class PipelineCompiler {
+public:
+    using BuildFunction = std::function<VkPipeline(const PipelineVariant &)>;
+
+private:
+    VkDevice device;
+    BuildFunction buildPipeline;
+    ThreadPool threadPool;
+
+    std::mutex mutex;
+    std::unordered_map<PipelineVariant, std::shared_future<VkPipeline>, PipelineVariantHash> pipelines;
+
+public:
+    PipelineCompiler(VkDevice device, BuildFunction buildPipeline, uint32_t threadCount)
+        : device(device), buildPipeline(std::move(buildPipeline)), threadPool(threadCount) {}
+
+    // Waits for outstanding builds and destroys every pipeline this compiler created
+    ~PipelineCompiler() {
+        for (auto &[variant, pipeline] : pipelines) {
+            try {
+                vkDestroyPipeline(device, pipeline.get(), nullptr);
+            } catch (...) {
+                // The build failed, so there is nothing to destroy
+            }
+        }
+    }
+
+    PipelineCompiler(const PipelineCompiler &) = delete;
+    PipelineCompiler &operator=(const PipelineCompiler &) = delete;
+
+    uint32_t threadCount() const { return threadPool.size(); }
+
+    // Returns immediately. The future becomes ready once the pipeline is built, or rethrows the build error
+    std::shared_future<VkPipeline> request(const PipelineVariant &variant) {
+        std::lock_guard lock(mutex);
+
+        auto existing = pipelines.find(variant);
+        if (existing != pipelines.end()) return existing->second;
+
+        auto pipeline = threadPool.submit([this, variant] { return buildPipeline(variant); }).share();
+        pipelines.emplace(variant, pipeline);
+        return pipeline;
+    }
+
+    void waitAll() {
+        std::vector<std::shared_future<VkPipeline>> pending;
+        {
+            std::lock_guard lock(mutex);
+            for (auto &[variant, pipeline] : pipelines) pending.push_back(pipeline);
+        }
+
+        for (auto &pipeline : pending) pipeline.wait();
+    }
+};
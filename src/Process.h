@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+extern char **environ;
+#endif
+
+// Runs a program and waits for it. The first argument is the program, looked up on the PATH unless it is a path.
+// There is no shell in between, so spaces and shell metacharacters in the arguments are passed through as they are.
+// Returns the exit code, or -1 if the program couldn't be started or didn't exit normally
+inline int runProcess(const std::vector<std::string> &arguments) {
+#ifdef _WIN32
+    // The C runtime joins the arguments into one command line without quoting them, and the program splits it again
+    // following the rules of CommandLineToArgvW: backslashes only escape when a quote follows them
+    std::vector<std::string> quoted;
+    for (auto &argument : arguments) {
+        std::string result = "\"";
+        size_t backslashes = 0;
+        for (char c : argument) {
+            if (c == '\\') {
+                backslashes++;
+                continue;
+            }
+            if (c == '"') backslashes = backslashes * 2 + 1;
+            result.append(backslashes, '\\');
+            result.push_back(c);
+            backslashes = 0;
+        }
+        result.append(backslashes * 2, '\\');  // So they don't escape the closing quote
+        result.push_back('"');
+        quoted.push_back(std::move(result));
+    }
+
+    std::vector<const char *> argv;
+    for (auto &argument : quoted) argv.push_back(argument.c_str());
+    argv.push_back(nullptr);
+    return static_cast<int>(_spawnvp(_P_WAIT, arguments[0].c_str(), argv.data()));
+#else
+    std::vector<char *> argv;
+    for (auto &argument : arguments) argv.push_back(const_cast<char *>(argument.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) return -1;
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
+// A file name in the temp directory that no other call, and no other running instance, comes up with, e.g.
+// "vk-learning-1234-7-shader.vert.spv". Nothing is created, that is up to the caller
+inline std::filesystem::path uniqueTempPath(const std::string &name) {
+    static std::atomic<uint64_t> counter = 0;
+#ifdef _WIN32
+    int processId = _getpid();
+#else
+    int processId = static_cast<int>(getpid());
+#endif
+    return std::filesystem::temp_directory_path() /
+           ("vk-learning-" + std::to_string(processId) + "-" + std::to_string(counter++) + "-" + name);
+}
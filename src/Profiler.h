@@ -0,0 +1,373 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Percentiles are computed over the most recent samples only, so a spike shows up while it is happening instead of
+// being averaged away by a long run
+const size_t DEFAULT_PROFILE_WINDOW = 1024;
+
+// Roughly a minute of frames at 60 fps with a dozen spans each. Older events are dropped from the trace
+const size_t DEFAULT_MAX_TRACE_EVENTS = 64 * 1024;
+
+// Chrome trace thread ids, so CPU and GPU spans end up on their own rows
+enum class ProfileTrack : uint32_t {
+    Cpu = 1,
+    Gpu = 2,
+    StartupWorker = 3,  // The thread initVulkan() hands independent stages to
+};
+
+// Collects named spans, keeps a rolling window of durations per name for percentiles and a bounded list of events that
+// can be written out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+class Profiler {
+    struct TraceEvent {
+        std::string name;
+        ProfileTrack track;
+        double startMicroseconds;
+        double durationMicroseconds;
+    };
+
+    struct Samples {
+        std::vector<double> milliseconds;  // Ring buffer of the last `windowSize` durations
+        size_t next = 0;
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t windowSize;
+    size_t maxTraceEvents;
+
+    std::mutex mutex;
+    std::map<std::string, Samples> samples;
+    std::deque<TraceEvent> traceEvents;
+
+public:
+    explicit Profiler(size_t windowSize = DEFAULT_PROFILE_WINDOW, size_t maxTraceEvents = DEFAULT_MAX_TRACE_EVENTS)
+        : windowSize(windowSize), maxTraceEvents(maxTraceEvents) {}
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    // Time since the profiler was created, the time base of every span
+    double nowMicroseconds() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void addSpan(const std::string &name, ProfileTrack track, double startMicroseconds, double durationMicroseconds) {
+        std::lock_guard lock(mutex);
+
+        Samples &window = samples[name];
+        double milliseconds = durationMicroseconds / 1000.0;
+        if (window.milliseconds.size() < windowSize) {
+            window.milliseconds.push_back(milliseconds);
+        } else {
+            window.milliseconds[window.next] = milliseconds;
+        }
+        window.next = (window.next + 1) % windowSize;
+
+        traceEvents.push_back({name, track, startMicroseconds, durationMicroseconds});
+        if (traceEvents.size() > maxTraceEvents) traceEvents.pop_front();
+    }
+
+    // Forgets every sample and trace event, e.g. to drop warm-up frames
+    void clear() {
+        std::lock_guard lock(mutex);
+        samples.clear();
+        traceEvents.clear();
+    }
+
+    // p in [0, 100], over the rolling window. 0 if nothing was recorded under that name
+    double percentile(const std::string &name, double p) {
+        std::lock_guard lock(mutex);
+
+        auto found = samples.find(name);
+        if (found == samples.end() || found->second.milliseconds.empty()) return 0.0;
+
+        return percentileOf(found->second.milliseconds, p);
+    }
+
+    void printSummary(std::ostream &out) {
+        std::lock_guard lock(mutex);
+
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-24s %10s %10s %10s\n", "span (ms)", "p50", "p95", "p99");
+        out << line;
+        for (auto &[name, window] : samples) {
+            if (window.milliseconds.empty()) continue;
+            std::snprintf(line, sizeof(line), "%-24s %10.3f %10.3f %10.3f\n", name.c_str(),
+                          percentileOf(window.milliseconds, 50.0), percentileOf(window.milliseconds, 95.0),
+                          percentileOf(window.milliseconds, 99.0));
+            out << line;
+        }
+    }
+
+    void writeChromeTrace(const std::string &filename) {
+        std::lock_guard lock(mutex);
+
+        std::ofstream file(filename, std::ios::trunc);
+        if (!file.is_open()) throw std::runtime_error("Failed to open trace file: " + filename);
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"Startup worker\"}}";
+
+        char timing[96];
+        for (auto &event : traceEvents) {
+            std::snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f", event.startMicroseconds,
+                          event.durationMicroseconds);
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << static_cast<uint32_t>(event.track) << "," << timing << "}";
+        }
+        file << "\n]}\n";
+    }
+
+private:
+    static double percentileOf(std::vector<double> values, double p) {
+        size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(values.size() - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        return values[rank];
+    }
+};
+
+// Records a CPU span for the lifetime of the scope. Does nothing when handed a null profiler, so instrumentation can
+// stay in place when profiling is off
+class ProfileScope {
+    Profiler *profiler;
+    const char *name;
+    ProfileTrack track;
+    double startMicroseconds = 0.0;
+
+public:
+    ProfileScope(Profiler *profiler, const char *name, ProfileTrack track = ProfileTrack::Cpu)
+        : profiler(profiler), name(name), track(track) {
+        if (profiler != nullptr) startMicroseconds = profiler->nowMicroseconds();
+    }
+
+    ~ProfileScope() {
+        if (profiler != nullptr) {
+            profiler->addSpan(name, track, startMicroseconds, profiler->nowMicroseconds() - startMicroseconds);
+        }
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+const uint32_t MAX_GPU_PROFILE_REGIONS = 32;
+
+// GPU spans from vkCmdWriteTimestamp. Every frame in flight has its own query pool; a slot's results are only read when
+// the slot comes around again, after its last frame has been waited for, so reading them back never stalls. GPU
+// timestamps are on a clock of their own (VK_EXT_calibrated_timestamps is not assumed), so in the trace every frame's
+// GPU spans are anchored at the CPU time its command buffer was recorded: durations are exact, start times are
+// approximate
+class GpuProfiler {
+    struct Region {
+        std::string name;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+
+    struct FrameQueries {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        std::vector<Region> regions;
+        uint32_t usedQueries = 0;
+        double anchorMicroseconds = 0.0;
+    };
+
+    VkDevice device;
+    Profiler &profiler;
+    double timestampPeriodNanoseconds;
+    uint64_t timestampMask;
+    std::vector<FrameQueries> frames;
+
+public:
+    GpuProfiler(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t framesInFlight,
+                Profiler &profiler)
+        : device(device), profiler(profiler) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriodNanoseconds = properties.limits.timestampPeriod;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+        if (validBits == 0) throw std::runtime_error("The graphics queue does not support timestamps");
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        frames.resize(framesInFlight);
+        for (auto &frame : frames) {
+            VkQueryPoolCreateInfo queryPoolInfo{};
+            queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolInfo.queryCount = MAX_GPU_PROFILE_REGIONS * 2;
+
+            if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frame.queryPool) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create timestamp query pool");
+            }
+        }
+    }
+
+    ~GpuProfiler() {
+        for (auto &frame : frames) {
+            vkDestroyQueryPool(device, frame.queryPool, nullptr);
+        }
+    }
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    // Collects whatever the previous use of this slot measured and resets its queries. Call right after beginning the
+    // command buffer, outside of any render pass, once the slot's last frame has been waited for
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+        FrameQueries &queries = frames[frame];
+        collect(queries);
+
+        vkCmdResetQueryPool(commandBuffer, queries.queryPool, 0, MAX_GPU_PROFILE_REGIONS * 2);
+        queries.regions.clear();
+        queries.usedQueries = 0;
+        queries.anchorMicroseconds = profiler.nowMicroseconds();
+    }
+
+    // Returns a handle for end(), or UINT32_MAX if the frame has run out of queries
+    uint32_t begin(VkCommandBuffer commandBuffer, uint32_t frame, const char *name) {
+        FrameQueries &queries = frames[frame];
+        if (queries.usedQueries + 2 > MAX_GPU_PROFILE_REGIONS * 2) return UINT32_MAX;
+
+        Region region{name, queries.usedQueries, queries.usedQueries + 1};
+        queries.usedQueries += 2;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.queryPool, region.beginQuery);
+
+        queries.regions.push_back(region);
+        return static_cast<uint32_t>(queries.regions.size() - 1);
+    }
+
+    void end(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t region) {
+        if (region == UINT32_MAX) return;
+
+        FrameQueries &queries = frames[frame];
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries.queryPool,
+                            queries.regions[region].endQuery);
+    }
+
+private:
+    void collect(FrameQueries &queries) {
+        if (queries.usedQueries == 0) return;
+
+        // Pairs of (timestamp, availability). Without VK_QUERY_RESULT_WAIT_BIT this never blocks; anything that is
+        // somehow not available yet is skipped
+        std::vector<uint64_t> results(queries.usedQueries * 2);
+        vkGetQueryPoolResults(device, queries.queryPool, 0, queries.usedQueries, results.size() * sizeof(uint64_t),
+                              results.data(), 2 * sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+        uint64_t frameBegin = results[0] & timestampMask;
+        for (auto &region : queries.regions) {
+            if (results[region.beginQuery * 2 + 1] == 0 || results[region.endQuery * 2 + 1] == 0) continue;
+
+            uint64_t begin = results[region.beginQuery * 2] & timestampMask;
+            uint64_t end = results[region.endQuery * 2] & timestampMask;
+            if (end < begin) continue;  // The counter wrapped
+
+            double offsetMicroseconds = static_cast<double>(begin - frameBegin) * timestampPeriodNanoseconds / 1000.0;
+            double durationMicroseconds = static_cast<double>(end - begin) * timestampPeriodNanoseconds / 1000.0;
+            profiler.addSpan(region.name, ProfileTrack::Gpu, queries.anchorMicroseconds + offsetMicroseconds,
+                             durationMicroseconds);
+        }
+    }
+};
+
+// Counts fragment shader invocations with a pipeline statistics query, one per frame slot. Fragments that fail an early
+// depth test never reach the shader, so divided by the number of pixels this is the overdraw that is actually paid for
+class OverdrawCounter {
+    struct FrameQuery {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        bool used = false;
+    };
+
+    VkDevice device;
+    std::vector<FrameQuery> frames;
+    uint64_t fragmentCount = 0;
+    uint64_t frameCount = 0;
+
+public:
+    OverdrawCounter(VkDevice device, uint32_t framesInFlight) : device(device), frames(framesInFlight) {
+        for (auto &frame : frames) {
+            VkQueryPoolCreateInfo queryPoolInfo{};
+            queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            queryPoolInfo.queryCount = 1;
+            queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+            if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frame.queryPool) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create pipeline statistics query pool");
+            }
+        }
+    }
+
+    ~OverdrawCounter() {
+        for (auto &frame : frames) {
+            vkDestroyQueryPool(device, frame.queryPool, nullptr);
+        }
+    }
+
+    OverdrawCounter(const OverdrawCounter &) = delete;
+    OverdrawCounter &operator=(const OverdrawCounter &) = delete;
+
+    // Same rules as GpuProfiler::beginFrame(). The query has to be active around the whole render pass rather than
+    // inside it, so it also covers secondary command buffers
+    void begin(VkCommandBuffer commandBuffer, uint32_t frame) {
+        FrameQuery &query = frames[frame];
+        collect(query);
+
+        vkCmdResetQueryPool(commandBuffer, query.queryPool, 0, 1);
+        vkCmdBeginQuery(commandBuffer, query.queryPool, 0, 0);
+        query.used = true;
+    }
+
+    void end(VkCommandBuffer commandBuffer, uint32_t frame) {
+        vkCmdEndQuery(commandBuffer, frames[frame].queryPool, 0);
+    }
+
+    // Picks up the frames still sitting in their slots. Only once the device is idle
+    void collectAll() {
+        for (auto &frame : frames) collect(frame);
+    }
+
+    // Average over every frame collected since the last reset()
+    double fragmentsPerFrame() const {
+        return frameCount == 0 ? 0.0 : static_cast<double>(fragmentCount) / static_cast<double>(frameCount);
+    }
+
+    void reset() {
+        fragmentCount = 0;
+        frameCount = 0;
+    }
+
+private:
+    void collect(FrameQuery &query) {
+        if (!query.used) return;
+
+        uint64_t result[2] = {};  // Invocations, availability
+        vkGetQueryPoolResults(device, query.queryPool, 0, 1, sizeof(result), result, sizeof(result),
+                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result[1] != 0) {
+            fragmentCount += result[0];
+            frameCount++;
+        }
+        query.used = false;
+    }
+};
@@ -0,0 +1,543 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "VulkanHandle.h"
+
+// Everything a pass can do to a resource that leaves something behind for a later access to wait for
+const VkAccessFlags2 RENDER_GRAPH_WRITE_ACCESS =
+    VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+    VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+// Where a resource is used: in which stages, how, and for images in which layout
+struct ResourceState {
+    VkPipelineStageFlags2 stageMask = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 accessMask = VK_ACCESS_2_NONE;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;  // Images only
+};
+
+// One resource a pass touches. A pass lists every resource at most once, with all the ways it uses it
+struct RenderGraphAccess {
+    uint32_t resource;
+    ResourceState state;
+
+    // Set when the pass transitions the image itself, like a VkRenderPass through its attachment descriptions: the
+    // layout it leaves the image in. The graph still waits for earlier accesses, but leaves the layout alone
+    VkImageLayout passFinalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+// An image that only lives within the frame. The graph creates it and gives its memory to other transient images
+// whose passes don't overlap with its own
+struct TransientImageInfo {
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspectMask;
+};
+
+// The frame as a list of passes that declare what they read and write. compile() works out, once, everything that
+// recording a frame then only has to replay:
+//
+// - The barriers between passes. A resource that was written gets one barrier before the first pass that reads it,
+//   covering every pass that reads it before it is written again; a write after reads only waits for their stages;
+//   and reads of something already visible need nothing at all. All barriers in front of a pass go in a single
+//   vkCmdPipelineBarrier2, with one global memory barrier for every buffer
+// - Which passes are needed. Working back from the outputs (imported resources with a final state, or marked as
+//   output), a pass that writes nothing that is read later is never recorded
+// - Memory for the transient images. Images whose first to last pass don't overlap share one allocation. The first
+//   pass that uses one waits for the last pass that used its memory, so this also covers the previous frame
+//
+// Barriers only cover the graph's own command buffer. Anything the frame shares with other submissions or the
+// presentation engine is ordered by semaphores, which the initial and final states of imported resources line up with
+class RenderGraph {
+    struct Resource {
+        std::string name;
+        bool isImage;
+        VkImageAspectFlags aspectMask = 0;
+        ResourceState initialState;  // Imported: how the frame finds it
+        ResourceState finalState;    // Imported: how the frame has to leave it. Nothing in it means anything goes
+        bool output = false;
+        VkImage image = VK_NULL_HANDLE;  // Imported images are set every frame, transient ones by compile()
+
+        bool transient = false;
+        TransientImageInfo transientInfo{};
+        UniqueImageView imageView;
+        VkMemoryRequirements memoryRequirements{};
+        uint32_t aliasGroup = UINT32_MAX;
+        uint32_t firstPass = UINT32_MAX;  // Lifetime, in kept passes
+        uint32_t lastPass = 0;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<RenderGraphAccess> accesses;
+        std::function<void(VkCommandBuffer)> record;
+        bool culled = false;
+    };
+
+    struct ImageBarrier {
+        uint32_t resource;
+        VkImageMemoryBarrier2 barrier;  // Without the image, which may change every frame
+    };
+
+    // Recorded in front of a pass, or after the last one
+    struct BarrierBatch {
+        VkMemoryBarrier2 memoryBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+        std::vector<ImageBarrier> imageBarriers;
+
+        bool empty() const { return memoryBarrier.srcStageMask == 0 && imageBarriers.empty(); }
+    };
+
+    // Transient images sharing memory, which is allocated for the largest of them
+    struct AliasGroup {
+        std::vector<uint32_t> images;  // In pass order
+        Allocation allocation;
+    };
+
+    // What compile() knows about a resource at a point in the frame
+    struct Tracked {
+        VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;  // Of the last write
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;  // Since the last write
+        VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;  // The last write is already visible to these
+        VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    VkDevice device;
+    DeviceMemoryAllocator &allocator;
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<uint32_t> keptPasses;  // Indices into `passes`, in order
+    std::vector<BarrierBatch> passBarriers;  // Parallel to `keptPasses`
+    BarrierBatch finalBarriers;
+    std::vector<AliasGroup> aliasGroups;
+    bool compiled = false;
+
+public:
+    RenderGraph(VkDevice device, DeviceMemoryAllocator &allocator) : device(device), allocator(allocator) {}
+
+    // Only once the GPU is done with the transient images, e.g. from the deletion queue
+    ~RenderGraph() {
+        for (auto &resource : resources) {
+            resource.imageView = {};
+            if (resource.transient && resource.image != VK_NULL_HANDLE) vkDestroyImage(device, resource.image, nullptr);
+        }
+        for (auto &group : aliasGroups) allocator.free(group.allocation);
+    }
+
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    // `initialState` is what the frame has to wait for before its first access, e.g. the stage the acquire semaphore
+    // is waited at, and `finalState` what the frame has to leave behind, e.g. PRESENT_SRC_KHR
+    uint32_t importImage(const std::string &name, VkImageAspectFlags aspectMask, const ResourceState &initialState,
+                         const ResourceState &finalState = {}) {
+        Resource resource;
+        resource.name = name;
+        resource.isImage = true;
+        resource.aspectMask = aspectMask;
+        resource.initialState = initialState;
+        resource.finalState = finalState;
+        return addResource(std::move(resource));
+    }
+
+    uint32_t importBuffer(const std::string &name, const ResourceState &initialState,
+                          const ResourceState &finalState = {}) {
+        Resource resource;
+        resource.name = name;
+        resource.isImage = false;
+        resource.initialState = initialState;
+        resource.finalState = finalState;
+        return addResource(std::move(resource));
+    }
+
+    uint32_t createImage(const std::string &name, const TransientImageInfo &info) {
+        Resource resource;
+        resource.name = name;
+        resource.isImage = true;
+        resource.aspectMask = info.aspectMask;
+        resource.transient = true;
+        resource.transientInfo = info;
+        return addResource(std::move(resource));
+    }
+
+    // Keeps the passes writing `resource` even though nothing in the frame reads it, e.g. because the next frame does
+    void markOutput(uint32_t resource) { resources[resource].output = true; }
+
+    // Passes run in the order they are added
+    void addPass(const std::string &name, std::vector<RenderGraphAccess> accesses,
+                 std::function<void(VkCommandBuffer)> record) {
+        if (compiled) throw std::runtime_error("Render graph passes have to be added before it is compiled");
+        passes.push_back({name, std::move(accesses), std::move(record)});
+    }
+
+    void compile() {
+        if (compiled) throw std::runtime_error("Render graph is already compiled");
+        cullPasses();
+        createTransientImages();
+        computeBarriers();
+        compiled = true;
+    }
+
+    // Imported images can be a different one every frame, e.g. the acquired swap chain image
+    void setImage(uint32_t resource, VkImage image) { resources[resource].image = image; }
+
+    // Transient images exist once the graph is compiled, and stay the same until it is destroyed
+    VkImage image(uint32_t resource) const { return resources[resource].image; }
+    VkImageView imageView(uint32_t resource) const { return resources[resource].imageView; }
+
+    void execute(VkCommandBuffer commandBuffer) {
+        for (size_t i = 0; i < keptPasses.size(); i++) {
+            recordBarriers(commandBuffer, passBarriers[i]);
+            passes[keptPasses[i]].record(commandBuffer);
+        }
+        recordBarriers(commandBuffer, finalBarriers);
+    }
+
+    // One line, e.g. for the log whenever the graph is rebuilt
+    void printSummary(std::ostream &out) const {
+        uint32_t barrierCount = countBarriers(finalBarriers);
+        for (auto &batch : passBarriers) barrierCount += countBarriers(batch);
+
+        VkDeviceSize aliasedBytes = 0;
+        VkDeviceSize transientBytes = 0;
+        for (auto &group : aliasGroups) {
+            aliasedBytes += group.allocation.size;
+            for (uint32_t image : group.images) transientBytes += resources[image].memoryRequirements.size;
+        }
+
+        out << "Render graph: " << keptPasses.size() << " passes (" << passes.size() - keptPasses.size()
+            << " culled), " << barrierCount << " barriers per frame, " << (aliasedBytes >> 10)
+            << " KiB of transient images (" << (transientBytes >> 10) << " KiB without aliasing)\n";
+    }
+
+private:
+    uint32_t addResource(Resource resource) {
+        if (compiled) throw std::runtime_error("Render graph resources have to be added before it is compiled");
+        resources.push_back(std::move(resource));
+        return static_cast<uint32_t>(resources.size() - 1);
+    }
+
+    static bool isWrite(const ResourceState &state) { return (state.accessMask & RENDER_GRAPH_WRITE_ACCESS) != 0; }
+
+    static bool hasFinalState(const Resource &resource) {
+        return resource.finalState.stageMask != VK_PIPELINE_STAGE_2_NONE ||
+               resource.finalState.layout != VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    // Backwards from the outputs: a pass is needed if it writes something that is needed, and then everything it
+    // reads is needed as well. Passes without any write can't be reasoned about and are always kept
+    void cullPasses() {
+        std::vector<bool> needed(resources.size());
+        for (size_t i = 0; i < resources.size(); i++) needed[i] = resources[i].output || hasFinalState(resources[i]);
+
+        for (size_t i = passes.size(); i-- > 0;) {
+            Pass &pass = passes[i];
+            bool writes = false;
+            bool writesNeeded = false;
+            for (auto &access : pass.accesses) {
+                if (!isWrite(access.state)) continue;
+                writes = true;
+                writesNeeded = writesNeeded || needed[access.resource];
+            }
+
+            pass.culled = writes && !writesNeeded;
+            if (pass.culled) continue;
+            for (auto &access : pass.accesses) needed[access.resource] = true;
+        }
+
+        for (uint32_t i = 0; i < passes.size(); i++) {
+            if (passes[i].culled) continue;
+            uint32_t kept = static_cast<uint32_t>(keptPasses.size());
+            keptPasses.push_back(i);
+            for (auto &access : passes[i].accesses) {
+                Resource &resource = resources[access.resource];
+                resource.firstPass = std::min(resource.firstPass, kept);
+                resource.lastPass = std::max(resource.lastPass, kept);
+            }
+        }
+    }
+
+    // Largest first, each into the first group none of whose images is alive at the same time and whose memory it can
+    // live in. Transient attachments only share with each other, since they go into lazily allocated memory if the
+    // device has any, which nothing else can use
+    void createTransientImages() {
+        std::vector<uint32_t> images;
+        for (uint32_t i = 0; i < resources.size(); i++) {
+            Resource &resource = resources[i];
+            if (!resource.transient || resource.firstPass == UINT32_MAX) continue;  // Only used by culled passes
+
+            const TransientImageInfo &info = resource.transientInfo;
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = info.format;
+            imageInfo.extent = {info.extent.width, info.extent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = info.usage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create transient image " + resource.name);
+            }
+            vkGetImageMemoryRequirements(device, resource.image, &resource.memoryRequirements);
+            images.push_back(i);
+        }
+
+        std::sort(images.begin(), images.end(), [&](uint32_t a, uint32_t b) {
+            return resources[a].memoryRequirements.size > resources[b].memoryRequirements.size;
+        });
+
+        std::vector<VkMemoryRequirements> groupRequirements;
+        for (uint32_t image : images) {
+            Resource &resource = resources[image];
+            bool lazy = resource.transientInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+            for (uint32_t group = 0; group < aliasGroups.size() && resource.aliasGroup == UINT32_MAX; group++) {
+                const Resource &first = resources[aliasGroups[group].images.front()];
+                bool sameKind = lazy == bool(first.transientInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+                uint32_t memoryTypes =
+                    groupRequirements[group].memoryTypeBits & resource.memoryRequirements.memoryTypeBits;
+                bool overlaps = std::any_of(aliasGroups[group].images.begin(), aliasGroups[group].images.end(),
+                                            [&](uint32_t other) {
+                                                return resources[other].firstPass <= resource.lastPass &&
+                                                       resource.firstPass <= resources[other].lastPass;
+                                            });
+                if (!sameKind || memoryTypes == 0 || overlaps) continue;
+
+                resource.aliasGroup = group;
+                aliasGroups[group].images.push_back(image);
+                groupRequirements[group].memoryTypeBits = memoryTypes;
+                groupRequirements[group].alignment =
+                    std::max(groupRequirements[group].alignment, resource.memoryRequirements.alignment);
+            }
+
+            if (resource.aliasGroup == UINT32_MAX) {
+                resource.aliasGroup = static_cast<uint32_t>(aliasGroups.size());
+                aliasGroups.push_back({{image}, {}});
+                groupRequirements.push_back(resource.memoryRequirements);  // The largest, so the group's size
+            }
+        }
+
+        const VkPhysicalDeviceMemoryProperties &memoryProperties = allocator.getMemoryProperties();
+        for (uint32_t group = 0; group < aliasGroups.size(); group++) {
+            AliasGroup &aliasGroup = aliasGroups[group];
+            std::sort(aliasGroup.images.begin(), aliasGroup.images.end(),
+                      [&](uint32_t a, uint32_t b) { return resources[a].firstPass < resources[b].firstPass; });
+
+            VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            bool lazy = resources[aliasGroup.images.front()].transientInfo.usage &
+                        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount && lazy; i++) {
+                if ((groupRequirements[group].memoryTypeBits & (1u << i)) &&
+                    (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+                    properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+                    break;
+                }
+            }
+            aliasGroup.allocation = allocator.allocate(groupRequirements[group], properties, false);
+
+            for (uint32_t image : aliasGroup.images) {
+                Resource &resource = resources[image];
+                vkBindImageMemory(device, resource.image, aliasGroup.allocation.memory, aliasGroup.allocation.offset);
+
+                VkImageViewCreateInfo viewInfo{};
+                viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+                viewInfo.image = resource.image;
+                viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+                viewInfo.format = resource.transientInfo.format;
+                viewInfo.subresourceRange.aspectMask = resource.aspectMask;
+                viewInfo.subresourceRange.levelCount = 1;
+                viewInfo.subresourceRange.layerCount = 1;
+
+                if (vkCreateImageView(device, &viewInfo, nullptr, resource.imageView.put(device)) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create transient image view " + resource.name);
+                }
+            }
+        }
+    }
+
+    // The last access of `resource` in the frame, ignoring the ones its pass synchronizes itself
+    ResourceState lastAccess(uint32_t resource) const {
+        for (size_t i = keptPasses.size(); i-- > 0;) {
+            for (auto &access : passes[keptPasses[i]].accesses) {
+                if (access.resource == resource) return access.state;
+            }
+        }
+        return {};
+    }
+
+    // Reads are only waited for by later writes, writes by everything after them
+    static Tracked trackedFrom(const ResourceState &state) {
+        Tracked tracked;
+        if (isWrite(state)) {
+            tracked.writeStages = state.stageMask;
+            tracked.writeAccess = state.accessMask & RENDER_GRAPH_WRITE_ACCESS;
+        } else {
+            tracked.readStages = state.stageMask;
+        }
+        tracked.layout = state.layout;
+        return tracked;
+    }
+
+    void computeBarriers() {
+        // A transient image starts out waiting for whatever last used its memory: the image before it in its alias
+        // group, or for the first one the last image of the group in the previous frame. Its contents never carry over
+        std::vector<Tracked> tracked(resources.size());
+        for (uint32_t i = 0; i < resources.size(); i++) {
+            const Resource &resource = resources[i];
+            if (!resource.transient) {
+                tracked[i] = trackedFrom(resource.initialState);
+            } else if (resource.aliasGroup != UINT32_MAX) {
+                const std::vector<uint32_t> &group = aliasGroups[resource.aliasGroup].images;
+                size_t position = std::find(group.begin(), group.end(), i) - group.begin();
+                uint32_t previous = group[(position + group.size() - 1) % group.size()];
+                tracked[i] = trackedFrom(lastAccess(previous));
+                tracked[i].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            }
+        }
+
+        passBarriers.resize(keptPasses.size());
+        for (size_t i = 0; i < keptPasses.size(); i++) {
+            BarrierBatch &batch = passBarriers[i];
+            for (auto &access : passes[keptPasses[i]].accesses) {
+                Tracked &state = tracked[access.resource];
+                ResourceState wanted = access.state;
+                if (access.passFinalLayout != VK_IMAGE_LAYOUT_UNDEFINED) wanted.layout = state.layout;
+                addBarrier(batch, access.resource, state, wanted, i);
+                if (access.passFinalLayout != VK_IMAGE_LAYOUT_UNDEFINED) state.layout = access.passFinalLayout;
+            }
+        }
+
+        for (uint32_t i = 0; i < resources.size(); i++) {
+            if (!resources[i].transient && hasFinalState(resources[i])) {
+                addBarrier(finalBarriers, i, tracked[i], resources[i].finalState, keptPasses.size());
+            }
+        }
+    }
+
+    // Brings `state` up to `access`, adding whatever that takes to `batch`. `passIndex` is the kept pass the access
+    // belongs to, or one past the last for the final state
+    void addBarrier(BarrierBatch &batch, uint32_t resource, Tracked &state, const ResourceState &access,
+                    size_t passIndex) {
+        const Resource &info = resources[resource];
+        bool layoutChange = info.isImage && access.layout != VK_IMAGE_LAYOUT_UNDEFINED && access.layout != state.layout;
+
+        if (layoutChange) {
+            ImageBarrier imageBarrier{resource, {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2}};
+            VkImageMemoryBarrier2 &barrier = imageBarrier.barrier;
+            barrier.srcStageMask = state.writeStages | state.readStages;
+            barrier.srcAccessMask = state.writeAccess;
+            barrier.dstStageMask = access.stageMask;
+            barrier.dstAccessMask = access.accessMask;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = access.layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange.aspectMask = info.aspectMask;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.layerCount = 1;
+            batch.imageBarriers.push_back(imageBarrier);
+
+            // The transition counts as a write that is already visible to this access
+            state = trackedFrom(access);
+            state.writeStages = access.stageMask;
+            state.visibleStages = access.stageMask;
+            state.visibleAccess = access.accessMask;
+            state.layout = access.layout;
+            return;
+        }
+
+        if (isWrite(access)) {
+            // Earlier reads only have to be done (no memory dependency), earlier writes also made available
+            VkPipelineStageFlags2 srcStages = state.writeStages | state.readStages;
+            if (srcStages != VK_PIPELINE_STAGE_2_NONE) {
+                addMemoryBarrier(batch, srcStages, state.writeAccess, access.stageMask, access.accessMask);
+            }
+            VkImageLayout layout = state.layout;
+            state = trackedFrom(access);
+            state.layout = layout;
+            return;
+        }
+
+        // Reads without a stage happen outside the command buffer, after a semaphore the submit signals
+        bool visible =
+            (access.stageMask & ~state.visibleStages) == 0 && (access.accessMask & ~state.visibleAccess) == 0;
+        bool written = state.writeStages != VK_PIPELINE_STAGE_2_NONE;
+        if (written && access.stageMask != VK_PIPELINE_STAGE_2_NONE && !visible) {
+            // One barrier for this and every later read up to the next write, instead of one per reading pass
+            ResourceState reads = access;
+            for (size_t later = passIndex + 1; later < keptPasses.size(); later++) {
+                const RenderGraphAccess *next = findAccess(keptPasses[later], resource);
+                if (next == nullptr) continue;
+                if (isWrite(next->state) || next->passFinalLayout != VK_IMAGE_LAYOUT_UNDEFINED ||
+                    (info.isImage && next->state.layout != state.layout)) {
+                    break;
+                }
+                reads.stageMask |= next->state.stageMask;
+                reads.accessMask |= next->state.accessMask;
+            }
+
+            addMemoryBarrier(batch, state.writeStages, state.writeAccess, reads.stageMask, reads.accessMask);
+            state.visibleStages |= reads.stageMask;
+            state.visibleAccess |= reads.accessMask;
+        }
+        state.readStages |= access.stageMask;
+    }
+
+    const RenderGraphAccess *findAccess(uint32_t pass, uint32_t resource) const {
+        for (auto &access : passes[pass].accesses) {
+            if (access.resource == resource) return &access;
+        }
+        return nullptr;
+    }
+
+    static void addMemoryBarrier(BarrierBatch &batch, VkPipelineStageFlags2 srcStageMask,
+                                 VkAccessFlags2 srcAccessMask, VkPipelineStageFlags2 dstStageMask,
+                                 VkAccessFlags2 dstAccessMask) {
+        batch.memoryBarrier.srcStageMask |= srcStageMask;
+        batch.memoryBarrier.srcAccessMask |= srcAccessMask;
+        batch.memoryBarrier.dstStageMask |= dstStageMask;
+        batch.memoryBarrier.dstAccessMask |= dstAccessMask;
+    }
+
+    static uint32_t countBarriers(const BarrierBatch &batch) {
+        return (batch.memoryBarrier.srcStageMask != 0 ? 1 : 0) + static_cast<uint32_t>(batch.imageBarriers.size());
+    }
+
+    void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch &batch) {
+        if (batch.empty()) return;
+
+        std::vector<VkImageMemoryBarrier2> imageBarriers;
+        imageBarriers.reserve(batch.imageBarriers.size());
+        for (auto &imageBarrier : batch.imageBarriers) {
+            imageBarriers.push_back(imageBarrier.barrier);
+            imageBarriers.back().image = resources[imageBarrier.resource].image;
+        }
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        if (batch.memoryBarrier.srcStageMask != 0) {
+            dependencyInfo.memoryBarrierCount = 1;
+            dependencyInfo.pMemoryBarriers = &batch.memoryBarrier;
+        }
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+};
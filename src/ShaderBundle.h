@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Every SPIR-V module of the application in one file:
+//
+//   ShaderBundleHeader
+//   ShaderBundleEntry[entryCount]
+//   SPIR-V words of every entry, each starting on a 4 byte boundary
+//
+// Offsets are from the start of the bundle. Since the bundle itself is either mmapped (page aligned) or embedded as a
+// uint32_t array, every module can be handed to vkCreateShaderModule straight from where it lies, without a copy
+const uint32_t SHADER_BUNDLE_MAGIC = 0x42565053;  // "SPVB"
+const uint32_t SHADER_BUNDLE_VERSION = 1;
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+struct ShaderBundleHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+struct ShaderBundleEntry {
+    char name[56];  // Null terminated, e.g. "shader.vert"
+    uint32_t offset;
+    uint32_t size;  // In bytes, always a multiple of 4
+};
+
+static_assert(sizeof(ShaderBundleHeader) % 4 == 0 && sizeof(ShaderBundleEntry) % 4 == 0);
+
+// Read-only view of a bundle, either mapped from a file or pointing at memory that outlives it (an embedded bundle)
+class ShaderBundle {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    void *mapping = nullptr;
+#endif
+
+public:
+    // Maps the file; nothing is read until a module is looked up, and then only the pages it touches
+    explicit ShaderBundle(const std::string &filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open shader bundle: " + filename);
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        size = static_cast<size_t>(fileSize.QuadPart);
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr) {
+            unmap();
+            throw std::runtime_error("Failed to map shader bundle: " + filename);
+        }
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Failed to open shader bundle: " + filename);
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+            size = static_cast<size_t>(fileStat.st_size);
+            mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);  // The mapping keeps the file alive
+
+        if (mapping == nullptr || mapping == MAP_FAILED) {
+            mapping = nullptr;
+            throw std::runtime_error("Failed to map shader bundle: " + filename);
+        }
+        data = static_cast<const uint8_t *>(mapping);
+#endif
+
+        try {
+            validate();
+        } catch (...) {
+            unmap();
+            throw;
+        }
+    }
+
+    // Wraps a bundle that is already in memory. `bundle` must be 4 byte aligned and outlive this object
+    ShaderBundle(const void *bundle, size_t bundleSize) : data(static_cast<const uint8_t *>(bundle)), size(bundleSize) {
+        validate();
+    }
+
+    ~ShaderBundle() { unmap(); }
+
+    ShaderBundle(const ShaderBundle &) = delete;
+    ShaderBundle &operator=(const ShaderBundle &) = delete;
+
+    std::vector<std::string> names() const {
+        std::vector<std::string> result;
+        for (auto &entry : entries()) result.emplace_back(entry.name);
+        return result;
+    }
+
+    // The SPIR-V words of a module, pointing into the bundle
+    std::span<const uint32_t> find(std::string_view name) const {
+        for (auto &entry : entries()) {
+            if (name == entry.name) {
+                return {reinterpret_cast<const uint32_t *>(data + entry.offset), entry.size / sizeof(uint32_t)};
+            }
+        }
+
+        throw std::runtime_error("Shader not found in bundle: " + std::string(name));
+    }
+
+private:
+    std::span<const ShaderBundleEntry> entries() const {
+        auto header = reinterpret_cast<const ShaderBundleHeader *>(data);
+        return {reinterpret_cast<const ShaderBundleEntry *>(data + sizeof(ShaderBundleHeader)), header->entryCount};
+    }
+
+    // Everything is checked once up front so lookups can trust the offsets
+    void validate() const {
+        if (reinterpret_cast<uintptr_t>(data) % 4 != 0) throw std::runtime_error("Shader bundle is not 4 byte aligned");
+        if (size < sizeof(ShaderBundleHeader)) throw std::runtime_error("Shader bundle is truncated");
+
+        auto header = reinterpret_cast<const ShaderBundleHeader *>(data);
+        if (header->magic != SHADER_BUNDLE_MAGIC || header->version != SHADER_BUNDLE_VERSION) {
+            throw std::runtime_error("Not a shader bundle, or built by an incompatible version");
+        }
+        if (sizeof(ShaderBundleHeader) + static_cast<size_t>(header->entryCount) * sizeof(ShaderBundleEntry) > size) {
+            throw std::runtime_error("Shader bundle index is truncated");
+        }
+
+        for (auto &entry : entries()) {
+            if (std::memchr(entry.name, '\0', sizeof(entry.name)) == nullptr || entry.offset % 4 != 0 ||
+                entry.size % 4 != 0 || entry.size < 4 || static_cast<size_t>(entry.offset) + entry.size > size ||
+                *reinterpret_cast<const uint32_t *>(data + entry.offset) != SPIRV_MAGIC) {
+                throw std::runtime_error("Shader bundle contains an invalid entry");
+            }
+        }
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (mapping != nullptr && data != nullptr) UnmapViewOfFile(data);
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (mapping != nullptr) munmap(mapping, size);
+        mapping = nullptr;
+#endif
+        data = nullptr;
+    }
+};
+
+// Lays out a bundle in memory, as words so the result is aligned however it ends up being stored. Used by the packing
+// tool at build time
+inline std::vector<uint32_t> buildShaderBundle(
+    const std::vector<std::pair<std::string, std::vector<uint32_t>>> &modules) {
+    size_t headerWords = (sizeof(ShaderBundleHeader) + modules.size() * sizeof(ShaderBundleEntry)) / sizeof(uint32_t);
+    size_t totalWords = headerWords;
+    for (auto &[name, code] : modules) totalWords += code.size();
+
+    std::vector<uint32_t> bundle(totalWords, 0);
+
+    ShaderBundleHeader header{SHADER_BUNDLE_MAGIC, SHADER_BUNDLE_VERSION, static_cast<uint32_t>(modules.size()), 0};
+    std::memcpy(bundle.data(), &header, sizeof(header));
+
+    size_t nextWord = headerWords;
+    for (size_t i = 0; i < modules.size(); i++) {
+        auto &[name, code] = modules[i];
+        if (name.size() >= sizeof(ShaderBundleEntry::name)) throw std::runtime_error("Shader name too long: " + name);
+        if (code.empty() || code[0] != SPIRV_MAGIC) throw std::runtime_error("Not a SPIR-V module: " + name);
+
+        ShaderBundleEntry entry{};
+        std::memcpy(entry.name, name.data(), name.size());
+        entry.offset = static_cast<uint32_t>(nextWord * sizeof(uint32_t));
+        entry.size = static_cast<uint32_t>(code.size() * sizeof(uint32_t));
+        std::memcpy(reinterpret_cast<uint8_t *>(bundle.data()) + sizeof(ShaderBundleHeader) +
+                        i * sizeof(ShaderBundleEntry),
+                    &entry, sizeof(entry));
+
+        std::memcpy(bundle.data() + nextWord, code.data(), entry.size);
+        nextWord += code.size();
+    }
+
+    return bundle;
+}
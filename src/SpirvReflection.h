@@ -0,0 +1,477 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Just enough of a SPIR-V parser to recover the interface of a shader: what the vertex stage reads, which descriptors
+// and push constants it uses and which specialization constants it declares. Pipeline layouts and vertex input state
+// are built from this instead of being written by hand next to the shaders
+struct ReflectedVertexInput {
+    uint32_t location;
+    VkFormat format;
+    std::string name;
+};
+
+struct ReflectedDescriptorBinding {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType descriptorType;
+    uint32_t descriptorCount;  // 0 for runtime sized arrays
+    std::string name;
+};
+
+struct ReflectedSpecializationConstant {
+    uint32_t constantId;
+    std::string name;
+    uint32_t defaultValue;  // Raw 32 bits; bools are VkBool32
+};
+
+struct ShaderReflection {
+    VkShaderStageFlagBits stage;
+    std::string entryPoint;
+    std::vector<ReflectedVertexInput> vertexInputs;  // Sorted by location, vertex stage only
+    std::vector<ReflectedDescriptorBinding> descriptorBindings;
+    uint32_t pushConstantOffset = 0;
+    uint32_t pushConstantSize = 0;  // 0 if the stage has no push constant block
+    std::vector<ReflectedSpecializationConstant> specializationConstants;
+};
+
+namespace spirv {
+// The few opcodes, decorations and enums we look at, from the SPIR-V specification
+enum Op : uint32_t {
+    OpName = 5,
+    OpEntryPoint = 15,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpSpecConstantTrue = 48,
+    OpSpecConstantFalse = 49,
+    OpSpecConstant = 50,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpTypeAccelerationStructureKHR = 5341,
+};
+
+enum Decoration : uint32_t {
+    SpecId = 1,
+    Block = 2,
+    BufferBlock = 3,
+    ArrayStride = 6,
+    MatrixStride = 7,
+    BuiltIn = 11,
+    Location = 30,
+    Binding = 33,
+    DescriptorSet = 34,
+    Offset = 35,
+};
+
+enum StorageClass : uint32_t {
+    UniformConstant = 0,
+    Input = 1,
+    Uniform = 2,
+    PushConstant = 9,
+    StorageBuffer = 12,
+};
+
+enum Dim : uint32_t {
+    DimBuffer = 5,
+    DimSubpassData = 6,
+};
+}  // namespace spirv
+
+class SpirvReflector {
+    struct Type {
+        uint32_t opcode = 0;
+        std::vector<uint32_t> operands;  // Everything after the result id
+    };
+
+    // Decoration -> first literal, for the id itself and per struct member
+    struct Decorations {
+        std::unordered_map<uint32_t, uint32_t> values;
+        std::unordered_map<uint32_t, std::unordered_map<uint32_t, uint32_t>> members;
+    };
+
+    struct Variable {
+        uint32_t id;
+        uint32_t pointerType;
+        uint32_t storageClass;
+    };
+
+    std::unordered_map<uint32_t, Type> types;
+    std::unordered_map<uint32_t, uint32_t> constants;  // Result id -> first word of the value
+    std::unordered_map<uint32_t, Decorations> decorations;
+    std::unordered_map<uint32_t, std::string> names;
+    std::vector<Variable> variables;
+    std::vector<uint32_t> specConstants;
+    uint32_t executionModel = UINT32_MAX;
+    std::string entryPoint;
+
+public:
+    explicit SpirvReflector(std::span<const uint32_t> code) { parse(code); }
+
+    ShaderReflection reflect() const {
+        ShaderReflection reflection;
+        reflection.stage = stageFlag();
+        reflection.entryPoint = entryPoint;
+
+        for (auto &variable : variables) {
+            const Type &pointer = typeOf(variable.pointerType);
+            uint32_t pointee = pointer.operands[1];
+
+            switch (variable.storageClass) {
+                case spirv::Input:
+                    if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT && !isBuiltIn(variable.id, pointee)) {
+                        reflection.vertexInputs.push_back(
+                            {decoration(variable.id, spirv::Location), vertexFormat(pointee), nameOf(variable.id)});
+                    }
+                    break;
+                case spirv::UniformConstant:
+                case spirv::Uniform:
+                case spirv::StorageBuffer:
+                    reflection.descriptorBindings.push_back(descriptorBinding(variable, pointee));
+                    break;
+                case spirv::PushConstant:
+                    structRange(pointee, reflection.pushConstantOffset, reflection.pushConstantSize);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        for (uint32_t id : specConstants) {
+            if (!hasDecoration(id, spirv::SpecId)) continue;
+            reflection.specializationConstants.push_back(
+                {decoration(id, spirv::SpecId), nameOf(id), constants.count(id) ? constants.at(id) : 0});
+        }
+
+        std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(),
+                  [](auto &a, auto &b) { return a.location < b.location; });
+        std::sort(reflection.descriptorBindings.begin(), reflection.descriptorBindings.end(), [](auto &a, auto &b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+        std::sort(reflection.specializationConstants.begin(), reflection.specializationConstants.end(),
+                  [](auto &a, auto &b) { return a.constantId < b.constantId; });
+
+        return reflection;
+    }
+
+private:
+    void parse(std::span<const uint32_t> code) {
+        if (code.size() < 5 || code[0] != 0x07230203) throw std::runtime_error("Not a SPIR-V module");
+
+        for (size_t i = 5; i < code.size();) {
+            uint32_t wordCount = code[i] >> 16;
+            uint32_t opcode = code[i] & 0xFFFF;
+            if (wordCount == 0 || i + wordCount > code.size()) throw std::runtime_error("Malformed SPIR-V module");
+            std::span<const uint32_t> operands = code.subspan(i + 1, wordCount - 1);
+
+            switch (opcode) {
+                case spirv::OpName:
+                    names[operands[0]] = literalString(operands.subspan(1));
+                    break;
+                case spirv::OpEntryPoint:
+                    // Only single entry point modules, which is all glslc produces
+                    executionModel = operands[0];
+                    entryPoint = literalString(operands.subspan(2));
+                    break;
+                case spirv::OpTypeBool:
+                case spirv::OpTypeInt:
+                case spirv::OpTypeFloat:
+                case spirv::OpTypeVector:
+                case spirv::OpTypeMatrix:
+                case spirv::OpTypeImage:
+                case spirv::OpTypeSampler:
+                case spirv::OpTypeSampledImage:
+                case spirv::OpTypeArray:
+                case spirv::OpTypeRuntimeArray:
+                case spirv::OpTypeStruct:
+                case spirv::OpTypePointer:
+                case spirv::OpTypeAccelerationStructureKHR:
+                    types[operands[0]] = {opcode, std::vector<uint32_t>(operands.begin() + 1, operands.end())};
+                    break;
+                case spirv::OpConstant:
+                    constants[operands[1]] = operands[2];
+                    break;
+                case spirv::OpSpecConstant:
+                    constants[operands[1]] = operands[2];
+                    specConstants.push_back(operands[1]);
+                    break;
+                case spirv::OpSpecConstantTrue:
+                case spirv::OpSpecConstantFalse:
+                    constants[operands[1]] = opcode == spirv::OpSpecConstantTrue ? VK_TRUE : VK_FALSE;
+                    specConstants.push_back(operands[1]);
+                    break;
+                case spirv::OpVariable:
+                    variables.push_back({operands[1], operands[0], operands[2]});
+                    break;
+                case spirv::OpDecorate:
+                    decorations[operands[0]].values[operands[1]] = operands.size() > 2 ? operands[2] : 0;
+                    break;
+                case spirv::OpMemberDecorate:
+                    decorations[operands[0]].members[operands[1]][operands[2]] = operands.size() > 3 ? operands[3] : 0;
+                    break;
+                default:
+                    break;
+            }
+
+            i += wordCount;
+        }
+
+        if (executionModel == UINT32_MAX) throw std::runtime_error("SPIR-V module has no entry point");
+    }
+
+    static std::string literalString(std::span<const uint32_t> words) {
+        std::string result;
+        for (uint32_t word : words) {
+            for (int byte = 0; byte < 4; byte++) {
+                char c = static_cast<char>((word >> (byte * 8)) & 0xFF);
+                if (c == '\0') return result;
+                result.push_back(c);
+            }
+        }
+        return result;
+    }
+
+    VkShaderStageFlagBits stageFlag() const {
+        switch (executionModel) {
+            case 0:
+                return VK_SHADER_STAGE_VERTEX_BIT;
+            case 1:
+                return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case 2:
+                return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case 3:
+                return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case 4:
+                return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case 5:
+                return VK_SHADER_STAGE_COMPUTE_BIT;
+            default:
+                throw std::runtime_error("Unsupported shader stage");
+        }
+    }
+
+    const Type &typeOf(uint32_t id) const {
+        auto found = types.find(id);
+        if (found == types.end()) throw std::runtime_error("SPIR-V references an unknown type");
+        return found->second;
+    }
+
+    std::string nameOf(uint32_t id) const {
+        auto found = names.find(id);
+        return found == names.end() ? std::string() : found->second;
+    }
+
+    bool hasDecoration(uint32_t id, uint32_t which) const {
+        auto found = decorations.find(id);
+        return found != decorations.end() && found->second.values.count(which) != 0;
+    }
+
+    uint32_t decoration(uint32_t id, uint32_t which) const {
+        if (!hasDecoration(id, which)) throw std::runtime_error("SPIR-V id is missing a decoration: " + nameOf(id));
+        return decorations.at(id).values.at(which);
+    }
+
+    bool hasMemberDecoration(uint32_t structType, uint32_t member, uint32_t which) const {
+        auto found = decorations.find(structType);
+        if (found == decorations.end()) return false;
+        auto memberDecorations = found->second.members.find(member);
+        return memberDecorations != found->second.members.end() && memberDecorations->second.count(which) != 0;
+    }
+
+    // gl_VertexIndex and friends, or a block of them
+    bool isBuiltIn(uint32_t variable, uint32_t type) const {
+        if (hasDecoration(variable, spirv::BuiltIn)) return true;
+        const Type &pointee = typeOf(type);
+        return pointee.opcode == spirv::OpTypeStruct && hasMemberDecoration(type, 0, spirv::BuiltIn);
+    }
+
+    VkFormat vertexFormat(uint32_t typeId) const {
+        const Type &type = typeOf(typeId);
+        uint32_t componentCount = 1;
+        const Type *component = &type;
+        if (type.opcode == spirv::OpTypeVector) {
+            componentCount = type.operands[1];
+            component = &typeOf(type.operands[0]);
+        }
+
+        if (component->operands[0] != 32) throw std::runtime_error("Only 32 bit vertex inputs are supported");
+
+        static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+                                                VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+        static const VkFormat intFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT,
+                                              VK_FORMAT_R32G32B32A32_SINT};
+        static const VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT,
+                                               VK_FORMAT_R32G32B32A32_UINT};
+
+        if (component->opcode == spirv::OpTypeFloat) return floatFormats[componentCount - 1];
+        if (component->opcode == spirv::OpTypeInt) {
+            return component->operands[1] ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+        }
+        throw std::runtime_error("Unsupported vertex input type");
+    }
+
+    ReflectedDescriptorBinding descriptorBinding(const Variable &variable, uint32_t typeId) const {
+        ReflectedDescriptorBinding binding{};
+        binding.set = decoration(variable.id, spirv::DescriptorSet);
+        binding.binding = decoration(variable.id, spirv::Binding);
+        binding.name = nameOf(variable.id);
+        binding.descriptorCount = 1;
+
+        // Arrays of descriptors
+        const Type *type = &typeOf(typeId);
+        if (type->opcode == spirv::OpTypeArray) {
+            binding.descriptorCount = constants.at(type->operands[1]);
+            typeId = type->operands[0];
+            type = &typeOf(typeId);
+        } else if (type->opcode == spirv::OpTypeRuntimeArray) {
+            binding.descriptorCount = 0;
+            typeId = type->operands[0];
+            type = &typeOf(typeId);
+        }
+
+        if (variable.storageClass == spirv::StorageBuffer) {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        } else if (variable.storageClass == spirv::Uniform) {
+            binding.descriptorType = hasDecoration(typeId, spirv::BufferBlock) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                                                                               : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        } else if (type->opcode == spirv::OpTypeSampler) {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        } else if (type->opcode == spirv::OpTypeSampledImage) {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        } else if (type->opcode == spirv::OpTypeImage) {
+            uint32_t dim = type->operands[1];
+            bool storage = type->operands[5] == 2;  // "Sampled" operand: 1 sampled, 2 read/write
+            if (dim == spirv::DimBuffer) {
+                binding.descriptorType =
+                    storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            } else if (dim == spirv::DimSubpassData) {
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            } else {
+                binding.descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            }
+        } else if (type->opcode == spirv::OpTypeAccelerationStructureKHR) {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        } else {
+            throw std::runtime_error("Unsupported descriptor type: " + binding.name);
+        }
+
+        return binding;
+    }
+
+    // Size in bytes of a type inside an explicitly laid out block
+    uint32_t blockSize(uint32_t typeId, uint32_t matrixStride = 0) const {
+        const Type &type = typeOf(typeId);
+        switch (type.opcode) {
+            case spirv::OpTypeBool:
+                return 4;
+            case spirv::OpTypeInt:
+            case spirv::OpTypeFloat:
+                return type.operands[0] / 8;
+            case spirv::OpTypeVector:
+                return type.operands[1] * blockSize(type.operands[0]);
+            case spirv::OpTypeMatrix:
+                return type.operands[1] * (matrixStride != 0 ? matrixStride : blockSize(type.operands[0]));
+            case spirv::OpTypeArray: {
+                uint32_t stride = hasDecoration(typeId, spirv::ArrayStride) ? decoration(typeId, spirv::ArrayStride)
+                                                                            : blockSize(type.operands[0]);
+                return constants.at(type.operands[1]) * stride;
+            }
+            case spirv::OpTypeStruct: {
+                uint32_t begin, size;
+                structRange(typeId, begin, size);
+                return begin + size;
+            }
+            default:
+                throw std::runtime_error("Unsupported type in block");
+        }
+    }
+
+    // Range covered by the members of a struct, from the first member's offset to the end of the last one
+    void structRange(uint32_t structType, uint32_t &begin, uint32_t &size) const {
+        const Type &type = typeOf(structType);
+        uint32_t first = UINT32_MAX;
+        uint32_t end = 0;
+
+        for (uint32_t member = 0; member < type.operands.size(); member++) {
+            if (!hasMemberDecoration(structType, member, spirv::Offset)) {
+                throw std::runtime_error("Block member without an explicit offset");
+            }
+
+            auto &memberDecorations = decorations.at(structType).members.at(member);
+            uint32_t offset = memberDecorations.at(spirv::Offset);
+            uint32_t matrixStride =
+                memberDecorations.count(spirv::MatrixStride) ? memberDecorations.at(spirv::MatrixStride) : 0;
+
+            first = std::min(first, offset);
+            end = std::max(end, offset + blockSize(type.operands[member], matrixStride));
+        }
+
+        begin = first == UINT32_MAX ? 0 : first;
+        size = end - begin;
+    }
+};
+
+inline ShaderReflection reflectSpirv(std::span<const uint32_t> code) { return SpirvReflector(code).reflect(); }
+
+// Bytes one vertex input of the given format takes up in a vertex buffer, for the formats vertexFormat() produces
+inline uint32_t vertexFormatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32_SINT:
+        case VK_FORMAT_R32_UINT:
+            return 4;
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R32G32_SINT:
+        case VK_FORMAT_R32G32_UINT:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+        case VK_FORMAT_R32G32B32_SINT:
+        case VK_FORMAT_R32G32B32_UINT:
+            return 12;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+        case VK_FORMAT_R32G32B32A32_SINT:
+        case VK_FORMAT_R32G32B32A32_UINT:
+            return 16;
+        default:
+            throw std::runtime_error("Unsupported vertex format");
+    }
+}
+
+// Whether a pipeline layout and vertex input state built for one module also fit the other. Names are ignored, only
+// locations, formats, bindings, types and sizes matter
+inline bool hasSameInterface(const ShaderReflection &a, const ShaderReflection &b) {
+    auto sameInput = [](auto &x, auto &y) { return x.location == y.location && x.format == y.format; };
+    auto sameBinding = [](auto &x, auto &y) {
+        return x.set == y.set && x.binding == y.binding && x.descriptorType == y.descriptorType &&
+               x.descriptorCount == y.descriptorCount;
+    };
+    auto sameConstant = [](auto &x, auto &y) { return x.constantId == y.constantId; };
+
+    return a.stage == b.stage && a.entryPoint == b.entryPoint &&
+           std::equal(a.vertexInputs.begin(), a.vertexInputs.end(), b.vertexInputs.begin(), b.vertexInputs.end(),
+                      sameInput) &&
+           std::equal(a.descriptorBindings.begin(), a.descriptorBindings.end(), b.descriptorBindings.begin(),
+                      b.descriptorBindings.end(), sameBinding) &&
+           a.pushConstantOffset == b.pushConstantOffset && a.pushConstantSize == b.pushConstantSize &&
+           std::equal(a.specializationConstants.begin(), a.specializationConstants.end(),
+                      b.specializationConstants.begin(), b.specializationConstants.end(), sameConstant);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "TimelineSemaphore.h"
+
+const VkDeviceSize DEFAULT_STAGING_RING_SIZE = 16 * 1024 * 1024;
+const uint32_t STAGING_RING_SEGMENTS = 4;
+
+// Uploads data to device local buffers through one persistently mapped, host visible buffer. The buffer is split into
+// segments that each have their own command buffer and remember the timeline value their copies signal: while the GPU
+// copies out of one segment the CPU is already filling the next, and a segment is only reused once its value has been
+// reached. Uploads of any size are fine, they are simply split across segments
+class StagingRing {
+    struct Segment {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        uint64_t submittedValue = 0;
+        VkDeviceSize used = 0;
+        bool recording = false;
+    };
+
+    VkDevice device;
+    VkQueue queue;
+    std::mutex *queueMutex;
+    DeviceMemoryAllocator &allocator;
+    VkCommandPool commandPool;
+    Buffer stagingBuffer;
+    TimelineSemaphore timeline;
+    VkDeviceSize segmentSize;
+    std::vector<Segment> segments;
+    uint32_t currentSegment = 0;
+
+public:
+    // `queueMutex` is held around submits when other threads submit to `queue` as well
+    StagingRing(VkDevice device, VkQueue queue, uint32_t queueFamily, DeviceMemoryAllocator &allocator,
+                VkDeviceSize size = DEFAULT_STAGING_RING_SIZE, std::mutex *queueMutex = nullptr)
+        : device(device),
+          queue(queue),
+          queueMutex(queueMutex),
+          allocator(allocator),
+          timeline(device),
+          segmentSize(size / STAGING_RING_SEGMENTS) {
+        stagingBuffer = allocator.createBuffer(
+            size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create staging command pool");
+        }
+
+        segments.resize(STAGING_RING_SEGMENTS);
+        for (auto &segment : segments) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device, &allocInfo, &segment.commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create staging ring segment");
+            }
+        }
+    }
+
+    ~StagingRing() {
+        flush();
+
+        vkDestroyCommandPool(device, commandPool, nullptr);
+        allocator.destroyBuffer(stagingBuffer);
+    }
+
+    StagingRing(const StagingRing &) = delete;
+    StagingRing &operator=(const StagingRing &) = delete;
+
+    // Queues a copy of `size` bytes into `dstBuffer`. The data is copied out of `data` before this returns, but the
+    // destination is only guaranteed to be written once flush() returns
+    void upload(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0) {
+        const char *source = static_cast<const char *>(data);
+
+        while (size > 0) {
+            Segment &segment = beginSegment();
+            if (segment.used == segmentSize) {
+                submitSegment();
+                continue;
+            }
+
+            VkDeviceSize chunkSize = std::min(size, segmentSize - segment.used);
+            VkDeviceSize stagingOffset = currentSegment * segmentSize + segment.used;
+            std::memcpy(static_cast<char *>(stagingBuffer.allocation.mapped) + stagingOffset, source, chunkSize);
+
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = stagingOffset;
+            copyRegion.dstOffset = dstOffset;
+            copyRegion.size = chunkSize;
+            vkCmdCopyBuffer(segment.commandBuffer, stagingBuffer.buffer, dstBuffer, 1, &copyRegion);
+
+            segment.used += chunkSize;
+            source += chunkSize;
+            dstOffset += chunkSize;
+            size -= chunkSize;
+        }
+    }
+
+    // Submits whatever is still being recorded and waits for every outstanding copy
+    void flush() {
+        if (segments[currentSegment].recording) submitSegment();
+        timeline.wait(timeline.lastSubmittedValue());
+    }
+
+private:
+    Segment &beginSegment() {
+        Segment &segment = segments[currentSegment];
+        if (segment.recording) return segment;
+
+        // The segment was submitted a full lap ago; its copies have to finish before its memory is overwritten
+        timeline.wait(segment.submittedValue);
+        vkResetCommandBuffer(segment.commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(segment.commandBuffer, &beginInfo);
+
+        segment.used = 0;
+        segment.recording = true;
+        return segment;
+    }
+
+    void submitSegment() {
+        Segment &segment = segments[currentSegment];
+
+        // Make the copies visible to whatever reads the buffers next (vertex fetch, index fetch, indirect, shaders)
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+                                VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(segment.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        vkEndCommandBuffer(segment.commandBuffer);
+
+        VkCommandBufferSubmitInfo commandBufferInfo{};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandBufferInfo.commandBuffer = segment.commandBuffer;
+
+        // Only claimed once the submit went through, so a failed one leaves no value behind that is never signalled
+        uint64_t value = timeline.lastSubmittedValue() + 1;
+        VkSemaphoreSubmitInfo signalInfo = timeline.submitInfo(value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandBufferInfo;
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+        std::unique_lock<std::mutex> queueLock;
+        if (queueMutex != nullptr) queueLock = std::unique_lock(*queueMutex);
+        if (vkQueueSubmit2(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit staging copies");
+        }
+        segment.submittedValue = timeline.nextValue();
+
+        segment.recording = false;
+        currentSegment = (currentSegment + 1) % STAGING_RING_SEGMENTS;
+    }
+};
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "ThreadPool.h"
+#include "TimelineSemaphore.h"
+
+const VkDeviceSize DEFAULT_TEXTURE_STAGING_SIZE = 64 * 1024 * 1024;
+
+// Bytes of texture data handed to the transfer queue per rendered frame, a 1024x1024 RGBA texture. Copies compete with
+// rendering for memory bandwidth even on their own queue, so they are spread out instead of all landing in one frame
+const VkDeviceSize DEFAULT_TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024;
+
+const VkFormat STREAMED_TEXTURE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+// Start of a texel row in the staging ring. Copies only need 4, this keeps rows on cache lines
+const VkDeviceSize TEXTURE_STAGING_ALIGNMENT = 64;
+
+struct DecodedImage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> rgbaPixels;
+};
+
+// Binary PPM (P6, 8 bits per channel), the format --dump-frame writes, expanded to opaque RGBA
+inline DecodedImage decodeImageFile(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Failed to open image " + filename);
+
+    // Header fields are separated by whitespace, and # starts a comment that runs to the end of the line
+    auto readField = [&file]() {
+        while (file >> std::ws && file.peek() == '#') {
+            file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        std::string field;
+        file >> field;
+        return field;
+    };
+
+    if (readField() != "P6") throw std::runtime_error("Not a binary PPM image: " + filename);
+    DecodedImage image;
+    image.width = static_cast<uint32_t>(std::stoul(readField()));
+    image.height = static_cast<uint32_t>(std::stoul(readField()));
+    if (std::stoul(readField()) != 255 || image.width == 0 || image.height == 0) {
+        throw std::runtime_error("Unsupported PPM image: " + filename);
+    }
+    file.get();  // The single whitespace character that ends the header
+
+    size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    std::vector<uint8_t> rgbPixels(pixelCount * 3);
+    file.read(reinterpret_cast<char *>(rgbPixels.data()), static_cast<std::streamsize>(rgbPixels.size()));
+    if (static_cast<size_t>(file.gcount()) != rgbPixels.size()) throw std::runtime_error("Truncated image " + filename);
+
+    image.rgbaPixels.resize(pixelCount * 4);
+    for (size_t i = 0; i < pixelCount; i++) {
+        std::memcpy(&image.rgbaPixels[i * 4], &rgbPixels[i * 3], 3);
+        image.rgbaPixels[i * 4 + 3] = 255;
+    }
+    return image;
+}
+
+// A texture whose copy has been submitted. Owned by whoever took it from the streamer
+struct StreamedTexture {
+    uint32_t id;  // Returned by TextureStreamer::request()
+    Image image;
+    VkImageView imageView;
+    uint64_t uploadValue;  // The streamer's timeline semaphore reaches this once the copy has finished
+};
+
+// Loads textures on a background thread and uploads them on a queue of their own, so rendering never stalls on them.
+//
+// The loader decodes a file, waits until the per-frame upload budget allows more copies, writes the texels into a
+// persistently mapped staging ring and submits the copy, which signals the next value of a timeline semaphore. The
+// render thread polls the semaphore and picks up every texture whose value has been reached. When the transfer queue is
+// from another family than the graphics queue, the image is released by the transfer family here and has to be
+// acquired on the graphics queue (recordAcquire()) by a submission that waits on the timeline for it
+class TextureStreamer {
+    struct Upload {
+        VkCommandBuffer commandBuffer;
+        uint64_t value;  // Reusable once the timeline has reached it
+    };
+
+    struct StagingRegion {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        uint64_t value;
+    };
+
+    VkDevice device;
+    DeviceMemoryAllocator &allocator;
+    VkQueue queue;
+    std::mutex *queueMutex;  // Held around submits when other threads use the queue as well. Optional
+    uint32_t transferFamily;
+    uint32_t graphicsFamily;
+    VkDeviceSize uploadBudget;
+
+    TimelineSemaphore timeline;
+    VkCommandPool commandPool;
+    Buffer stagingBuffer;
+    VkDeviceSize stagingSize;
+
+    // Only touched by the loader thread
+    std::vector<Upload> uploads;
+    std::deque<StagingRegion> stagingRegions;  // Oldest first
+    VkDeviceSize stagingHead = 0;
+
+    // Shared with the render thread
+    std::mutex mutex;
+    std::condition_variable budgetAvailable;
+    int64_t budget;  // May go negative after a texture larger than a frame's budget; later frames pay it back
+    bool stopping = false;
+    std::vector<StreamedTexture> submitted;
+    uint32_t nextId = 0;
+
+    std::unique_ptr<ThreadPool> loader;
+
+public:
+    // `uploadBudget` is in bytes per beginFrame(), 0 for no limit
+    TextureStreamer(VkDevice device, DeviceMemoryAllocator &allocator, VkQueue queue, uint32_t transferFamily,
+                    uint32_t graphicsFamily, std::mutex *queueMutex, VkDeviceSize stagingSize,
+                    VkDeviceSize uploadBudget)
+        : device(device),
+          allocator(allocator),
+          queue(queue),
+          queueMutex(queueMutex),
+          transferFamily(transferFamily),
+          graphicsFamily(graphicsFamily),
+          uploadBudget(uploadBudget),
+          timeline(device),
+          stagingSize(stagingSize),
+          budget(static_cast<int64_t>(uploadBudget)) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = transferFamily;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create texture streaming command pool");
+        }
+
+        stagingBuffer = allocator.createBuffer(
+            stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        loader = std::make_unique<ThreadPool>(1);
+    }
+
+    // Textures that are still queued are dropped, the ones already submitted are waited for and destroyed
+    ~TextureStreamer() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        budgetAvailable.notify_all();
+        loader.reset();
+
+        timeline.wait(timeline.lastSubmittedValue());
+        for (auto &texture : submitted) destroyTexture(texture);
+        vkDestroyCommandPool(device, commandPool, nullptr);
+        allocator.destroyBuffer(stagingBuffer);
+    }
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    bool needsOwnershipTransfer() const { return transferFamily != graphicsFamily; }
+    const TimelineSemaphore &uploadTimeline() const { return timeline; }
+
+    // Queues a file for loading and returns the id its StreamedTexture will have
+    uint32_t request(const std::string &filename) {
+        uint32_t id;
+        {
+            std::lock_guard lock(mutex);
+            id = nextId++;
+        }
+        loader->submit([this, id, filename] { load(id, filename); });
+        return id;
+    }
+
+    // Grants another frame's worth of upload budget. Unused budget does not carry over
+    void beginFrame() {
+        if (uploadBudget == 0) return;
+        {
+            std::lock_guard lock(mutex);
+            budget = std::min(budget + static_cast<int64_t>(uploadBudget), static_cast<int64_t>(uploadBudget));
+        }
+        budgetAvailable.notify_one();
+    }
+
+    // Every texture whose copy has finished since the last call. The caller owns them from now on
+    std::vector<StreamedTexture> takeCompleted() {
+        uint64_t completedValue = timeline.completedValue();
+
+        std::vector<StreamedTexture> completed;
+        std::lock_guard lock(mutex);
+        auto firstPending = std::stable_partition(submitted.begin(), submitted.end(), [&](auto &texture) {
+            return texture.uploadValue <= completedValue;
+        });
+        completed.assign(submitted.begin(), firstPending);
+        submitted.erase(submitted.begin(), firstPending);
+        return completed;
+    }
+
+    // The acquire half of the queue family ownership transfer, recorded on the graphics queue before the textures are
+    // sampled. Nothing to do when both queues are from the same family
+    void recordAcquire(VkCommandBuffer commandBuffer, const std::vector<StreamedTexture> &textures) const {
+        if (!needsOwnershipTransfer() || textures.empty()) return;
+
+        std::vector<VkImageMemoryBarrier2> barriers;
+        for (auto &texture : textures) {
+            VkImageMemoryBarrier2 barrier = ownershipBarrier(texture.image.image);
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+            barriers.push_back(barrier);
+        }
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+        dependencyInfo.pImageMemoryBarriers = barriers.data();
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+
+    void destroyTexture(StreamedTexture &texture) {
+        vkDestroyImageView(device, texture.imageView, nullptr);
+        allocator.destroyImage(texture.image);
+    }
+
+private:
+    // Runs on the loader thread. A texture that fails to load is reported and skipped, the others carry on
+    void load(uint32_t id, const std::string &filename) {
+        {
+            std::lock_guard lock(mutex);
+            if (stopping) return;
+        }
+
+        StreamedTexture texture{};
+        texture.id = id;
+        try {
+            DecodedImage decoded = decodeImageFile(filename);
+            VkDeviceSize size = decoded.rgbaPixels.size();
+            if (size > stagingSize) throw std::runtime_error("Larger than the staging ring");
+
+            createTexture(texture, decoded.width, decoded.height);
+            if (!waitForBudget(size)) {
+                destroyTexture(texture);
+                return;
+            }
+
+            VkDeviceSize stagingOffset = reserveStaging(size);
+            std::memcpy(static_cast<char *>(stagingBuffer.allocation.mapped) + stagingOffset,
+                        decoded.rgbaPixels.data(), size);
+            texture.uploadValue = submitCopy(texture.image.image, decoded.width, decoded.height, stagingOffset);
+            stagingRegions.back().value = texture.uploadValue;
+        } catch (const std::exception &e) {
+            std::cerr << "Failed to stream texture " << filename << ": " << e.what() << "\n";
+            if (texture.image.image != VK_NULL_HANDLE) destroyTexture(texture);
+            return;
+        }
+
+        std::lock_guard lock(mutex);
+        submitted.push_back(texture);
+    }
+
+    void createTexture(StreamedTexture &texture, uint32_t width, uint32_t height) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = STREAMED_TEXTURE_FORMAT;
+        imageInfo.extent = {width, height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;  // Ownership is transferred explicitly instead
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        texture.image = allocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = texture.image.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = STREAMED_TEXTURE_FORMAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device, &viewInfo, nullptr, &texture.imageView) != VK_SUCCESS) {
+            allocator.destroyImage(texture.image);
+            throw std::runtime_error("Failed to create texture image view");
+        }
+    }
+
+    // False when the streamer is shutting down while waiting
+    bool waitForBudget(VkDeviceSize size) {
+        std::unique_lock lock(mutex);
+        budgetAvailable.wait(lock, [this] { return stopping || uploadBudget == 0 || budget > 0; });
+        if (stopping) return false;
+        budget -= static_cast<int64_t>(size);
+        return true;
+    }
+
+    // Space for `size` bytes in the staging ring, wrapping around to the start when the end is too short. Waits for
+    // the copies of any earlier upload still using that space
+    VkDeviceSize reserveStaging(VkDeviceSize size) {
+        VkDeviceSize begin = (stagingHead + TEXTURE_STAGING_ALIGNMENT - 1) / TEXTURE_STAGING_ALIGNMENT *
+                             TEXTURE_STAGING_ALIGNMENT;
+        if (begin + size > stagingSize) begin = 0;
+        VkDeviceSize end = begin + size;
+
+        uint64_t overlappingValue = 0;
+        for (auto &region : stagingRegions) {
+            if (region.begin < end && begin < region.end) overlappingValue = std::max(overlappingValue, region.value);
+        }
+        timeline.wait(overlappingValue);
+
+        uint64_t completedValue = timeline.completedValue();
+        while (!stagingRegions.empty() && stagingRegions.front().value <= completedValue) stagingRegions.pop_front();
+
+        stagingRegions.push_back({begin, end, 0});  // The value is only known once the copy is submitted
+        stagingHead = end;
+        return begin;
+    }
+
+    // A command buffer whose previous copy has finished, or a new one
+    VkCommandBuffer acquireCommandBuffer(uint64_t value) {
+        uint64_t completedValue = timeline.completedValue();
+
+        for (auto &upload : uploads) {
+            if (upload.value <= completedValue) {
+                upload.value = value;
+                vkResetCommandBuffer(upload.commandBuffer, 0);
+                return upload.commandBuffer;
+            }
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate texture upload command buffer");
+        }
+        uploads.push_back({commandBuffer, value});
+        return commandBuffer;
+    }
+
+    // Both halves of the ownership transfer have to describe the same layout transition and queue families
+    VkImageMemoryBarrier2 ownershipBarrier(VkImage image) const {
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcQueueFamilyIndex = needsOwnershipTransfer() ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = needsOwnershipTransfer() ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        return barrier;
+    }
+
+    // Returns the timeline value the copy signals
+    uint64_t submitCopy(VkImage image, uint32_t width, uint32_t height, VkDeviceSize stagingOffset) {
+        uint64_t value = timeline.lastSubmittedValue() + 1;  // Only claimed with nextValue() once submitted
+        VkCommandBuffer commandBuffer = acquireCommandBuffer(value);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        VkImageMemoryBarrier2 toTransfer{};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        toTransfer.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        toTransfer.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = image;
+        toTransfer.subresourceRange = ownershipBarrier(image).subresourceRange;
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = 1;
+        dependencyInfo.pImageMemoryBarriers = &toTransfer;
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = stagingOffset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {width, height, 1};
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                               &region);
+
+        // The release half of the ownership transfer, or just the layout transition within one family. Either way the
+        // graphics queue waits on the timeline semaphore before sampling, which is what makes the copy visible there
+        VkImageMemoryBarrier2 release = ownershipBarrier(image);
+        release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        dependencyInfo.pImageMemoryBarriers = &release;
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+        vkEndCommandBuffer(commandBuffer);
+
+        VkCommandBufferSubmitInfo commandBufferInfo{};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandBufferInfo.commandBuffer = commandBuffer;
+
+        VkSemaphoreSubmitInfo signalInfo = timeline.submitInfo(value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandBufferInfo;
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+        std::unique_lock<std::mutex> queueLock;
+        if (queueMutex != nullptr) queueLock = std::unique_lock(*queueMutex);
+        if (vkQueueSubmit2(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit texture upload");
+        }
+        timeline.nextValue();
+        return value;
+    }
+};
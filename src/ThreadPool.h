@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A fixed set of worker threads pulling tasks from a shared queue. Tasks are handed back as futures so the caller
+// decides when (and whether) to block on the result
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    bool stopping = false;
+
+public:
+    explicit ThreadPool(uint32_t threadCount) {
+        if (threadCount == 0) threadCount = 1;
+
+        workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    // Finishes every task that was already queued before joining
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        taskAvailable.notify_all();
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    uint32_t size() const { return static_cast<uint32_t>(workers.size()); }
+
+    template <typename Task>
+    std::future<std::invoke_result_t<Task>> submit(Task &&task) {
+        // std::function needs a copyable callable, packaged_task is move-only
+        auto packagedTask =
+            std::make_shared<std::packaged_task<std::invoke_result_t<Task>()>>(std::forward<Task>(task));
+        auto future = packagedTask->get_future();
+
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace([packagedTask] { (*packagedTask)(); });
+        }
+        taskAvailable.notify_one();
+
+        return future;
+    }
+
+private:
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;  // Only reachable when stopping
+
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+
+            task();
+        }
+    }
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+
+// A timeline semaphore and the last value handed to a submission. Every submission signals the next value, so "has this
+// work finished" becomes "has the counter reached N": the CPU waits with wait(N), other queues wait for N in their own
+// submits, and anything that may only be reused or destroyed after the work just remembers N. Unlike a fence there is
+// nothing to reset between uses, and any number of waiters can wait for any value
+class TimelineSemaphore {
+    VkDevice device;
+    VkSemaphore semaphore;
+    uint64_t lastValue = 0;
+
+public:
+    explicit TimelineSemaphore(VkDevice device) : device(device) {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create timeline semaphore");
+        }
+    }
+
+    ~TimelineSemaphore() { vkDestroySemaphore(device, semaphore, nullptr); }
+
+    TimelineSemaphore(const TimelineSemaphore &) = delete;
+    TimelineSemaphore &operator=(const TimelineSemaphore &) = delete;
+
+    VkSemaphore handle() const { return semaphore; }
+
+    // The value for the submission about to be made. It counts as submitted from here on
+    uint64_t nextValue() { return ++lastValue; }
+
+    uint64_t lastSubmittedValue() const { return lastValue; }
+
+    uint64_t completedValue() const {
+        uint64_t value;
+        vkGetSemaphoreCounterValue(device, semaphore, &value);
+        return value;
+    }
+
+    // Returns right away for values that have already been reached, including 0
+    void wait(uint64_t value) const {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &value;
+        vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+    }
+
+    // For the wait and signal arrays of vkQueueSubmit2
+    VkSemaphoreSubmitInfo submitInfo(uint64_t value, VkPipelineStageFlags2 stageMask) const {
+        VkSemaphoreSubmitInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        info.semaphore = semaphore;
+        info.value = value;
+        info.stageMask = stageMask;
+        return info;
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <type_traits>
+#include <utility>
+
+// Splits a vkDestroy* function into the object it destroys and the object that object was created from. Instances and
+// devices have no parent
+template <typename Destroy>
+struct VulkanDestroyTraits;
+
+template <typename ParentHandle, typename ObjectHandle>
+struct VulkanDestroyTraits<void (*)(ParentHandle, ObjectHandle, const VkAllocationCallbacks *)> {
+    using Parent = ParentHandle;
+    using Handle = ObjectHandle;
+};
+
+struct NoParent {};
+
+template <typename ObjectHandle>
+struct VulkanDestroyTraits<void (*)(ObjectHandle, const VkAllocationCallbacks *)> {
+    using Parent = NoParent;
+    using Handle = ObjectHandle;
+};
+
+// Owns one Vulkan object and destroys it with `Destroy` when it goes out of scope, is reset or is assigned another one.
+// Move-only, like the object it owns. It converts to the raw handle, so it can be passed straight to vkCmd* and
+// friends, and creation functions write into put():
+//
+//   vkCreatePipelineLayout(device, &layoutInfo, nullptr, pipelineLayout.put(device));
+//
+// Members are destroyed in reverse declaration order, so declaring children after their parent (the device after the
+// instance, views after their swap chain) is all it takes to tear everything down correctly
+template <auto Destroy>
+class UniqueHandle {
+public:
+    using Parent = typename VulkanDestroyTraits<decltype(Destroy)>::Parent;
+    using Handle = typename VulkanDestroyTraits<decltype(Destroy)>::Handle;
+
+private:
+    [[no_unique_address]] Parent parent{};
+    Handle handle = VK_NULL_HANDLE;
+
+public:
+    UniqueHandle() = default;
+    UniqueHandle(Parent parent, Handle handle) : parent(parent), handle(handle) {}
+    explicit UniqueHandle(Handle handle) requires std::is_same_v<Parent, NoParent> : handle(handle) {}
+
+    ~UniqueHandle() { reset(); }
+
+    UniqueHandle(const UniqueHandle &) = delete;
+    UniqueHandle &operator=(const UniqueHandle &) = delete;
+
+    UniqueHandle(UniqueHandle &&other) noexcept
+        : parent(other.parent), handle(std::exchange(other.handle, VK_NULL_HANDLE)) {}
+
+    UniqueHandle &operator=(UniqueHandle &&other) noexcept {
+        if (this != &other) {
+            reset();
+            parent = other.parent;
+            handle = std::exchange(other.handle, VK_NULL_HANDLE);
+        }
+        return *this;
+    }
+
+    operator Handle() const { return handle; }
+    Handle get() const { return handle; }
+
+    // Destroys the current object, if any, and returns where vkCreate* should write the new one
+    Handle *put(Parent newParent) {
+        reset();
+        parent = newParent;
+        return &handle;
+    }
+
+    Handle *put() requires std::is_same_v<Parent, NoParent> {
+        reset();
+        return &handle;
+    }
+
+    void reset() {
+        if (handle == VK_NULL_HANDLE) return;
+        if constexpr (std::is_same_v<Parent, NoParent>) {
+            Destroy(handle, nullptr);
+        } else {
+            Destroy(parent, handle, nullptr);
+        }
+        handle = VK_NULL_HANDLE;
+    }
+
+    // Gives up ownership without destroying anything
+    Handle release() { return std::exchange(handle, VK_NULL_HANDLE); }
+};
+
+using UniqueInstance = UniqueHandle<vkDestroyInstance>;
+using UniqueDevice = UniqueHandle<vkDestroyDevice>;
+using UniqueSurface = UniqueHandle<vkDestroySurfaceKHR>;
+using UniqueSwapchain = UniqueHandle<vkDestroySwapchainKHR>;
+using UniqueImageView = UniqueHandle<vkDestroyImageView>;
+using UniqueRenderPass = UniqueHandle<vkDestroyRenderPass>;
+using UniqueFramebuffer = UniqueHandle<vkDestroyFramebuffer>;
+using UniqueShaderModule = UniqueHandle<vkDestroyShaderModule>;
+using UniqueDescriptorSetLayout = UniqueHandle<vkDestroyDescriptorSetLayout>;
+using UniquePipelineLayout = UniqueHandle<vkDestroyPipelineLayout>;
+using UniquePipelineCache = UniqueHandle<vkDestroyPipelineCache>;
+using UniquePipeline = UniqueHandle<vkDestroyPipeline>;
+using UniqueCommandPool = UniqueHandle<vkDestroyCommandPool>;
+using UniqueSemaphore = UniqueHandle<vkDestroySemaphore>;
+using UniqueSampler = UniqueHandle<vkDestroySampler>;
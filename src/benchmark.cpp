@@ -0,0 +1,353 @@
+// Offline benchmark harness. Runs a fixed list of headless scenarios, each on a freshly created device, and writes the
+// results as JSON so runs from different commits can be compared, e.g. on lavapipe in CI:
+//
+//   vk-learning-bench --output results.json
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "HelloTriangleApplication.h"
+
+const uint32_t DEFAULT_BENCHMARK_WARMUP_FRAMES = 30;
+const uint32_t DEFAULT_BENCHMARK_FRAMES = 300;
+
+// Streamed by the streaming scenarios, 4 MiB each once expanded to RGBA
+const uint32_t BENCHMARK_TEXTURE_COUNT = 16;
+const uint32_t BENCHMARK_TEXTURE_SIZE = 1024;
+
+struct Scenario {
+    std::string name;
+    AppConfig config;
+};
+
+static std::string benchmarkTexturePath(uint32_t index) {
+    auto path = std::filesystem::temp_directory_path() / ("vk-learning-bench-" + std::to_string(index) + ".ppm");
+    return path.string();
+}
+
+// Checkerboards in a different color each, written once per run before the first scenario that needs them
+static void writeBenchmarkTextures() {
+    for (uint32_t i = 0; i < BENCHMARK_TEXTURE_COUNT; i++) {
+        std::ofstream file(benchmarkTexturePath(i), std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) throw std::runtime_error("Failed to write " + benchmarkTexturePath(i));
+
+        file << "P6\n" << BENCHMARK_TEXTURE_SIZE << " " << BENCHMARK_TEXTURE_SIZE << "\n255\n";
+        std::vector<char> row(BENCHMARK_TEXTURE_SIZE * 3);
+        for (uint32_t y = 0; y < BENCHMARK_TEXTURE_SIZE; y++) {
+            for (uint32_t x = 0; x < BENCHMARK_TEXTURE_SIZE; x++) {
+                bool light = ((x / 64) + (y / 64)) % 2 == 0;
+                for (uint32_t channel = 0; channel < 3; channel++) {
+                    bool lit = light || ((i + 1) >> channel & 1);
+                    row[x * 3 + channel] = static_cast<char>(lit ? 255 : 64);
+                }
+            }
+            file.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+    }
+}
+
+// Every scenario starts from the same baseline and changes one thing, so each group isolates a single variable
+std::vector<Scenario> buildScenarios() {
+    AppConfig baseline;
+    baseline.headless = true;
+    baseline.usePipelineCache = false;  // Keep runs independent of whatever an earlier run left on disk
+
+    std::vector<Scenario> scenarios;
+
+    for (uint32_t triangles : {1u, 1000u, 100000u, 1000000u}) {
+        Scenario scenario{"triangles/" + std::to_string(triangles), baseline};
+        scenario.config.triangleCount = triangles;
+        scenarios.push_back(scenario);
+    }
+
+    for (DrawMode drawMode : {DrawMode::Direct, DrawMode::Instanced, DrawMode::Indirect}) {
+        for (uint32_t objects : {1000u, 10000u, 100000u}) {
+            Scenario scenario{std::string("draws/") + drawModeName(drawMode) + "/" + std::to_string(objects),
+                              baseline};
+            scenario.config.drawMode = drawMode;
+            scenario.config.objectCount = objects;
+            scenarios.push_back(scenario);
+        }
+    }
+
+    const VkExtent2D resolutions[] = {{640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+    for (auto resolution : resolutions) {
+        Scenario scenario{"resolution/" + std::to_string(resolution.width) + "x" + std::to_string(resolution.height),
+                          baseline};
+        scenario.config.width = resolution.width;
+        scenario.config.height = resolution.height;
+        scenario.config.triangleCount = 10000;  // Enough geometry that the resolution is not the only cost
+        scenarios.push_back(scenario);
+    }
+
+    for (uint32_t framesInFlight : {1u, 2u, 3u}) {
+        Scenario scenario{"frames-in-flight/" + std::to_string(framesInFlight), baseline};
+        scenario.config.framesInFlight = framesInFlight;
+        scenario.config.offscreenImageCount = std::max(framesInFlight, DEFAULT_OFFSCREEN_IMAGE_COUNT);
+        scenario.config.triangleCount = 10000;
+        scenarios.push_back(scenario);
+    }
+
+    // Per frame CPU and GPU overhead of the two ways of setting up the color attachment, with and without secondaries
+    for (RenderPath renderPath : {RenderPath::RenderPass, RenderPath::Dynamic}) {
+        for (uint32_t recordThreads : {0u, 2u}) {
+            Scenario scenario{std::string("render-path/") + renderPathName(renderPath) +
+                                  (recordThreads > 0 ? "/secondaries" : ""),
+                              baseline};
+            scenario.config.renderPath = renderPath;
+            scenario.config.recordThreads = recordThreads;
+            scenarios.push_back(scenario);
+        }
+    }
+
+    // A dense scene where every pixel is covered by several objects, to show what the draw order does to overdraw
+    for (DrawOrder drawOrder : {DrawOrder::Unsorted, DrawOrder::FrontToBack, DrawOrder::BackToFront}) {
+        Scenario scenario{std::string("overdraw/") + drawOrderName(drawOrder), baseline};
+        scenario.config.objectCount = 10000;
+        scenario.config.objectScale = 8.0f;
+        scenario.config.drawOrder = drawOrder;
+        scenario.config.countOverdraw = true;
+        scenarios.push_back(scenario);
+    }
+
+    // Many materials in per object draws. Pooled writes the heap into a new set every frame and binds it in every
+    // command buffer; bindless binds the same set every frame
+    for (DescriptorMode descriptorMode : {DescriptorMode::Bindless, DescriptorMode::Pooled}) {
+        Scenario scenario{std::string("descriptors/") + descriptorModeName(descriptorMode), baseline};
+        scenario.config.descriptorMode = descriptorMode;
+        scenario.config.drawMode = DrawMode::Direct;
+        scenario.config.objectCount = 10000;
+        scenario.config.materialCount = 4096;
+        scenarios.push_back(scenario);
+    }
+
+    // Textures arriving while rendering. Unlimited submits every copy as soon as it is decoded, which shows up as
+    // frame time spikes; a budget spreads the same copies over more frames
+    for (VkDeviceSize uploadBudget : {VkDeviceSize(0), VkDeviceSize(1024 * 1024)}) {
+        Scenario scenario{"streaming/" + (uploadBudget == 0 ? std::string("unlimited")
+                                                             : std::to_string(uploadBudget / 1024) + "KiB"),
+                          baseline};
+        scenario.config.objectCount = 1000;
+        scenario.config.textureUploadBudget = uploadBudget;
+        for (uint32_t i = 0; i < BENCHMARK_TEXTURE_COUNT; i++) {
+            scenario.config.texturePaths.push_back(benchmarkTexturePath(i));
+        }
+        scenarios.push_back(scenario);
+    }
+
+    // A zoomed in view of a large scene, so most objects are off screen. The CPU tests every object while recording;
+    // the GPU does it in a compute pass and the CPU cost stays flat. With HiZ, objects overlap enough that many of the
+    // visible ones are hidden behind others
+    for (CullMode cullMode : {CullMode::None, CullMode::Cpu, CullMode::Gpu}) {
+        for (bool occlusionCulling : {false, true}) {
+            if (occlusionCulling && cullMode != CullMode::Gpu) continue;
+
+            for (uint32_t objects : {10000u, 100000u, 1000000u}) {
+                Scenario scenario{std::string("culling/") + cullModeName(cullMode) + (occlusionCulling ? "-hiz" : "") +
+                                      "/" + std::to_string(objects),
+                                  baseline};
+                scenario.config.drawMode = DrawMode::Indirect;  // What CullMode::None is compared against
+                scenario.config.objectCount = objects;
+                scenario.config.objectScale = 4.0f;
+                scenario.config.viewZoom = 4.0f;
+                scenario.config.cullMode = cullMode;
+                scenario.config.occlusionCulling = occlusionCulling;
+                scenarios.push_back(scenario);
+            }
+        }
+    }
+
+    return scenarios;
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+static std::string formatMilliseconds(double milliseconds) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.4f", milliseconds);
+    return buffer;
+}
+
+// Every string written into the JSON goes through this: exception messages and device names may contain quotes,
+// backslashes or control characters
+static std::string escapeJson(const std::string &text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            default:
+                if (c < 0x20) {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                } else {
+                    escaped += static_cast<char>(c);
+                }
+        }
+    }
+    return escaped;
+}
+
+static void writeScenarioJson(std::ostream &out, const Scenario &scenario, const BenchmarkResult &result) {
+    std::vector<double> sorted = result.frameMilliseconds;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = sorted.empty() ? 0.0 : std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+
+    const AppConfig &config = scenario.config;
+    out << "    {\n";
+    out << "      \"name\": \"" << escapeJson(scenario.name) << "\",\n";
+    out << "      \"triangles\": " << config.triangleCount << ",\n";
+    out << "      \"objects\": " << config.objectCount << ",\n";
+    out << "      \"drawMode\": \"" << drawModeName(config.drawMode) << "\",\n";
+    out << "      \"renderPath\": \"" << renderPathName(config.renderPath) << "\",\n";
+    out << "      \"recordThreads\": " << config.recordThreads << ",\n";
+    out << "      \"materials\": " << config.materialCount << ",\n";
+    out << "      \"descriptorMode\": \"" << descriptorModeName(result.descriptorMode) << "\",\n";
+    out << "      \"width\": " << config.width << ",\n";
+    out << "      \"height\": " << config.height << ",\n";
+    out << "      \"framesInFlight\": " << config.framesInFlight << ",\n";
+    out << "      \"frames\": " << sorted.size() << ",\n";
+    out << "      \"frameTimeMs\": {\"mean\": " << formatMilliseconds(mean)
+        << ", \"min\": " << formatMilliseconds(sorted.empty() ? 0.0 : sorted.front())
+        << ", \"p50\": " << formatMilliseconds(percentile(sorted, 50.0))
+        << ", \"p95\": " << formatMilliseconds(percentile(sorted, 95.0))
+        << ", \"p99\": " << formatMilliseconds(percentile(sorted, 99.0))
+        << ", \"max\": " << formatMilliseconds(sorted.empty() ? 0.0 : sorted.back()) << "},\n";
+    out << "      \"cpuRecordMs\": {\"p50\": " << formatMilliseconds(result.recordMilliseconds[0])
+        << ", \"p95\": " << formatMilliseconds(result.recordMilliseconds[1])
+        << ", \"p99\": " << formatMilliseconds(result.recordMilliseconds[2]) << "},\n";
+    out << "      \"gpuFrameMs\": {\"p50\": " << formatMilliseconds(result.gpuFrameMilliseconds[0])
+        << ", \"p95\": " << formatMilliseconds(result.gpuFrameMilliseconds[1])
+        << ", \"p99\": " << formatMilliseconds(result.gpuFrameMilliseconds[2]) << "},\n";
+    out << "      \"memory\": {\"allocatedBytes\": " << result.allocatedBytes
+        << ", \"usedBytes\": " << result.usedBytes << "}";
+    if (config.countOverdraw) {
+        out << ",\n      \"drawOrder\": \"" << drawOrderName(config.drawOrder) << "\",\n";
+        out << "      \"fragmentsPerPixel\": " << formatMilliseconds(result.fragmentsPerPixel);
+    }
+    if (config.cullMode != CullMode::None || config.viewZoom != 1.0f) {
+        out << ",\n      \"cullMode\": \"" << cullModeName(config.cullMode) << "\",\n";
+        out << "      \"occlusionCulling\": " << (config.occlusionCulling ? "true" : "false") << ",\n";
+        out << "      \"viewZoom\": " << config.viewZoom << ",\n";
+        out << "      \"objectsDrawn\": " << result.objectsDrawn << ",\n";
+        out << "      \"cullMs\": " << formatMilliseconds(result.cullMilliseconds);
+    }
+    if (!config.texturePaths.empty()) {
+        out << ",\n      \"uploadBudgetBytes\": " << config.textureUploadBudget << ",\n";
+        out << "      \"textures\": " << config.texturePaths.size() << ",\n";
+        out << "      \"texturesResident\": " << result.texturesResident;
+    }
+    out << "\n";
+    out << "    }";
+}
+
+int main(int argc, char **argv) {
+    uint32_t warmupFrames = DEFAULT_BENCHMARK_WARMUP_FRAMES;
+    uint32_t measuredFrames = DEFAULT_BENCHMARK_FRAMES;
+    std::string outputPath;
+    std::string filter;
+    std::string deviceOverride;
+    bool preferCpuDevice = false;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--warmup" && i + 1 < argc) {
+                warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (arg == "--frames" && i + 1 < argc) {
+                measuredFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (arg == "--output" && i + 1 < argc) {
+                outputPath = argv[++i];
+            } else if (arg == "--filter" && i + 1 < argc) {
+                filter = argv[++i];  // Only run scenarios whose name contains this
+            } else if (arg == "--device" && i + 1 < argc) {
+                deviceOverride = argv[++i];
+            } else if (arg == "--prefer-cpu") {
+                preferCpuDevice = true;  // Results that don't depend on which GPU the machine has, e.g. lavapipe in CI
+            } else {
+                throw std::runtime_error("Unknown argument: " + arg);
+            }
+        }
+        if (measuredFrames == 0) throw std::runtime_error("At least one measured frame is required");
+
+        // The application logs to stdout (e.g. "Time to pipeline"), which is where the JSON goes by default
+        std::streambuf *stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+        std::string deviceName;
+        std::ostringstream scenariosJson;
+        bool first = true;
+        bool texturesWritten = false;
+        for (auto &scenario : buildScenarios()) {
+            if (!filter.empty() && scenario.name.find(filter) == std::string::npos) continue;
+            scenario.config.deviceOverride = deviceOverride;
+            scenario.config.preferCpuDevice = preferCpuDevice;
+            if (!scenario.config.texturePaths.empty() && !std::exchange(texturesWritten, true)) {
+                writeBenchmarkTextures();
+            }
+
+            std::cerr << "Running " << scenario.name << "\n";
+            if (!first) scenariosJson << ",\n";
+            first = false;
+
+            // A scenario the device cannot run (e.g. no drawIndirectFirstInstance) is reported, not fatal
+            try {
+                HelloTriangleApplication app(scenario.config);
+                BenchmarkResult result = app.runBenchmark(warmupFrames, measuredFrames);
+                deviceName = result.deviceName;
+                writeScenarioJson(scenariosJson, scenario, result);
+            } catch (const std::exception &e) {
+                std::cerr << scenario.name << " failed: " << e.what() << "\n";
+                scenariosJson << "    {\"name\": \"" << escapeJson(scenario.name) << "\", \"error\": \""
+                              << escapeJson(e.what()) << "\"}";
+            }
+        }
+
+        std::cout.rdbuf(stdoutBuffer);
+
+        std::ofstream file;
+        if (!outputPath.empty()) {
+            file.open(outputPath, std::ios::trunc);
+            if (!file.is_open()) throw std::runtime_error("Failed to open output file: " + outputPath);
+        }
+        std::ostream &out = outputPath.empty() ? std::cout : file;
+
+        out << "{\n";
+        out << "  \"device\": \"" << escapeJson(deviceName) << "\",\n";
+        out << "  \"warmupFrames\": " << warmupFrames << ",\n";
+        out << "  \"measuredFrames\": " << measuredFrames << ",\n";
+        out << "  \"scenarios\": [\n" << scenariosJson.str() << "\n  ]\n";
+        out << "}\n";
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
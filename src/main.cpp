@@ -1,1004 +1,126 @@
-#define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
-
-#include <algorithm>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
-#include <limits>
-#include <optional>
-#include <set>
 #include <stdexcept>
-#include <unordered_map>
-#include <vector>
-
-const uint32_t WIDTH = 800;
-const uint32_t HEIGHT = 600;
-
-const char *validationLayers[] = {"VK_LAYER_KHRONOS_validation"};
-const char *deviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-
-#ifdef NDEBUG
-const bool enableValidationLayers = false;
-#else
-const bool enableValidationLayers = true;
-#endif
-
-// Because this function is an extension function, it is not automatically loaded. We have to look up its address
-// ourselves
-VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-                                      const VkAllocationCallbacks *pAllocator,
-                                      VkDebugUtilsMessengerEXT *pDebugMessenger) {
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
-    } else {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
-    }
-}
-
-void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
-                                   const VkAllocationCallbacks *pAllocator) {
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        func(instance, debugMessenger, pAllocator);
-    }
-}
-
-// We need to check which queue families are supported by the device
-struct QueueFamilyIndices {
-    std::optional<uint32_t> graphicsFamily;
-    std::optional<uint32_t> presentationFamily;  // In case the drawing queue and the presentation queue do not overlap
-
-    bool isComplete() const { return graphicsFamily.has_value() && presentationFamily.has_value(); }
-};
-
-struct SwapChainSupportDetails {
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> surfaceFormats;
-    std::vector<VkPresentModeKHR> presentationModes;
-};
-
-class HelloTriangleApplication {
-    GLFWwindow *window;
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debugMessenger;
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;  // implicitly destroyed when `instance` is destroyed
-    VkDevice device;
-    VkQueue graphicsQueue;  // Queues are implicitly destroyed with the device is destroyed
-    VkQueue presentationQueue;
-    VkSurfaceKHR surface;
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainsImages;
-    VkFormat swapChainImageFormat;  // Needed for later after swap chain creation
-    VkExtent2D swapChainExtent;     // Needed for later after swap chain creation
-    std::vector<VkImageView> swapChainImageViews;
-    VkRenderPass renderPass;
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
-    VkCommandPool commandPool;
-    VkCommandBuffer commandBuffer;
-    VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
-    VkFence inFlightFence;
-
-public:
-    void run() {
-        initWindow();
-        initVulkan();
-        mainLoop();
-        cleanup();
-    }
-
-private:
-    void initWindow() {
-        glfwInit();  // Initialize the GLFW Library
-
-        // Do not create an OpenGL context
-        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-
-        // Disable resizing for now since it needs special care
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-
-        // Create the actual window
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
-    }
-
-    void createInstance() {
-        // This is the connection between my app and the Vulkan lib
-
-        // Included later - Enable Vk Validation Layers
-        if (enableValidationLayers && !checkValidationLayerSupport()) {
-            throw std::runtime_error("Validation layers requested but not available.");
-        }
-
-        // Info about our application
-        // It's optional but helps the driver optimize
-        VkApplicationInfo appInfo{};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "Vk First Triangle";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.pEngineName = "No Engine";
-        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
-
-        // Not optional and includes information on what Vulkan extensions and validation layers to include
-        VkInstanceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        createInfo.pApplicationInfo = &appInfo;
-        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-
-        // GLFW will handle windows for us so we need to get the extensions it needs and pass it to Vulkan
-        auto extensions = getRequiredExtensions();
-        const uint32_t extensionsCount = extensions.size();
-        checkSupportedExtensions(extensions.data(), &extensionsCount);
-
-        createInfo.enabledExtensionCount = extensionsCount;
-        createInfo.ppEnabledExtensionNames = extensions.data();
-
-        // Now Includes validation layers
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = std::size(validationLayers);
-            createInfo.ppEnabledLayerNames = validationLayers;
-
-            populateDebugMessengerCreateInfo(debugCreateInfo);
-            createInfo.pNext = &debugCreateInfo;
-        } else {
-            createInfo.enabledLayerCount = 0;
-            createInfo.pNext = nullptr;
-        }
-
-        // That's everything specified. Create the Vulkan Instance. If everything goes well, then all the information is
-        // stored in the instance handle. vkCreateInstance will either return VK_SUCCESS or an error for us to check
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create Vk Instance");
-        }
-    }
-
-    std::vector<const char *> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-        std::vector extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
-        if (enableValidationLayers) extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-
-        return extensions;
-    }
-
-    void checkSupportedExtensions(const char **requiredExtensions, const uint32_t *requiredExtensionCount) {
-        // Request just the number of supported Extensions
-        uint32_t supportedExtensionCount = 0;
-        vkEnumerateInstanceExtensionProperties(nullptr, &supportedExtensionCount, nullptr);
-
-        // Get the extension details
-        std::vector<VkExtensionProperties> extensions(supportedExtensionCount);
-        vkEnumerateInstanceExtensionProperties(nullptr, &supportedExtensionCount, extensions.data());
-
-        // Extra credit to check if the required extensions are supported
-        std::set<std::string> supportedExtensionsLut{};
-
-        for (const VkExtensionProperties &extension : extensions) {
-            supportedExtensionsLut.insert({extension.extensionName});
-        }
-
-        std::cout << "Required Extensions:\n";
-        for (int i = 0; i < *requiredExtensionCount; i++) {
-            std::cout << "\t" << requiredExtensions[i];
-
-            if (supportedExtensionsLut.contains(requiredExtensions[i])) {
-                std::cout << " (supported)" << "\n";
-            } else {
-                std::cout << " (not supported)" << "\n";
+#include <string>
+
+#include "HelloTriangleApplication.h"
+
+AppConfig parseArgs(int argc, char **argv) {
+    AppConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames-in-flight" && i + 1 < argc) {
+            config.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--device" && i + 1 < argc) {
+            config.deviceOverride = argv[++i];
+        } else if (arg == "--prefer-cpu") {
+            config.preferCpuDevice = true;
+        } else if (arg == "--device-info") {
+            config.printDeviceInfo = true;
+        } else if (arg == "--width" && i + 1 < argc) {
+            config.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--height" && i + 1 < argc) {
+            config.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--offscreen-images" && i + 1 < argc) {
+            config.offscreenImageCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--frames" && i + 1 < argc) {
+            config.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--dump-frame" && i + 1 < argc) {
+            config.dumpFramePath = argv[++i];
+        } else if (arg == "--capture" && i + 1 < argc) {
+            config.capturePath = argv[++i];  // Needs an 8-bit RGBA or BGRA surface format
+        } else if (arg == "--capture-format" && i + 1 < argc) {
+            config.captureFormat = parseCaptureFormat(argv[++i]);
+        } else if (arg == "--capture-every" && i + 1 < argc) {
+            config.captureInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--capture-buffers" && i + 1 < argc) {
+            config.captureBufferCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--present" && i + 1 < argc) {
+            config.presentPolicy = parsePresentPolicy(argv[++i]);
+        } else if (arg == "--swapchain-images" && i + 1 < argc) {
+            config.swapChainImageCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--frame-pacing") {
+            config.framePacing = true;
+        } else if (arg == "--shader-bundle" && i + 1 < argc) {
+            config.shaderBundlePath = argv[++i];
+        } else if (arg == "--pipeline-cache" && i + 1 < argc) {
+            config.pipelineCachePath = argv[++i];
+        } else if (arg == "--no-pipeline-cache") {
+            config.usePipelineCache = false;
+        } else if (arg == "--opacity" && i + 1 < argc) {
+            config.opacity = std::stof(argv[++i]);
+        } else if (arg == "--hot-reload") {
+            config.hotReload = true;
+        } else if (arg == "--shader-source-dir" && i + 1 < argc) {
+            config.shaderSourceDir = argv[++i];
+        } else if (arg == "--glslc" && i + 1 < argc) {
+            config.glslcPath = argv[++i];
+        } else if (arg == "--triangles" && i + 1 < argc) {
+            config.triangleCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--objects" && i + 1 < argc) {
+            config.objectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--draw-mode" && i + 1 < argc) {
+            config.drawMode = parseDrawMode(argv[++i]);
+        } else if (arg == "--object-scale" && i + 1 < argc) {
+            config.objectScale = std::stof(argv[++i]);
+        } else if (arg == "--draw-order" && i + 1 < argc) {
+            config.drawOrder = parseDrawOrder(argv[++i]);
+        } else if (arg == "--count-overdraw") {
+            config.countOverdraw = true;
+        } else if (arg == "--view-zoom" && i + 1 < argc) {
+            config.viewZoom = std::stof(argv[++i]);
+        } else if (arg == "--cull" && i + 1 < argc) {
+            config.cullMode = parseCullMode(argv[++i]);
+        } else if (arg == "--occlusion-cull") {
+            config.occlusionCulling = true;
+        } else if (arg == "--materials" && i + 1 < argc) {
+            config.materialCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--descriptors" && i + 1 < argc) {
+            config.descriptorMode = parseDescriptorMode(argv[++i]);
+        } else if (arg == "--texture" && i + 1 < argc) {
+            config.texturePaths.push_back(argv[++i]);  // May be repeated
+        } else if (arg == "--upload-budget" && i + 1 < argc) {
+            config.textureUploadBudget = std::stoull(argv[++i]);  // Bytes per frame
+        } else if (arg == "--render-path" && i + 1 < argc) {
+            config.renderPath = parseRenderPath(argv[++i]);
+        } else if (arg == "--record-threads" && i + 1 < argc) {
+            config.recordThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--bench-objects") {
+            config.benchmarkObjects = true;
+        } else if (arg == "--bench-object-counts" && i + 1 < argc) {
+            // Comma separated, e.g. 1000,10000,100000
+            config.benchmarkObjectCounts.clear();
+            std::string counts = argv[++i];
+            for (size_t start = 0; start < counts.size();) {
+                size_t end = counts.find(',', start);
+                if (end == std::string::npos) end = counts.size();
+                config.benchmarkObjectCounts.push_back(
+                    static_cast<uint32_t>(std::stoul(counts.substr(start, end - start))));
+                start = end + 1;
             }
-        }
-    }
-
-    bool checkValidationLayerSupport() {
-        // Get the number of layer properties
-        uint32_t layerCount;
-        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
-
-        std::vector<VkLayerProperties> availableLayers(layerCount);
-        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
-
-        // My method again for checking two lists
-        std::unordered_map<std::string, bool> requestedValidationLayersLut{};
-        for (const char *requestedLayer : validationLayers) {
-            requestedValidationLayersLut.insert({requestedLayer, false});
-        }
-
-        for (const auto &layer : availableLayers) {
-            if (requestedValidationLayersLut.contains(layer.layerName)) {
-                requestedValidationLayersLut[layer.layerName] = true;
-            }
-        }
-
-        for (auto &pair : requestedValidationLayersLut) {
-            if (pair.second == false) return false;
-        }
-
-        return true;
-    }
-
-    void setupDebugMessenger() {
-        if (!enableValidationLayers) return;
-
-        // Setup the debugger
-        VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        populateDebugMessengerCreateInfo(createInfo);
-
-        // Pass it to Vulkan
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to set up debug messenger");
-        }
-    }
-
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
-        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                                 VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                                 VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
-        createInfo.pUserData = nullptr;  // Optional
-        createInfo.flags = 0;
-    }
-
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-                                                        VkDebugUtilsMessageTypeFlagsEXT messageTypes,
-                                                        const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-                                                        void *pUserData) {
-        switch (messageSeverity) {
-            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-                std::cout << "[DEBUG]\t" << pCallbackData->pMessage << "\n";
-                break;
-            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-                std::cout << "[WARN]\t" << pCallbackData->pMessage << "\n";
-                break;
-            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
-                std::cerr << "[ERROR]\t" << pCallbackData->pMessage << "\n";
-                break;
-            default:
-                std::cerr << "[UNKNOWN]\t" << pCallbackData->pMessage << "\n";
-        }
-
-        // Indicates if the Vulkan call that triggered the validation layer message should be aborted
-        return VK_FALSE;  // Normally keep false
-    }
-
-    void createSurface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create window surface");
-        }
-    }
-
-    void pickPhysicalDevice() {
-        uint32_t deviceCount = 0;
-        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-
-        if (deviceCount == 0) throw std::runtime_error("Failed to find GPUs that support Vulkan");
-
-        std::vector<VkPhysicalDevice> devices(deviceCount);
-        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-
-        for (const auto &device : devices) {
-            if (isDeviceSuitable(device)) {
-                physicalDevice = device;
-                break;
-            }
-        }
-
-        if (physicalDevice == VK_NULL_HANDLE) throw std::runtime_error("No suitable GPUs");
-    }
-
-    bool isDeviceSuitable(VkPhysicalDevice device) {
-        // Basic device properties like the name, type and supported Vulkan version
-        VkPhysicalDeviceProperties deviceProperties;
-        vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-        // Optional features like texture compression, 64-bit floats and multi viewport rendering
-        VkPhysicalDeviceFeatures deviceFeatures;
-        vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-        // As an example
-        // return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU && deviceFeatures.geometryShader;
-        // We could also score the devices and get the most suitable one
-
-        // We care about supported: vulkan version, queue families, extensions, swap chain
-        bool supportsVulkan1_3 = deviceProperties.apiVersion >= VK_VERSION_1_3;
-        QueueFamilyIndices queueFamilies = findQueueFamilies(device);
-        bool extensionsSupported = checkDeviceExtensionSupport(device);
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
-            SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-            swapChainAdequate = !swapChainSupport.surfaceFormats.empty() && !swapChainSupport.presentationModes.empty();
-        }
-
-        return supportsVulkan1_3 && queueFamilies.isComplete() && extensionsSupported && swapChainAdequate;
-    }
-
-    bool checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice) {
-        uint32_t extensionCount;
-        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
-
-        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
-
-        std::set<std::string> requiredExtensions(std::begin(deviceExtensions), std::end(deviceExtensions));
-
-        for (const auto &extension : availableExtensions) {
-            requiredExtensions.erase(extension.extensionName);
-        }
-
-        return requiredExtensions.empty();
-    }
-
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice physicalDevice) {
-        SwapChainSupportDetails details;
-
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &details.capabilities);
-
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, nullptr);
-        if (formatCount != 0) {
-            details.surfaceFormats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, details.surfaceFormats.data());
-        }
-
-        uint32_t presentationModeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentationModeCount, nullptr);
-        if (presentationModeCount != 0) {
-            details.presentationModes.resize(presentationModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentationModeCount,
-                                                      details.presentationModes.data());
-        }
-
-        return details;
-    }
-
-    // Chooses the best swap chain format; we will prefer 32-bit SRGB colors
-    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats) {
-        for (const auto &availableFormat : availableFormats) {
-            if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB &&
-                availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-                return availableFormat;
-            }
-        }
-
-        return availableFormats[0];
-    }
-
-    // The most important part of the swap chain with 4 different modes including immediate, v-sync, triple buffer, etc.
-    VkPresentModeKHR chooseSwapPresentationMode(const std::vector<VkPresentModeKHR> &availablePresentationModes) {
-        for (const auto &availableMode : availablePresentationModes) {
-            // This mode is a good trade-off of low latency and no tearing if energy is not a concern
-            if (availableMode == VK_PRESENT_MODE_MAILBOX_KHR) return availableMode;
-        }
-
-        return VK_PRESENT_MODE_FIFO_KHR;  // v-sync similar option is the only one guaranteed to be available
-    }
-
-    // The resolution of the swap chain images. It's almost always exactly equal to the resolution of the window that
-    // we're drawing to in pixels (can differ on high pixel-density displays)
-    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
-        if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) return capabilities.currentExtent;
-
-        // If the width was the max, we are dealing with a high density display and need to get true pixel locations
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-
-        VkExtent2D actualExtent = {
-            static_cast<uint32_t>(width),
-            static_cast<uint32_t>(height),
-        };
-
-        actualExtent.width =
-            std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-        actualExtent.height =
-            std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
-        return actualExtent;
-    }
-
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
-        QueueFamilyIndices indices;
-
-        uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-
-        // Find the indices in the queue families of the queues we need
-        VkBool32 presentationSupport = false;
-        int i = 0;
-        for (const auto &queueFamily : queueFamilies) {
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) indices.graphicsFamily = i;
-
-            // Will likely be the graphics family too but this is a more general support
-            if (!presentationSupport) {
-                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
-                if (presentationSupport) indices.presentationFamily = i;
-            }
-
-            if (indices.isComplete()) break;
-            i++;
-        }
-
-        return indices;
-    }
-
-    void createLogicalDevice() {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        std::set queueFamilySet = {indices.graphicsFamily.value(), indices.presentationFamily.value()};
-
-        // This is not pre-allocated because values in the set could map to the same key, so the set could be smaller
-        // than it appears e.g. graphics and presentation families are typically the same but might not be.
-        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-
-        // Specifies the queues we want
-        float queuePriority = 1.0f;
-        for (uint32_t queueFamily : queueFamilySet) {
-            VkDeviceQueueCreateInfo queueCreateInfo{};
-            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
-            queueCreateInfos.push_back(queueCreateInfo);
-        }
-
-        // The specifies what special features we want to use
-        VkPhysicalDeviceFeatures deviceFeatures{};
-
-        // Finally create the logical device
-        VkDeviceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        createInfo.pQueueCreateInfos = queueCreateInfos.data();
-        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-        createInfo.pEnabledFeatures = &deviceFeatures;
-
-        // Similar to VkInstanceCreateInfo but device specific
-        createInfo.enabledExtensionCount = std::size(deviceExtensions);
-        createInfo.ppEnabledExtensionNames = deviceExtensions;
-
-        if (enableValidationLayers) {  // Newer versions don't need this but good for compatibility
-            createInfo.enabledLayerCount = std::size(validationLayers);
-            createInfo.ppEnabledLayerNames = validationLayers;
+        } else if (arg == "--profile") {
+            config.profile = true;
+        } else if (arg == "--profile-trace" && i + 1 < argc) {
+            config.profile = true;
+            config.profileTracePath = argv[++i];
+        } else if (arg == "--startup-trace" && i + 1 < argc) {
+            config.startupTracePath = argv[++i];
+        } else if (arg == "--bench-pipelines") {
+            config.benchmarkPipelines = true;
         } else {
-            createInfo.enabledLayerCount = 0;
-        }
-
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create logical device");
-        }
-
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentationFamily.value(), 0, &presentationQueue);
-    }
-
-    void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.surfaceFormats);
-        VkPresentModeKHR presentMode = chooseSwapPresentationMode(swapChainSupport.presentationModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
-
-        swapChainImageFormat = surfaceFormat.format;
-        swapChainExtent = extent;
-
-        // We need to specify how many images to keep in the swap chain. There is a required minimum amount, but it is
-        // recommended to keep 1 more than the required minimum
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-
-        // We also need to set below the maximum images allowed in the swap chain (0 means there is no max)
-        if (swapChainSupport.capabilities.maxImageCount > 0 &&
-            imageCount > swapChainSupport.capabilities.maxImageCount) {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
-
-        // Now the Create Info struct
-        VkSwapchainCreateInfoKHR createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface;
-        createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1;  // Amount of layers each image has. Always 1 unless a 3D app
-        createInfo.imageUsage =
-            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;  // What we are going to use the images in the chain for. We are
-                                                  // rendering them directly so use this one
-
-        // We now need to handle if images are used across queues. Again, the graphics and presentation queues are
-        // typically the same, but it is possible it can differ
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentationFamily.value()};
-
-        if (indices.graphicsFamily != indices.presentationFamily) {
-            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;  // Images can be used across multiple queue
-                                                                       // families without explicit ownership transfers
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
-        } else {
-            createInfo.imageSharingMode =
-                VK_SHARING_MODE_EXCLUSIVE;  // An image is owned by one queue family at a time and ownership must be
-                                            // explicitly transferred before using it in another queue family. This
-                                            // option offers the best performance
-            createInfo.queueFamilyIndexCount = 0;      // Optional
-            createInfo.pQueueFamilyIndices = nullptr;  // Optional
-        }
-
-        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;  // Dont perform any extra transforms
-        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;             // No blending on the alpha channel
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;  // Clips out pixels if the window is obscured
-        createInfo.oldSwapchain =
-            VK_NULL_HANDLE;  // Many conditions can cause the swap chain to be invalidated and new chain must be created
-                             // (such as window resizing). This is complex so assume only 1 chain for now
-
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create swap chain");
-        }
-
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-        swapChainsImages.resize(imageCount);
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainsImages.data());
-    }
-
-    // An image view is quite literally a view into an image. It describes how to access the image and which part of the
-    // image to access.
-    void createImageViews() {
-        swapChainImageViews.resize(swapChainsImages.size());
-
-        for (size_t i = 0; i < swapChainsImages.size(); i++) {
-            VkImageViewCreateInfo createInfo{};
-            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            createInfo.image = swapChainsImages[i];
-
-            // Specify how the image should be interpreted
-            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            createInfo.format = swapChainImageFormat;
-
-            // Keep default color mappings
-            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-
-            // Describe what the image's purpose is and which part of the image should be accessed. Our images will be
-            // used as color targets without any mipmapping levels or multiple layers.
-            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            createInfo.subresourceRange.baseMipLevel = 0;
-            createInfo.subresourceRange.levelCount = 1;
-            createInfo.subresourceRange.baseArrayLayer = 0;
-            createInfo.subresourceRange.layerCount = 1;
-
-            if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS) {
-                throw std::runtime_error("Failed to create image views");
-            }
-        }
-    }
-
-    static std::vector<char> readFile(const std::string &filename) {
-        // 'ate' means to read at the end of the file so we can get the size ahead of time
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-        if (!file.is_open()) throw std::runtime_error("Failed to open file");
-
-        // Allocate buffer for file
-        size_t fileSize = (size_t)file.tellg();
-        std::vector<char> buffer(fileSize);
-
-        // Read in the file
-        file.seekg(0);  // go to the beginning
-        file.read(buffer.data(), fileSize);
-
-        file.close();
-        return buffer;
-    }
-
-    VkShaderModule createShaderModule(const std::vector<char> &shaderCode) {
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = shaderCode.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t *>(shaderCode.data());
-
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create shader module");
-        }
-
-        return shaderModule;
-    }
-
-    void createRenderPass() {
-        VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        VkAttachmentReference colorAttachmentRef{};
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colorAttachmentRef;
-
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = 1;
-        renderPassInfo.pAttachments = &colorAttachment;
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
-
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create render pass");
-        }
-    }
-
-    void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("../shaders/shader.vert.spv");
-        auto fragShaderCode = readFile("../shaders/shader.frag.spv");
-
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";
-
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
-
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-        // describes the format of the vertex data that will be passed to the vertex shader
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.pVertexBindingDescriptions = nullptr;  // Optional
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
-        vertexInputInfo.pVertexAttributeDescriptions = nullptr;  // Optional
-
-        // describes two things: what kind of geometry will be drawn from the vertices and if primitive restart should
-        // be enabled
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent.width);
-        viewport.height = static_cast<float>(swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = swapChainExtent;
-
-        std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-        dynamicState.pDynamicStates = dynamicStates.data();
-
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.scissorCount = 1;
-
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-        rasterizer.depthBiasConstantFactor = 0.0f;  // Optional
-        rasterizer.depthBiasClamp = 0.0f;           // Optional
-        rasterizer.depthBiasSlopeFactor = 0.0f;     // Optional
-
-        // configures multisampling, which is one of the ways to perform antialiasing -- disabled for now
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisampling.minSampleShading = 1.0f;           // Optional
-        multisampling.pSampleMask = nullptr;             // Optional
-        multisampling.alphaToCoverageEnable = VK_FALSE;  // Optional
-        multisampling.alphaToOneEnable = VK_FALSE;       // Optional
-
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask =
-            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
-        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;   // Optional
-        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;  // Optional
-        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;              // Optional
-        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;   // Optional
-        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;  // Optional
-        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;              // Optional
-
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY;  // Optional
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f;  // Optional
-        colorBlending.blendConstants[1] = 0.0f;  // Optional
-        colorBlending.blendConstants[2] = 0.0f;  // Optional
-        colorBlending.blendConstants[3] = 0.0f;  // Optional
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 0;             // Optional
-        pipelineLayoutInfo.pSetLayouts = nullptr;          // Optional
-        pipelineLayoutInfo.pushConstantRangeCount = 0;     // Optional
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;  // Optional
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create pipeline layout");
+            throw std::runtime_error("Unknown argument: " + arg);
         }
-
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = nullptr;  // Optional
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;  // Optional
-        pipelineInfo.basePipelineIndex = -1;               // Optional
-
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) !=
-            VK_SUCCESS) {
-            throw std::runtime_error("Failed to create graphics pipeline");
-        }
-
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
     }
 
-    void createFramebuffer() {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            VkImageView attachments[] = {swapChainImageViews[i]};
-
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = 1;
-            framebufferInfo.pAttachments = attachments;
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
-
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("Failed to create framebuffer");
-            }
-        }
-    }
-
-    void createCommandPool() {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create command pool");
-        }
-    }
-
-    void createCommandBuffer() {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = 1;
-
-        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to allocate command buffers");
-        }
-    }
-
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = 0;                   // Optional
-        beginInfo.pInheritanceInfo = nullptr;  // Optional
-
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to begin recording command buffer");
-        }
-
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
-
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
-
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent.width);
-        viewport.height = static_cast<float>(swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = swapChainExtent;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-
-        vkCmdEndRenderPass(commandBuffer);
-
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to record command buffer");
-        }
-    }
-
-    void createSyncObjects() {
-        VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
-        VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS ||
-            vkCreateFence(device, &fenceInfo, nullptr, &inFlightFence) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create synchronization objects");
-        }
-    }
-
-    void initVulkan() {
-        createInstance();
-        setupDebugMessenger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
-        createFramebuffer();
-        createCommandPool();
-        createCommandBuffer();
-        createSyncObjects();
-    }
-
-    void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
-            drawFrame();
-        }
-
-        vkDeviceWaitIdle(device);
-    }
-
-    void drawFrame() {
-        vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
-        vkResetFences(device, 1, &inFlightFence);
-
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-
-        vkResetCommandBuffer(commandBuffer, 0);
-        recordCommandBuffer(commandBuffer, imageIndex);
-
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphore};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
-
-        VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signalSemaphores;
-
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFence) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to submit draw command buffer");
-        }
-
-        VkPresentInfoKHR presentInfo{};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = signalSemaphores;
-
-        VkSwapchainKHR swapChains[] = {swapChain};
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;
-        presentInfo.pImageIndices = &imageIndex;
-        presentInfo.pResults = nullptr;  // Optional
-
-        vkQueuePresentKHR(presentationQueue, &presentInfo);
-    }
-
-    void cleanup() {
-        vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
-        vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-        vkDestroyFence(device, inFlightFence, nullptr);
-        vkDestroyCommandPool(device, commandPool, nullptr);
-        for (auto framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
-        }
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyRenderPass(device, renderPass, nullptr);
-        for (auto imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
-        }
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
-        vkDestroyDevice(device, nullptr);
-        if (enableValidationLayers) {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
-        }
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
-        glfwDestroyWindow(window);
-        glfwTerminate();
-    }
-};
-
-int main() {
-    HelloTriangleApplication app;
+    return config;
+}
 
+int main(int argc, char **argv) {
     try {
+        HelloTriangleApplication app(parseArgs(argc, argv));
         app.run();
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,155 @@
+// Build time tool that packs compiled SPIR-V modules into one shader bundle (see ShaderBundle.h), and optionally into a
+// C++ source file that embeds the bundle in the executable. Every module is reflected on the way in, so a module the
+// application would fail to build a pipeline layout for breaks the build instead of the first launch:
+//
+//   vk-learning-pack-shaders shaders.bundle [--embed embedded_shaders.cpp] [--reflection shaders.reflection.json]
+//       shader.vert=shader.vert.spv shader.frag=shader.frag.spv
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ShaderBundle.h"
+#include "SpirvReflection.h"
+
+static std::vector<uint32_t> readSpirv(const std::string &filename) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0) throw std::runtime_error("Not a SPIR-V module: " + filename);
+
+    std::vector<uint32_t> code(fileSize / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(code.data()), static_cast<std::streamsize>(fileSize));
+    return code;
+}
+
+static void writeBundle(const std::string &filename, const std::vector<uint32_t> &bundle) {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+
+    file.write(reinterpret_cast<const char *>(bundle.data()),
+               static_cast<std::streamsize>(bundle.size() * sizeof(uint32_t)));
+}
+
+// A uint32_t array rather than bytes, so the embedded bundle gets the alignment it needs for free
+static void writeEmbeddedSource(const std::string &filename, const std::vector<uint32_t> &bundle) {
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+
+    file << "// Generated by vk-learning-pack-shaders, do not edit\n";
+    file << "#include <cstddef>\n#include <cstdint>\n\n";
+    file << "extern const uint32_t embeddedShaderBundle[] = {";
+
+    char word[16];
+    for (size_t i = 0; i < bundle.size(); i++) {
+        if (i % 8 == 0) file << "\n   ";
+        std::snprintf(word, sizeof(word), " 0x%08x,", bundle[i]);
+        file << word;
+    }
+
+    file << "\n};\n";
+    file << "extern const size_t embeddedShaderBundleSize = sizeof(embeddedShaderBundle);\n";
+}
+
+// What the application will see at runtime, for humans and for diffing between builds. Enum values are the raw Vulkan
+// values (VkFormat, VkDescriptorType, VkShaderStageFlagBits)
+static void writeReflection(const std::string &filename,
+                            const std::vector<std::pair<std::string, ShaderReflection>> &reflections) {
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+
+    file << "{\n";
+    for (size_t i = 0; i < reflections.size(); i++) {
+        auto &[name, reflection] = reflections[i];
+        file << "  \"" << name << "\": {\n";
+        file << "    \"stage\": " << reflection.stage << ",\n";
+        file << "    \"entryPoint\": \"" << reflection.entryPoint << "\",\n";
+
+        file << "    \"vertexInputs\": [";
+        for (size_t j = 0; j < reflection.vertexInputs.size(); j++) {
+            auto &input = reflection.vertexInputs[j];
+            file << (j == 0 ? "" : ", ") << "{\"location\": " << input.location << ", \"format\": " << input.format
+                 << ", \"name\": \"" << input.name << "\"}";
+        }
+        file << "],\n";
+
+        file << "    \"descriptorBindings\": [";
+        for (size_t j = 0; j < reflection.descriptorBindings.size(); j++) {
+            auto &binding = reflection.descriptorBindings[j];
+            file << (j == 0 ? "" : ", ") << "{\"set\": " << binding.set << ", \"binding\": " << binding.binding
+                 << ", \"type\": " << binding.descriptorType << ", \"count\": " << binding.descriptorCount
+                 << ", \"name\": \"" << binding.name << "\"}";
+        }
+        file << "],\n";
+
+        file << "    \"pushConstants\": {\"offset\": " << reflection.pushConstantOffset
+             << ", \"size\": " << reflection.pushConstantSize << "},\n";
+
+        file << "    \"specializationConstants\": [";
+        for (size_t j = 0; j < reflection.specializationConstants.size(); j++) {
+            auto &constant = reflection.specializationConstants[j];
+            file << (j == 0 ? "" : ", ") << "{\"id\": " << constant.constantId << ", \"name\": \"" << constant.name
+                 << "\", \"default\": " << constant.defaultValue << "}";
+        }
+        file << "]\n";
+
+        file << "  }" << (i + 1 < reflections.size() ? "," : "") << "\n";
+    }
+    file << "}\n";
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc < 3) {
+            throw std::runtime_error("Usage: " + std::string(argv[0]) +
+                                     " <output.bundle> [--embed <output.cpp>] [--reflection <output.json>]"
+                                     " <name>=<module.spv>...");
+        }
+
+        std::string bundlePath = argv[1];
+        std::string embedPath;
+        std::string reflectionPath;
+        std::vector<std::pair<std::string, std::vector<uint32_t>>> modules;
+
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--embed" && i + 1 < argc) {
+                embedPath = argv[++i];
+                continue;
+            }
+            if (arg == "--reflection" && i + 1 < argc) {
+                reflectionPath = argv[++i];
+                continue;
+            }
+
+            size_t separator = arg.find('=');
+            if (separator == std::string::npos) throw std::runtime_error("Expected <name>=<module.spv>: " + arg);
+            modules.emplace_back(arg.substr(0, separator), readSpirv(arg.substr(separator + 1)));
+        }
+
+        std::vector<std::pair<std::string, ShaderReflection>> reflections;
+        for (auto &[name, code] : modules) {
+            try {
+                reflections.emplace_back(name, reflectSpirv(code));
+            } catch (const std::exception &e) {
+                throw std::runtime_error("Failed to reflect " + name + ": " + e.what());
+            }
+        }
+
+        std::vector<uint32_t> bundle = buildShaderBundle(modules);
+        writeBundle(bundlePath, bundle);
+        if (!embedPath.empty()) writeEmbeddedSource(embedPath, bundle);
+        if (!reflectionPath.empty()) writeReflection(reflectionPath, reflections);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}